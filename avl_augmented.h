@@ -0,0 +1,406 @@
+#ifndef AVL_AUGMENTED_H
+#define AVL_AUGMENTED_H
+
+#include <limits>
+#include <type_traits>
+#include "avlbst.h"
+
+/*
+  Range aggregates
+
+  AugmentedAVLTree caches, in every node, a monoid aggregate of the values
+  in its subtree. Inserts and removes recompute the path they changed,
+  rotations recompute the two nodes they moved, and bulk builds (copies,
+  deserialize, image loads) recompute what they built, so the aggregate of
+  the values of any key range [lo, hi] takes O(log n): the two boundary
+  paths below the node where lo and hi part ways, plus the cached
+  aggregates of the subtrees hanging off them.
+
+  A monoid supplies the aggregate type, its identity, how to lift one
+  value into it and an associative combine (it need not be commutative;
+  items are combined in key order):
+
+    struct Monoid
+    {
+        typedef ... value_type;
+        value_type identity() const;
+        value_type lift(const Value& value) const;
+        value_type combine(const value_type& a, const value_type& b) const;
+    };
+
+  SumMonoid, MinMonoid and MaxMonoid are provided. Values must only be
+  changed through insert(), which keeps the aggregates current; writing
+  through an iterator does not.
+
+    AugmentedAVLTree<long, double, SumMonoid<double> > volume;
+    double total = volume.aggregate(from, to);
+*/
+
+template<typename T>
+struct SumMonoid
+{
+    typedef T value_type;
+    T identity() const { return T(); }
+    T lift(const T& value) const { return value; }
+    T combine(const T& a, const T& b) const { return a + b; }
+};
+
+template<typename T>
+struct MinMonoid
+{
+    typedef T value_type;
+    T identity() const { return std::numeric_limits<T>::has_infinity ? std::numeric_limits<T>::infinity() : std::numeric_limits<T>::max(); }
+    T lift(const T& value) const { return value; }
+    T combine(const T& a, const T& b) const { return b < a ? b : a; }
+};
+
+template<typename T>
+struct MaxMonoid
+{
+    typedef T value_type;
+    T identity() const { return std::numeric_limits<T>::has_infinity ? -std::numeric_limits<T>::infinity() : std::numeric_limits<T>::lowest(); }
+    T lift(const T& value) const { return value; }
+    T combine(const T& a, const T& b) const { return a < b ? b : a; }
+};
+
+/**
+* An AVL node that also caches the aggregate of its subtree
+*/
+template <typename Key, typename Value, typename Aggregate>
+class AugmentedAVLNode : public AVLNode<Key, Value>
+{
+public:
+    AugmentedAVLNode(const Key& key, const Value& value, AVLNode<Key, Value>* parent, const Aggregate& aggregate);
+    virtual ~AugmentedAVLNode();
+
+    const Aggregate& getAggregate() const;
+    void setAggregate(const Aggregate& aggregate);
+
+protected:
+    Aggregate aggregate_;
+};
+
+/*
+  ----------------------------------------------------
+  Begin implementations for the AugmentedAVLNode class.
+  ----------------------------------------------------
+*/
+
+template<class Key, class Value, class Aggregate>
+AugmentedAVLNode<Key, Value, Aggregate>::AugmentedAVLNode(const Key& key, const Value& value, AVLNode<Key, Value>* parent, const Aggregate& aggregate) :
+    AVLNode<Key, Value>(key, value, parent), aggregate_(aggregate)
+{
+
+}
+
+template<class Key, class Value, class Aggregate>
+AugmentedAVLNode<Key, Value, Aggregate>::~AugmentedAVLNode()
+{
+
+}
+
+template<class Key, class Value, class Aggregate>
+const Aggregate& AugmentedAVLNode<Key, Value, Aggregate>::getAggregate() const
+{
+    return aggregate_;
+}
+
+template<class Key, class Value, class Aggregate>
+void AugmentedAVLNode<Key, Value, Aggregate>::setAggregate(const Aggregate& aggregate)
+{
+    aggregate_ = aggregate;
+}
+
+/*
+  --------------------------------------------------
+  End implementations for the AugmentedAVLNode class.
+  --------------------------------------------------
+*/
+
+template <class Key, class Value, class Monoid, class Compare = std::less<Key> >
+class AugmentedAVLTree : public AVLTree<Key, Value, Compare>
+{
+public:
+    typedef typename Monoid::value_type Aggregate;
+    typedef AugmentedAVLNode<Key, Value, Aggregate> AugNode;
+
+    explicit AugmentedAVLTree(const Monoid& monoid = Monoid(), const Compare& comp = Compare());
+    AugmentedAVLTree(const AugmentedAVLTree& other);
+    AugmentedAVLTree(AugmentedAVLTree&& other);
+    AugmentedAVLTree& operator=(const AugmentedAVLTree& other);
+    AugmentedAVLTree& operator=(AugmentedAVLTree&& other);
+    void swap(AugmentedAVLTree& other);
+
+    Aggregate aggregate() const; // Of every value
+    Aggregate aggregate(const Key& lo, const Key& hi) const; // Of the values with keys in [lo, hi]
+
+    // Hides the writable overload, which would bypass the aggregates
+    Value const & operator[](const Key& key) const;
+
+protected:
+    virtual Node<Key, Value>* createNode(const Key& key, const Value& value, Node<Key, Value>* parent) const override;
+    virtual Node<Key, Value>* constructNode(void* place, const Key& key, const Value& value, Node<Key, Value>* parent) const override;
+    virtual size_t getNodeSize() const override;
+    virtual bool nodesTriviallyDestructible() const override;
+    virtual void nodeSwap(AVLNode<Key, Value>* n1, AVLNode<Key, Value>* n2) override;
+    virtual void augmentSubtree(Node<Key, Value>* root) override;
+    virtual void _augmentPath(AVLNode<Key, Value>* n) override;
+    virtual void _augmentRotation(AVLNode<Key, Value>* lower, AVLNode<Key, Value>* upper) override;
+
+    void _augmentNode(AVLNode<Key, Value>* n); // Recomputes n's aggregate from its children's
+    Aggregate _subtreeAggregate(AVLNode<Key, Value>* n) const; // The cached aggregate, or the identity for null
+    static AVLNode<Key, Value>* _firstPostOrder(AVLNode<Key, Value>* n);
+
+    Monoid monoid_;
+};
+
+/*
+  ----------------------------------------------------
+  Begin implementations for the AugmentedAVLTree class.
+  ----------------------------------------------------
+*/
+
+/**
+* Constructs an empty tree aggregating with monoid and ordered by comp
+*/
+template<class Key, class Value, class Monoid, class Compare>
+AugmentedAVLTree<Key, Value, Monoid, Compare>::AugmentedAVLTree(const Monoid& monoid, const Compare& comp) :
+    AVLTree<Key, Value, Compare>(comp), monoid_(monoid)
+{
+
+}
+
+/**
+* Copy constructor. Clones in the body, like AVLTree's, so that the clone
+* is made of augmented nodes; their aggregates are recomputed once built.
+*/
+template<class Key, class Value, class Monoid, class Compare>
+AugmentedAVLTree<Key, Value, Monoid, Compare>::AugmentedAVLTree(const AugmentedAVLTree& other) :
+    AVLTree<Key, Value, Compare>(other.comp_), monoid_(other.monoid_)
+{
+    this->relaxed_ = other.relaxed_;
+    this->relaxedSteps_ = other.relaxedSteps_;
+    this->_copyFrom(other);
+}
+
+template<class Key, class Value, class Monoid, class Compare>
+AugmentedAVLTree<Key, Value, Monoid, Compare>::AugmentedAVLTree(AugmentedAVLTree&& other) :
+    AVLTree<Key, Value, Compare>(other.comp_), monoid_(other.monoid_)
+{
+    this->_requireTreeType(other, typeid(AugmentedAVLTree));
+    this->_swapContents(other);
+}
+
+template<class Key, class Value, class Monoid, class Compare>
+AugmentedAVLTree<Key, Value, Monoid, Compare>& AugmentedAVLTree<Key, Value, Monoid, Compare>::operator=(const AugmentedAVLTree& other)
+{
+    if (this != &other)
+    {
+        // The monoid goes first, since the copy recomputes aggregates with it
+        monoid_ = other.monoid_;
+        AVLTree<Key, Value, Compare>::operator=(other);
+    }
+    return *this;
+}
+
+template<class Key, class Value, class Monoid, class Compare>
+AugmentedAVLTree<Key, Value, Monoid, Compare>& AugmentedAVLTree<Key, Value, Monoid, Compare>::operator=(AugmentedAVLTree&& other)
+{
+    if (this != &other)
+    {
+        monoid_ = other.monoid_;
+        AVLTree<Key, Value, Compare>::operator=(std::move(other));
+    }
+    return *this;
+}
+
+template<class Key, class Value, class Monoid, class Compare>
+void AugmentedAVLTree<Key, Value, Monoid, Compare>::swap(AugmentedAVLTree& other)
+{
+    AVLTree<Key, Value, Compare>::swap(other);
+    std::swap(monoid_, other.monoid_);
+}
+
+template<class Key, class Value, class Monoid, class Compare>
+void swap(AugmentedAVLTree<Key, Value, Monoid, Compare>& a, AugmentedAVLTree<Key, Value, Monoid, Compare>& b)
+{
+    a.swap(b);
+}
+
+/**
+* Returns the aggregate of every value in the tree, in O(1)
+*/
+template<class Key, class Value, class Monoid, class Compare>
+typename AugmentedAVLTree<Key, Value, Monoid, Compare>::Aggregate
+AugmentedAVLTree<Key, Value, Monoid, Compare>::aggregate() const
+{
+    return _subtreeAggregate(static_cast<AVLNode<Key, Value>*>(this->root_));
+}
+
+/**
+* Returns the aggregate of the values whose keys are in [lo, hi], combined
+* in key order (the identity if there are none). Finds the node where the
+* searches for lo and hi part ways, then walks down each boundary, taking
+* whole cached subtrees that lie inside the range.
+*/
+template<class Key, class Value, class Monoid, class Compare>
+typename AugmentedAVLTree<Key, Value, Monoid, Compare>::Aggregate
+AugmentedAVLTree<Key, Value, Monoid, Compare>::aggregate(const Key& lo, const Key& hi) const
+{
+    AVLNode<Key, Value>* split = static_cast<AVLNode<Key, Value>*>(this->root_);
+    while (split)
+    {
+        if (this->comp_(split->getKey(), lo)) split = split->getRight();
+        else if (this->comp_(hi, split->getKey())) split = split->getLeft();
+        else break;
+    }
+    if (!split) return monoid_.identity();
+
+    // Everything at or after lo in the left subtree, built up from the right
+    Aggregate left = monoid_.identity();
+    for (AVLNode<Key, Value>* n = split->getLeft(); n; )
+    {
+        if (this->comp_(n->getKey(), lo)) n = n->getRight();
+        else
+        {
+            left = monoid_.combine(monoid_.lift(n->getValue()), monoid_.combine(_subtreeAggregate(n->getRight()), left));
+            n = n->getLeft();
+        }
+    }
+
+    // Everything at or before hi in the right subtree, built up from the left
+    Aggregate right = monoid_.identity();
+    for (AVLNode<Key, Value>* n = split->getRight(); n; )
+    {
+        if (this->comp_(hi, n->getKey())) n = n->getLeft();
+        else
+        {
+            right = monoid_.combine(monoid_.combine(right, _subtreeAggregate(n->getLeft())), monoid_.lift(n->getValue()));
+            n = n->getRight();
+        }
+    }
+
+    return monoid_.combine(left, monoid_.combine(monoid_.lift(split->getValue()), right));
+}
+
+template<class Key, class Value, class Monoid, class Compare>
+Value const & AugmentedAVLTree<Key, Value, Monoid, Compare>::operator[](const Key& key) const
+{
+    return AVLTree<Key, Value, Compare>::operator[](key);
+}
+
+/*
+* New nodes start out as a subtree of one
+*/
+template<class Key, class Value, class Monoid, class Compare>
+Node<Key, Value>* AugmentedAVLTree<Key, Value, Monoid, Compare>::createNode(const Key& key, const Value& value, Node<Key, Value>* parent) const
+{
+    return new AugNode(key, value, static_cast<AVLNode<Key, Value>*>(parent), monoid_.lift(value));
+}
+
+template<class Key, class Value, class Monoid, class Compare>
+Node<Key, Value>* AugmentedAVLTree<Key, Value, Monoid, Compare>::constructNode(void* place, const Key& key, const Value& value, Node<Key, Value>* parent) const
+{
+    return new (place) AugNode(key, value, static_cast<AVLNode<Key, Value>*>(parent), monoid_.lift(value));
+}
+
+template<class Key, class Value, class Monoid, class Compare>
+size_t AugmentedAVLTree<Key, Value, Monoid, Compare>::getNodeSize() const
+{
+    return sizeof(AugNode);
+}
+
+template<class Key, class Value, class Monoid, class Compare>
+bool AugmentedAVLTree<Key, Value, Monoid, Compare>::nodesTriviallyDestructible() const
+{
+    return AVLTree<Key, Value, Compare>::nodesTriviallyDestructible() && std::is_trivially_destructible<Aggregate>::value;
+}
+
+/*
+* Aggregates stay with their positions, like balances; the remove that
+* swapped the nodes then recomputes the path it changed
+*/
+template<class Key, class Value, class Monoid, class Compare>
+void AugmentedAVLTree<Key, Value, Monoid, Compare>::nodeSwap(AVLNode<Key, Value>* n1, AVLNode<Key, Value>* n2)
+{
+    AVLTree<Key, Value, Compare>::nodeSwap(n1, n2);
+    AugNode* a1 = static_cast<AugNode*>(n1);
+    AugNode* a2 = static_cast<AugNode*>(n2);
+    Aggregate temp = a1->getAggregate();
+    a1->setAggregate(a2->getAggregate());
+    a2->setAggregate(temp);
+}
+
+/*
+* Recomputes every aggregate in a freshly built subtree, children before
+* parents, walking in post-order over the parent links instead of recursing
+*/
+template<class Key, class Value, class Monoid, class Compare>
+void AugmentedAVLTree<Key, Value, Monoid, Compare>::augmentSubtree(Node<Key, Value>* root)
+{
+    if (!root) return;
+
+    AVLNode<Key, Value>* n = static_cast<AVLNode<Key, Value>*>(root);
+    n = _firstPostOrder(n);
+    for (;;)
+    {
+        _augmentNode(n);
+        if (n == root) return;
+
+        AVLNode<Key, Value>* parent = n->getParent();
+        if (parent->getLeft() == n && parent->getRight()) n = _firstPostOrder(parent->getRight());
+        else n = parent;
+    }
+}
+
+template<class Key, class Value, class Monoid, class Compare>
+void AugmentedAVLTree<Key, Value, Monoid, Compare>::_augmentPath(AVLNode<Key, Value>* n)
+{
+    for (; n; n = n->getParent()) _augmentNode(n);
+}
+
+template<class Key, class Value, class Monoid, class Compare>
+void AugmentedAVLTree<Key, Value, Monoid, Compare>::_augmentRotation(AVLNode<Key, Value>* lower, AVLNode<Key, Value>* upper)
+{
+    _augmentNode(lower);
+    _augmentNode(upper);
+}
+
+template<class Key, class Value, class Monoid, class Compare>
+void AugmentedAVLTree<Key, Value, Monoid, Compare>::_augmentNode(AVLNode<Key, Value>* n)
+{
+    Aggregate a = monoid_.combine(_subtreeAggregate(n->getLeft()), monoid_.lift(n->getValue()));
+    static_cast<AugNode*>(n)->setAggregate(monoid_.combine(a, _subtreeAggregate(n->getRight())));
+}
+
+/*
+* Helper for augmentSubtree
+* The first node of n's subtree in post-order: down the left where there
+* is one, else the right, to a leaf
+*/
+template<class Key, class Value, class Monoid, class Compare>
+AVLNode<Key, Value>* AugmentedAVLTree<Key, Value, Monoid, Compare>::_firstPostOrder(AVLNode<Key, Value>* n)
+{
+    for (;;)
+    {
+        if (n->getLeft()) n = n->getLeft();
+        else if (n->getRight()) n = n->getRight();
+        else return n;
+    }
+}
+
+template<class Key, class Value, class Monoid, class Compare>
+typename AugmentedAVLTree<Key, Value, Monoid, Compare>::Aggregate
+AugmentedAVLTree<Key, Value, Monoid, Compare>::_subtreeAggregate(AVLNode<Key, Value>* n) const
+{
+    if (!n) return monoid_.identity();
+    return static_cast<AugNode*>(n)->getAggregate();
+}
+
+/*
+  --------------------------------------------------
+  End implementations for the AugmentedAVLTree class.
+  --------------------------------------------------
+*/
+
+#endif
@@ -0,0 +1,255 @@
+#ifndef AVL_MULTIMAP_H
+#define AVL_MULTIMAP_H
+
+#include <utility>
+#include "avlbst.h"
+
+/*
+  Multimap
+
+  AVLTree::insert overwrites the value of a key that is already there.
+  AVLMultimap keeps every inserted item instead, as its own node, so a key
+  with many values costs no side allocation and its values sit in the tree
+  next to each other. A new duplicate goes after the ones already there,
+  and rotations and removes never reorder nodes, so the values of a key
+  are always iterated in insertion order.
+
+    count(key), equal_range(key)   O(log n + k) for the k items with key
+    removeOne(key)                 removes the oldest of them, O(log n)
+    removeAll(key), remove(key)    finds the run once, O(log n), then
+                                   unlinks its k nodes without searching
+    erase(it)                      removes one item, returns the next
+
+  Each unlink is an ordinary AVL remove: usually a few steps, with up to
+  O(log n) rotations in the rare case that rebalancing climbs to the root.
+
+  find(), lower_bound() and operator[] reach the oldest item of a key.
+  Copies, images and relaxed balancing work as for AVLTree, but
+  deserialize() still requires strictly increasing keys.
+
+    AVLMultimap<std::string, Order> byCustomer;
+    byCustomer.insert(std::make_pair(customer, order));
+    auto range = byCustomer.equal_range(customer);
+    for (auto it = range.first; it != range.second; ++it) ...
+*/
+
+template <class Key, class Value, class Compare = std::less<Key> >
+class AVLMultimap : public AVLTree<Key, Value, Compare>
+{
+public:
+    typedef typename BinarySearchTree<Key, Value, Compare>::iterator iterator;
+
+    explicit AVLMultimap(const Compare& comp = Compare());
+    AVLMultimap(const AVLMultimap& other) = default;
+    AVLMultimap(AVLMultimap&& other);
+    AVLMultimap& operator=(const AVLMultimap& other) = default;
+    AVLMultimap& operator=(AVLMultimap&& other) = default;
+
+    virtual void insert(const std::pair<const Key, Value>& new_item) override; // Adds the item after any others with the same key
+    virtual void remove(const Key& key) override; // Removes every item with key
+    template<typename K, typename C = Compare, typename = typename C::is_transparent>
+    void remove(const K& key); // Same, for lookup keys of other types with a transparent Compare
+    size_t removeAll(const Key& key); // Same, returning how many it removed
+    bool removeOne(const Key& key); // Removes the oldest item with key, if there is one
+    iterator erase(iterator pos); // Removes the item at pos and returns the one after it
+
+    iterator upper_bound(const Key& key) const; // First item whose key is after key
+    std::pair<iterator, iterator> equal_range(const Key& key) const;
+    size_t count(const Key& key) const;
+
+protected:
+    Node<Key, Value>* _upperBound(Node<Key, Value>* current, const Key& key) const; // Finds the first node in the subtree ordered after key
+    template<typename K>
+    size_t _removeRun(const K& key); // Unlinks every node equivalent to key
+};
+
+/*
+  -----------------------------------------------
+  Begin implementations for the AVLMultimap class.
+  -----------------------------------------------
+*/
+
+template<class Key, class Value, class Compare>
+AVLMultimap<Key, Value, Compare>::AVLMultimap(const Compare& comp) :
+    AVLTree<Key, Value, Compare>(comp)
+{
+
+}
+
+/**
+* Move constructor. AVLTree's would refuse a multimap, so this one takes
+* the nodes itself.
+*/
+template<class Key, class Value, class Compare>
+AVLMultimap<Key, Value, Compare>::AVLMultimap(AVLMultimap&& other) :
+    AVLTree<Key, Value, Compare>(other.comp_)
+{
+    this->_requireTreeType(other, typeid(AVLMultimap));
+    this->_swapContents(other);
+}
+
+/**
+* Descends to the upper bound of the key, so that the new node follows
+* every equivalent one, and links it in as a new leaf
+*/
+template<class Key, class Value, class Compare>
+void AVLMultimap<Key, Value, Compare>::insert(const std::pair<const Key, Value>& new_item)
+{
+    if (this->empty())
+    {
+        AVLTree<Key, Value, Compare>::insert(new_item);
+        return;
+    }
+
+    BST_TIMED(TREE_TIME_INSERT);
+    AVLNode<Key, Value>* current = static_cast<AVLNode<Key, Value>*>(this->root_);
+    AVLNode<Key, Value>* parent = nullptr;
+    bool goLeft = false;
+    size_t depth = 0;
+    while (current)
+    {
+        depth++;
+        parent = current;
+        goLeft = this->comp_(new_item.first, current->getKey());
+        current = goLeft ? current->getLeft() : current->getRight();
+    }
+    BST_STAT(treeStatsRecordSearch(depth, depth));
+
+    this->_insertLeaf(parent, goLeft, new_item, depth);
+}
+
+template<class Key, class Value, class Compare>
+void AVLMultimap<Key, Value, Compare>::remove(const Key& key)
+{
+    removeAll(key);
+}
+
+/**
+* Heterogeneous version of remove, which also removes every item with key
+* (the one inherited from BinarySearchTree would remove only the oldest)
+*/
+template<class Key, class Value, class Compare>
+template<typename K, typename C, typename>
+void AVLMultimap<Key, Value, Compare>::remove(const K& key)
+{
+    BST_TIMED(TREE_TIME_REMOVE);
+    _removeRun(key);
+}
+
+template<class Key, class Value, class Compare>
+size_t AVLMultimap<Key, Value, Compare>::removeAll(const Key& key)
+{
+    BST_TIMED(TREE_TIME_REMOVE);
+    return _removeRun(key);
+}
+
+/*
+* Helper for removeAll and remove
+* Finds the oldest item with key once, then walks the run in order, taking
+* each node's successor before unlinking it (removes free only the node
+* they are given, so the successor stays valid)
+*/
+template<class Key, class Value, class Compare>
+template<typename K>
+size_t AVLMultimap<Key, Value, Compare>::_removeRun(const K& key)
+{
+    size_t removed = 0;
+    Node<Key, Value>* current = this->_lowerBound(this->root_, key);
+    while (current && !this->comp_(key, current->getKey()))
+    {
+        Node<Key, Value>* next = this->successor(current);
+        this->_eraseNode(current);
+        current = next;
+        removed++;
+    }
+    return removed;
+}
+
+template<class Key, class Value, class Compare>
+bool AVLMultimap<Key, Value, Compare>::removeOne(const Key& key)
+{
+    BST_TIMED(TREE_TIME_REMOVE);
+    Node<Key, Value>* current = this->_internalFind(this->root_, key);
+    if (!current) return false;
+
+    this->_eraseNode(current);
+    return true;
+}
+
+/**
+* Removes the item at pos, which must not be the end iterator
+*/
+template<class Key, class Value, class Compare>
+typename AVLMultimap<Key, Value, Compare>::iterator
+AVLMultimap<Key, Value, Compare>::erase(iterator pos)
+{
+    BST_TIMED(TREE_TIME_REMOVE);
+    Node<Key, Value>* next = this->successor(pos.current_);
+    this->_eraseNode(pos.current_);
+    return iterator(next);
+}
+
+template<class Key, class Value, class Compare>
+typename AVLMultimap<Key, Value, Compare>::iterator
+AVLMultimap<Key, Value, Compare>::upper_bound(const Key& key) const
+{
+    return iterator(_upperBound(this->root_, key));
+}
+
+/**
+* Returns the items with key as [first, second), both end if there are none
+*/
+template<class Key, class Value, class Compare>
+std::pair<typename AVLMultimap<Key, Value, Compare>::iterator, typename AVLMultimap<Key, Value, Compare>::iterator>
+AVLMultimap<Key, Value, Compare>::equal_range(const Key& key) const
+{
+    Node<Key, Value>* first = this->_lowerBound(this->root_, key);
+    if (!first || this->comp_(key, first->getKey())) return std::make_pair(iterator(first), iterator(first));
+
+    return std::make_pair(iterator(first), iterator(_upperBound(this->root_, key)));
+}
+
+/**
+* Counts by walking the run in order, which costs O(k) after the first
+* descent since successive successors share their paths
+*/
+template<class Key, class Value, class Compare>
+size_t AVLMultimap<Key, Value, Compare>::count(const Key& key) const
+{
+    size_t found = 0;
+    for (Node<Key, Value>* current = this->_lowerBound(this->root_, key);
+         current && !this->comp_(key, current->getKey());
+         current = this->successor(current))
+    {
+        found++;
+    }
+    return found;
+}
+
+/*
+* Helper for upper_bound and equal_range
+* Finds the first node in the subtree whose key is after key
+*/
+template<class Key, class Value, class Compare>
+Node<Key, Value>* AVLMultimap<Key, Value, Compare>::_upperBound(Node<Key, Value>* current, const Key& key) const
+{
+    Node<Key, Value>* candidate = nullptr;
+    while (current)
+    {
+        if (this->comp_(key, current->getKey()))
+        {
+            candidate = current;
+            current = current->getLeft();
+        }
+        else current = current->getRight();
+    }
+    return candidate;
+}
+
+/*
+  ---------------------------------------------
+  End implementations for the AVLMultimap class.
+  ---------------------------------------------
+*/
+
+#endif
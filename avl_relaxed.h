@@ -0,0 +1,297 @@
+#ifndef AVL_RELAXED_H
+#define AVL_RELAXED_H
+
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+/*
+  Relaxed balancing
+
+  In relaxed mode an insert or remove links or unlinks its node like a
+  plain BST and only marks the path above it as pending, by storing
+  AVL_PENDING_BALANCE in place of the balance. Marking stops at the first
+  node that is already pending, so during a burst it costs O(1) per update
+  on average and no rotation is ever done on the update itself.
+
+  Pending nodes always form the top of the tree: every ancestor of a
+  pending node is pending, and a node that is not pending roots a correct
+  AVL subtree. rebalanceStep(budget) repairs pending nodes bottom up, each
+  one by joining its two (correct) subtrees under it the AVL way: walk down
+  the taller one to a subtree at most one level taller than the shorter,
+  hang the node there and retrace with single or double rotations. Each
+  repair costs O(log n), and once nothing is pending the tree is a correct
+  AVL tree again with O(log n) depth.
+
+  Repairs can be driven from an idle loop or timer by calling
+  rebalanceStep(), or piggybacked on updates by passing stepsPerUpdate to
+  setRelaxed(). Lookups and iteration work as usual in either state.
+
+  Repairs go bottom up, so a stream of inserts at the same end of the key
+  range (which keeps re-marking the bottom of the tree) can hold them off
+  indefinitely. To keep the tree from degenerating anyway, an insert that
+  lands at depth d >= 3 log2 n + 3 makes d repairs on the spot, starting
+  right above its new leaf. That fixes the pending path of a same-end
+  burst (whose side subtrees are clean) in O(log^2 n), and in a tree with
+  pending nodes elsewhere it still pays down the backlog by d repairs
+  instead of all of it at once. A correct AVL tree never gets that deep,
+  and a tree built from random keys rarely does, so bursts of random keys
+  never pay for it.
+
+    tree.setRelaxed(true, 1);     // ingest burst, one repair per update
+    ...
+    tree.rebalanceStep(1000);     // later, a bounded slice of catch-up work
+    tree.setRelaxed(false);       // back to strict AVL, finishing all repairs
+*/
+
+#define AVL_PENDING_BALANCE INT8_MAX
+
+/**
+* Turns relaxed balancing on or off. Turning it off first repairs every
+* pending node, so that strict inserts and removes start from a correct tree.
+*/
+template<class Key, class Value, class Compare>
+void AVLTree<Key, Value, Compare>::setRelaxed(bool relaxed, size_t stepsPerUpdate)
+{
+    if (!relaxed) rebalanceStep(SIZE_MAX);
+    relaxed_ = relaxed;
+    relaxedSteps_ = relaxed ? stepsPerUpdate : 0;
+}
+
+template<class Key, class Value, class Compare>
+bool AVLTree<Key, Value, Compare>::relaxed() const
+{
+    return relaxed_;
+}
+
+/**
+* Returns true while some node still waits to be rebalanced
+*/
+template<class Key, class Value, class Compare>
+bool AVLTree<Key, Value, Compare>::rebalancePending() const
+{
+    return this->root_ && static_cast<AVLNode<Key, Value>*>(this->root_)->getBalance() == AVL_PENDING_BALANCE;
+}
+
+/**
+* Repairs up to budget pending nodes, deepest first
+*/
+template<class Key, class Value, class Compare>
+size_t AVLTree<Key, Value, Compare>::rebalanceStep(size_t budget)
+{
+    return _rebalanceFrom(static_cast<AVLNode<Key, Value>*>(this->root_), budget);
+}
+
+/*
+* Helper for rebalanceStep and piggybacked repairs
+* Walks the pending part of the tree in post-order starting below n, so
+* consecutive repairs stay close together, then continues up from n
+*/
+template<class Key, class Value, class Compare>
+size_t AVLTree<Key, Value, Compare>::_rebalanceFrom(AVLNode<Key, Value>* n, size_t budget)
+{
+    size_t repaired = 0;
+    while (repaired < budget && n && n->getBalance() == AVL_PENDING_BALANCE)
+    {
+        // Descend to a pending node whose subtrees are both clean
+        for (;;)
+        {
+            if (n->getLeft() && n->getLeft()->getBalance() == AVL_PENDING_BALANCE) n = n->getLeft();
+            else if (n->getRight() && n->getRight()->getBalance() == AVL_PENDING_BALANCE) n = n->getRight();
+            else break;
+        }
+
+        // Its parent is pending too (or it was the root)
+        n = _repairPending(n)->getParent();
+        repaired++;
+    }
+    return repaired;
+}
+
+/*
+* Helper for relaxed inserts and removes
+* Marks the given node and its ancestors as pending, stopping at the first
+* one that already is
+*/
+template<class Key, class Value, class Compare>
+void AVLTree<Key, Value, Compare>::_markPending(AVLNode<Key, Value>* n)
+{
+    while (n && n->getBalance() != AVL_PENDING_BALANCE)
+    {
+        n->setBalance(AVL_PENDING_BALANCE);
+        n = n->getParent();
+    }
+}
+
+/*
+* Helper for rebalanceStep
+* Rebalances the pending node x, whose subtrees are correct AVL trees of
+* any heights, and returns the root of the subtree now in its place
+*/
+template<class Key, class Value, class Compare>
+AVLNode<Key, Value>* AVLTree<Key, Value, Compare>::_repairPending(AVLNode<Key, Value>* x)
+{
+    int leftHeight = _cleanHeight(x->getLeft());
+    int rightHeight = _cleanHeight(x->getRight());
+    if (leftHeight - rightHeight <= 1 && rightHeight - leftHeight <= 1)
+    {
+        x->setBalance((int8_t)(rightHeight - leftHeight));
+        return x;
+    }
+
+    bool leftTaller = leftHeight > rightHeight;
+    AVLNode<Key, Value>* tall = leftTaller ? x->getLeft() : x->getRight();
+    int tallHeight = leftTaller ? leftHeight : rightHeight;
+    int shortHeight = leftTaller ? rightHeight : leftHeight;
+
+    // The taller subtree takes x's place
+    AVLNode<Key, Value>* parent = x->getParent();
+    bool isLeft = parent && parent->getLeft() == x;
+    tall->setParent(parent);
+    if (!parent) this->root_ = tall;
+    else if (isLeft) parent->setLeft(tall);
+    else parent->setRight(tall);
+
+    // Walk down its inner side to a subtree c at most one level taller than the shorter side
+    std::vector<std::pair<AVLNode<Key, Value>*, int> > spine;
+    AVLNode<Key, Value>* c = tall;
+    int cHeight = tallHeight;
+    while (cHeight > shortHeight + 1)
+    {
+        spine.push_back(std::make_pair(c, cHeight));
+        if (leftTaller)
+        {
+            cHeight -= c->getBalance() == -1 ? 2 : 1;
+            c = c->getRight();
+        }
+        else
+        {
+            cHeight -= c->getBalance() == 1 ? 2 : 1;
+            c = c->getLeft();
+        }
+    }
+
+    // x joins c and the shorter subtree, one level taller than c
+    AVLNode<Key, Value>* top = spine.back().first;
+    x->setParent(top);
+    if (c) c->setParent(x);
+    if (leftTaller)
+    {
+        top->setRight(x);
+        x->setLeft(c);
+        x->setBalance((int8_t)(shortHeight - cHeight));
+    }
+    else
+    {
+        top->setLeft(x);
+        x->setRight(c);
+        x->setBalance((int8_t)(cHeight - shortHeight));
+    }
+    int height = std::max(cHeight, shortHeight) + 1;
+    _augmentPath(x); // x has new children and the spine new descendants; the rotations below keep this up
+
+    // Retrace up the spine; the outer side of every spine node keeps its height
+    for (size_t i = spine.size(); i-- > 0; )
+    {
+        AVLNode<Key, Value>* p = spine[i].first;
+        int pHeight = spine[i].second;
+        if (leftTaller) _restoreBalance(p, p->getBalance() == 1 ? pHeight - 2 : pHeight - 1, height, height);
+        else _restoreBalance(p, height, p->getBalance() == -1 ? pHeight - 2 : pHeight - 1, height);
+    }
+
+    if (!parent) return static_cast<AVLNode<Key, Value>*>(this->root_);
+    return isLeft ? parent->getLeft() : parent->getRight();
+}
+
+/*
+* Helper for _repairPending
+* Given the heights of n's subtrees (both correct AVL trees, differing by
+* at most 2), sets n's balance or rotates, and returns the new subtree root
+* and its height
+*/
+template<class Key, class Value, class Compare>
+AVLNode<Key, Value>* AVLTree<Key, Value, Compare>::_restoreBalance(AVLNode<Key, Value>* n, int leftHeight, int rightHeight, int& height)
+{
+    int diff = rightHeight - leftHeight;
+    if (diff >= -1 && diff <= 1)
+    {
+        n->setBalance((int8_t)diff);
+        height = std::max(leftHeight, rightHeight) + 1;
+        return n;
+    }
+
+    if (diff == 2)
+    {
+        AVLNode<Key, Value>* r = n->getRight();
+        int8_t b = r->getBalance();
+        if (b >= 0)
+        {
+            rotateLeft(n);
+            n->setBalance((int8_t)(1 - b));
+            r->setBalance((int8_t)(b - 1));
+            height = b == 0 ? rightHeight + 1 : rightHeight;
+            return r;
+        }
+
+        AVLNode<Key, Value>* g = r->getLeft();
+        int8_t gb = g->getBalance();
+        rotateRight(r);
+        rotateLeft(n);
+        n->setBalance(gb == 1 ? -1 : 0);
+        r->setBalance(gb == -1 ? 1 : 0);
+        g->setBalance(0);
+        height = rightHeight;
+        return g;
+    }
+
+    AVLNode<Key, Value>* l = n->getLeft();
+    int8_t b = l->getBalance();
+    if (b <= 0)
+    {
+        rotateRight(n);
+        n->setBalance((int8_t)(-1 - b));
+        l->setBalance((int8_t)(b + 1));
+        height = b == 0 ? leftHeight + 1 : leftHeight;
+        return l;
+    }
+
+    AVLNode<Key, Value>* g = l->getRight();
+    int8_t gb = g->getBalance();
+    rotateLeft(l);
+    rotateRight(n);
+    l->setBalance(gb == 1 ? -1 : 0);
+    n->setBalance(gb == -1 ? 1 : 0);
+    g->setBalance(0);
+    height = leftHeight;
+    return g;
+}
+
+/*
+* Helper for relaxed inserts
+* Returns 3 floor(log2 n) + 3, well above the height of any AVL tree of n nodes
+*/
+template<class Key, class Value, class Compare>
+size_t AVLTree<Key, Value, Compare>::_relaxedDepthLimit() const
+{
+    size_t limit = 3;
+    for (size_t n = this->size_; n > 1; n >>= 1) limit += 3;
+    return limit;
+}
+
+/*
+* Helper for _repairPending
+* Follows the taller side down, which the balances of a correct subtree point to
+*/
+template<class Key, class Value, class Compare>
+int AVLTree<Key, Value, Compare>::_cleanHeight(const AVLNode<Key, Value>* n)
+{
+    int height = 0;
+    while (n)
+    {
+        height++;
+        n = n->getBalance() > 0 ? n->getRight() : n->getLeft();
+    }
+    return height;
+}
+
+#endif
@@ -0,0 +1,516 @@
+#ifndef AVL_WAL_H
+#define AVL_WAL_H
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <sstream>
+#include <streambuf>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include <dirent.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include "avlbst.h"
+
+/*
+  Durability layer for AVLTree
+
+  A durable tree lives in a directory holding at most a few files:
+
+    checkpoint-<N>   the tree as written by serialize(), covering every
+                     log segment numbered below N
+    wal-<N>          every insert/remove made after checkpoint-<N>
+
+  Each log record is framed as
+
+    length     uint32_t   size of the payload
+    checksum   uint32_t   FNV-1a of the payload
+    payload    op byte ('I' or 'R'), then the key, then the value for inserts
+
+  Records are buffered in memory and written with a single fdatasync once
+  a group fills up (group commit). On startup the newest checkpoint is
+  loaded and its log segment replayed; a torn record at the end of the log
+  (from a crash mid-write) ends the replay and is truncated away. So does
+  a length that runs past the end of the file.
+*/
+
+#define WAL_OP_INSERT 'I'
+#define WAL_OP_REMOVE 'R'
+
+struct WalOptions
+{
+    WalOptions() : groupCommitOps(64), groupCommitBytes(1 << 20), checkpointEveryOps(1000000) {}
+
+    size_t groupCommitOps;      // fsync after this many buffered mutations
+    size_t groupCommitBytes;    // ...or once this many bytes are buffered
+    size_t checkpointEveryOps;  // write a checkpoint after this many logged mutations (0 = never)
+};
+
+/*
+* FNV-1a hash used to detect torn or corrupted log records
+*/
+inline uint32_t walChecksum(const char* data, size_t size)
+{
+    uint32_t hash = 2166136261u;
+    for (size_t i = 0; i < size; i++)
+    {
+        hash ^= (unsigned char)data[i];
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+/*
+* fsyncs a directory so that renames and unlinks inside it are durable
+*/
+inline void walSyncDirectory(const std::string& dir)
+{
+    int fd = ::open(dir.c_str(), O_RDONLY);
+    if (fd < 0) return;
+    ::fsync(fd);
+    ::close(fd);
+}
+
+/*
+* A stream buffer that appends everything written to it onto a string,
+* so records can be encoded into a reused buffer without extra copies
+*/
+class StringAppendBuf : public std::streambuf
+{
+public:
+    explicit StringAppendBuf(std::string& target) : target_(target) {}
+
+protected:
+    virtual int_type overflow(int_type c) override
+    {
+        if (c != traits_type::eof()) target_.push_back((char)c);
+        return traits_type::not_eof(c);
+    }
+
+    virtual std::streamsize xsputn(const char* data, std::streamsize size) override
+    {
+        target_.append(data, (size_t)size);
+        return size;
+    }
+
+private:
+    std::string& target_;
+};
+
+/**
+* An append-only log file with group commit. Appends only copy into an
+* in-memory buffer; commit() writes the buffer out and fdatasyncs it once.
+*/
+class WriteAheadLog
+{
+public:
+    WriteAheadLog() : fd_(-1), pendingOps_(0) {}
+    ~WriteAheadLog();
+
+    void open(const std::string& path);
+    void close();
+    bool isOpen() const { return fd_ >= 0; }
+
+    void append(const char* record, size_t size);
+    void commit();
+
+    size_t pendingOps() const { return pendingOps_; }
+    size_t pendingBytes() const { return buffer_.size(); }
+
+private:
+    WriteAheadLog(const WriteAheadLog&);              // not copyable
+    WriteAheadLog& operator=(const WriteAheadLog&);
+
+    int fd_;
+    std::string buffer_;
+    size_t pendingOps_;
+};
+
+/**
+* Closes the log; a failed final commit cannot be reported from here
+*/
+inline WriteAheadLog::~WriteAheadLog()
+{
+    try
+    {
+        close();
+    }
+    catch (...)
+    {
+    }
+}
+
+/**
+* Opens (or creates) the log at path for appending
+*/
+inline void WriteAheadLog::open(const std::string& path)
+{
+    close();
+    fd_ = ::open(path.c_str(), O_WRONLY | O_CREAT | O_APPEND, 0644);
+    if (fd_ < 0) throw std::runtime_error("Cannot open write-ahead log " + path);
+}
+
+/**
+* Commits anything still buffered and closes the file
+*/
+inline void WriteAheadLog::close()
+{
+    if (fd_ < 0) return;
+    commit();
+    ::close(fd_);
+    fd_ = -1;
+}
+
+/**
+* Buffers one framed record; nothing reaches the file until commit()
+*/
+inline void WriteAheadLog::append(const char* record, size_t size)
+{
+    buffer_.append(record, size);
+    pendingOps_++;
+}
+
+/**
+* Writes all buffered records and makes them durable with one fdatasync
+*/
+inline void WriteAheadLog::commit()
+{
+    if (fd_ < 0 || buffer_.empty()) return;
+
+    const char* data = buffer_.data();
+    size_t left = buffer_.size();
+    while (left)
+    {
+        ssize_t written = ::write(fd_, data, left);
+        if (written < 0) throw std::runtime_error("Write-ahead log write failed");
+        data += written;
+        left -= (size_t)written;
+    }
+    if (::fdatasync(fd_) != 0) throw std::runtime_error("Write-ahead log sync failed");
+
+    buffer_.clear();
+    pendingOps_ = 0;
+}
+
+/**
+* An AVLTree whose mutations are logged to a write-ahead log and
+* periodically checkpointed, so its contents survive a crash.
+*
+* Mutations acknowledged before the last group commit (or sync()) are
+* durable; ones still in the group buffer may be lost in a crash.
+*
+* Only insert and remove are logged, so the members that would change the
+* tree without a record (the writable operator[], clear, swap, deserialize
+* and clearInBackground) are hidden. Values must not be changed through
+* iterators either.
+*/
+template <typename Key, typename Value, typename Compare = std::less<Key>, typename KeyCodec = StreamCodec<Key>, typename ValueCodec = StreamCodec<Value> >
+class DurableAVLTree : public AVLTree<Key, Value, Compare>
+{
+public:
+    explicit DurableAVLTree(const std::string& dir, const WalOptions& options = WalOptions(), const Compare& comp = Compare());
+    virtual ~DurableAVLTree();
+
+    virtual void insert(const std::pair<const Key, Value>& new_item) override;
+    virtual void remove(const Key& key) override;
+
+    void sync();        // Forces a group commit of every buffered mutation
+    void checkpoint();  // Writes a checkpoint and starts a new log segment
+
+    size_t recoveredOps() const { return recoveredOps_; }
+
+    // Hides the writable overload, which would bypass the log
+    Value const & operator[](const Key& key) const;
+
+protected:
+    void recover();
+    size_t replay(const std::string& path);
+    void logRecord(char op, const Key& key, const Value* value);
+    void checkpointIfDue();
+    std::string fileName(const char* prefix, uint64_t seq) const;
+
+    std::string dir_;
+    WalOptions options_;
+    WriteAheadLog log_;
+    uint64_t seq_;              // sequence number of the current checkpoint / log segment
+    size_t opsSinceCheckpoint_;
+    size_t recoveredOps_;
+    std::string record_;        // reused encoding buffer for one log record
+    StringAppendBuf recordBuf_;
+    std::ostream recordOut_;
+
+private:
+    // Would change the tree without logging it
+    using AVLTree<Key, Value, Compare>::clear;
+    using AVLTree<Key, Value, Compare>::clearInBackground;
+    using AVLTree<Key, Value, Compare>::swap;
+    using AVLTree<Key, Value, Compare>::deserialize;
+};
+
+/*
+  ----------------------------------------------------
+  Begin implementations for the DurableAVLTree class.
+  ----------------------------------------------------
+*/
+
+/**
+* Opens the durable tree stored in dir (which must exist), recovering
+* its contents from the newest checkpoint and log
+*/
+template<typename Key, typename Value, typename Compare, typename KeyCodec, typename ValueCodec>
+DurableAVLTree<Key, Value, Compare, KeyCodec, ValueCodec>::DurableAVLTree(const std::string& dir, const WalOptions& options, const Compare& comp) :
+    AVLTree<Key, Value, Compare>(comp), dir_(dir), options_(options), seq_(0), opsSinceCheckpoint_(0), recoveredOps_(0),
+    recordBuf_(record_), recordOut_(&recordBuf_)
+{
+    recover();
+}
+
+/**
+* Makes every buffered mutation durable before going away
+*/
+template<typename Key, typename Value, typename Compare, typename KeyCodec, typename ValueCodec>
+DurableAVLTree<Key, Value, Compare, KeyCodec, ValueCodec>::~DurableAVLTree()
+{
+    try
+    {
+        log_.close();
+    }
+    catch (...)
+    {
+        // Destructors must not throw; the records stay unacknowledged
+    }
+}
+
+template<typename Key, typename Value, typename Compare, typename KeyCodec, typename ValueCodec>
+std::string DurableAVLTree<Key, Value, Compare, KeyCodec, ValueCodec>::fileName(const char* prefix, uint64_t seq) const
+{
+    return dir_ + "/" + prefix + std::to_string((unsigned long long)seq);
+}
+
+/**
+* Logs the insert, applies it, then checkpoints if one is due
+*/
+template<typename Key, typename Value, typename Compare, typename KeyCodec, typename ValueCodec>
+void DurableAVLTree<Key, Value, Compare, KeyCodec, ValueCodec>::insert(const std::pair<const Key, Value>& new_item)
+{
+    logRecord(WAL_OP_INSERT, new_item.first, &new_item.second);
+    AVLTree<Key, Value, Compare>::insert(new_item);
+    checkpointIfDue();
+}
+
+/**
+* Logs the remove, applies it, then checkpoints if one is due
+*/
+template<typename Key, typename Value, typename Compare, typename KeyCodec, typename ValueCodec>
+void DurableAVLTree<Key, Value, Compare, KeyCodec, ValueCodec>::remove(const Key& key)
+{
+    logRecord(WAL_OP_REMOVE, key, nullptr);
+    AVLTree<Key, Value, Compare>::remove(key);
+    checkpointIfDue();
+}
+
+template<typename Key, typename Value, typename Compare, typename KeyCodec, typename ValueCodec>
+Value const & DurableAVLTree<Key, Value, Compare, KeyCodec, ValueCodec>::operator[](const Key& key) const
+{
+    return AVLTree<Key, Value, Compare>::operator[](key);
+}
+
+/*
+* Frames one mutation and appends it to the log buffer,
+* committing if the group is full
+*/
+template<typename Key, typename Value, typename Compare, typename KeyCodec, typename ValueCodec>
+void DurableAVLTree<Key, Value, Compare, KeyCodec, ValueCodec>::logRecord(char op, const Key& key, const Value* value)
+{
+    // Leave room for the length and checksum, which are filled in once the payload is known
+    record_.assign(8, '\0');
+    recordOut_.put(op);
+    KeyCodec::write(recordOut_, key);
+    if (value) ValueCodec::write(recordOut_, *value);
+
+    uint32_t length = (uint32_t)(record_.size() - 8);
+    uint32_t checksum = walChecksum(record_.data() + 8, length);
+    record_.replace(0, 4, reinterpret_cast<const char*>(&length), 4);
+    record_.replace(4, 4, reinterpret_cast<const char*>(&checksum), 4);
+
+    log_.append(record_.data(), record_.size());
+    opsSinceCheckpoint_++;
+
+    if (log_.pendingOps() >= options_.groupCommitOps || log_.pendingBytes() >= options_.groupCommitBytes) log_.commit();
+}
+
+/*
+* Checkpoints once enough mutations were logged. Only called after the
+* last one was applied, since the checkpoint replaces its log segment.
+*/
+template<typename Key, typename Value, typename Compare, typename KeyCodec, typename ValueCodec>
+void DurableAVLTree<Key, Value, Compare, KeyCodec, ValueCodec>::checkpointIfDue()
+{
+    if (options_.checkpointEveryOps && opsSinceCheckpoint_ >= options_.checkpointEveryOps) checkpoint();
+}
+
+/**
+* Forces every buffered mutation to disk
+*/
+template<typename Key, typename Value, typename Compare, typename KeyCodec, typename ValueCodec>
+void DurableAVLTree<Key, Value, Compare, KeyCodec, ValueCodec>::sync()
+{
+    log_.commit();
+}
+
+/**
+* Writes the whole tree as checkpoint N+1, switches to log segment N+1
+* and then drops the files of generation N, which it now covers
+*/
+template<typename Key, typename Value, typename Compare, typename KeyCodec, typename ValueCodec>
+void DurableAVLTree<Key, Value, Compare, KeyCodec, ValueCodec>::checkpoint()
+{
+    log_.commit();
+
+    uint64_t next = seq_ + 1;
+    std::string path = fileName("checkpoint-", next);
+    std::string tmp = path + ".tmp";
+    {
+        std::ofstream out(tmp.c_str(), std::ios::binary | std::ios::trunc);
+        this->template serialize<KeyCodec, ValueCodec>(out);
+        out.flush();
+        if (!out) throw std::runtime_error("Cannot write checkpoint " + tmp);
+    }
+
+    // The stream has no fsync, so sync the file through a second descriptor before publishing it
+    int fd = ::open(tmp.c_str(), O_RDONLY);
+    if (fd < 0 || ::fsync(fd) != 0)
+    {
+        if (fd >= 0) ::close(fd);
+        throw std::runtime_error("Cannot sync checkpoint " + tmp);
+    }
+    ::close(fd);
+    if (::rename(tmp.c_str(), path.c_str()) != 0) throw std::runtime_error("Cannot publish checkpoint " + path);
+
+    log_.open(fileName("wal-", next));
+    walSyncDirectory(dir_);
+
+    ::unlink(fileName("checkpoint-", seq_).c_str());
+    ::unlink(fileName("wal-", seq_).c_str());
+    seq_ = next;
+    opsSinceCheckpoint_ = 0;
+}
+
+/*
+* Loads the newest checkpoint and replays the log segments written after it
+*/
+template<typename Key, typename Value, typename Compare, typename KeyCodec, typename ValueCodec>
+void DurableAVLTree<Key, Value, Compare, KeyCodec, ValueCodec>::recover()
+{
+    DIR* d = ::opendir(dir_.c_str());
+    if (!d) throw std::runtime_error("Cannot open durable tree directory " + dir_);
+
+    bool haveCheckpoint = false;
+    uint64_t checkpointSeq = 0;
+    std::vector<uint64_t> segments;
+    while (struct dirent* entry = ::readdir(d))
+    {
+        std::string name = entry->d_name;
+        char* end;
+        if (name.compare(0, 11, "checkpoint-") == 0)
+        {
+            uint64_t seq = std::strtoull(name.c_str() + 11, &end, 10);
+            if (*end == '\0' && (!haveCheckpoint || seq > checkpointSeq))
+            {
+                haveCheckpoint = true;
+                checkpointSeq = seq;
+            }
+        }
+        else if (name.compare(0, 4, "wal-") == 0)
+        {
+            uint64_t seq = std::strtoull(name.c_str() + 4, &end, 10);
+            if (*end == '\0') segments.push_back(seq);
+        }
+    }
+    ::closedir(d);
+
+    if (haveCheckpoint)
+    {
+        std::ifstream in(fileName("checkpoint-", checkpointSeq).c_str(), std::ios::binary);
+        this->template deserialize<KeyCodec, ValueCodec>(in);
+    }
+
+    std::sort(segments.begin(), segments.end());
+    seq_ = checkpointSeq;
+    for (size_t i = 0; i < segments.size(); i++)
+    {
+        if (segments[i] < checkpointSeq) continue; // already covered by the checkpoint
+        recoveredOps_ += replay(fileName("wal-", segments[i]));
+        seq_ = segments[i];
+    }
+
+    log_.open(fileName("wal-", seq_));
+    opsSinceCheckpoint_ = recoveredOps_;
+}
+
+/*
+* Applies every intact record of one log segment, truncating a torn tail
+* Returns the number of records applied. A length is checked against what
+* is left of the file before anything is allocated for the payload.
+*/
+template<typename Key, typename Value, typename Compare, typename KeyCodec, typename ValueCodec>
+size_t DurableAVLTree<Key, Value, Compare, KeyCodec, ValueCodec>::replay(const std::string& path)
+{
+    std::ifstream in(path.c_str(), std::ios::binary | std::ios::ate);
+    std::streamoff fileSize = in ? (std::streamoff)in.tellg() : 0;
+    in.seekg(0);
+    size_t applied = 0;
+    std::streamoff good = 0;
+    std::string payload;
+
+    while (true)
+    {
+        uint32_t header[2];
+        in.read(reinterpret_cast<char*>(header), sizeof(header));
+        if (in.gcount() != (std::streamsize)sizeof(header)) break;
+        if (header[0] == 0 || (std::streamoff)header[0] > fileSize - good - (std::streamoff)sizeof(header)) break;
+
+        payload.resize(header[0]);
+        in.read(&payload[0], header[0]);
+        if (in.gcount() != (std::streamsize)header[0]) break;
+        if (walChecksum(payload.data(), payload.size()) != header[1]) break;
+
+        std::istringstream record(payload);
+        char op = (char)record.get();
+        try
+        {
+            Key key = KeyCodec::read(record);
+            if (op == WAL_OP_INSERT)
+            {
+                Value value = ValueCodec::read(record);
+                AVLTree<Key, Value, Compare>::insert(std::make_pair(key, value));
+            }
+            else if (op == WAL_OP_REMOVE) AVLTree<Key, Value, Compare>::remove(key);
+            else break;
+        }
+        catch (std::runtime_error&)
+        {
+            break; // a record that passed its checksum but does not decode
+        }
+
+        applied++;
+        good += (std::streamoff)(sizeof(header) + header[0]);
+    }
+    in.close();
+
+    // Drop whatever follows the last intact record so new appends start clean
+    if (::truncate(path.c_str(), (off_t)good) != 0) throw std::runtime_error("Cannot truncate write-ahead log " + path);
+    return applied;
+}
+
+/*
+  --------------------------------------------------
+  End implementations for the DurableAVLTree class.
+  --------------------------------------------------
+*/
+
+#endif
@@ -127,14 +127,31 @@ AVLNode<Key, Value> *AVLNode<Key, Value>::getRight() const
 */
 
 
-template <class Key, class Value>
-class AVLTree : public BinarySearchTree<Key, Value>
+template <class Key, class Value, class Compare = std::less<Key> >
+class AVLTree : public BinarySearchTree<Key, Value, Compare>
 {
 public:
+    explicit AVLTree(const Compare& comp = Compare());
+    AVLTree(const AVLTree& other); // Clones other, balances included
+    AVLTree(AVLTree&& other);
+    AVLTree& operator=(const AVLTree& other);
+    AVLTree& operator=(AVLTree&& other);
+    void swap(AVLTree& other);
     virtual void insert (const std::pair<const Key, Value> &new_item); // TODO
-    virtual void remove(const Key& key);  // TODO
+
+    // Relaxed balancing for ingest bursts (see avl_relaxed.h)
+    void setRelaxed(bool relaxed, size_t stepsPerUpdate = 0);
+    bool relaxed() const;
+    size_t rebalanceStep(size_t budget); // Repairs up to budget pending nodes, returns how many it repaired
+    bool rebalancePending() const;
 protected:
+    virtual void removeNode(Node<Key, Value>* current) override; // TODO
     virtual void nodeSwap( AVLNode<Key,Value>* n1, AVLNode<Key,Value>* n2);
+    virtual Node<Key, Value>* createNode(const Key& key, const Value& value, Node<Key, Value>* parent) const override;
+    virtual Node<Key, Value>* constructNode(void* place, const Key& key, const Value& value, Node<Key, Value>* parent) const override;
+    virtual int8_t getNodeBalance(const Node<Key, Value>* n) const override;
+    virtual void setNodeBalance(Node<Key, Value>* n, int8_t balance) const override;
+    virtual size_t getNodeSize() const override;
 
     // Add helper functions here
     void insertFix(AVLNode<Key, Value>* p, AVLNode<Key, Value>* n);
@@ -145,71 +162,202 @@ protected:
     void rotateRight(AVLNode<Key, Value>* p);
     void rotateLeft(AVLNode<Key, Value>* p);
     void removeFix(AVLNode<Key, Value>* n, int diff);
+    AVLNode<Key, Value>* _insertLeaf(AVLNode<Key, Value>* parent, bool goLeft, const std::pair<const Key, Value>& new_item, size_t depth); // Links in a new node below parent, rebalances and returns it
+    void _markPending(AVLNode<Key, Value>* n); // Marks n and its ancestors as needing rebalancing
+    size_t _rebalanceFrom(AVLNode<Key, Value>* n, size_t budget); // Repairs pending nodes below n, then above it
+    AVLNode<Key, Value>* _repairPending(AVLNode<Key, Value>* n); // Rebalances a pending node whose subtrees are clean
+    AVLNode<Key, Value>* _restoreBalance(AVLNode<Key, Value>* n, int leftHeight, int rightHeight, int& height); // Sets n's balance, rotating if its sides differ by 2
+    static int _cleanHeight(const AVLNode<Key, Value>* n); // Height of a subtree with correct balances, in O(height)
+    size_t _relaxedDepthLimit() const; // Depth at which a relaxed insert makes as many repairs as it is deep
+    void _swapContents(AVLTree& other); // Same as the base version, relaxed settings included
+
+    // Augmentation hooks (see avl_augmented.h), no-ops for a plain AVL tree
+    virtual void _augmentPath(AVLNode<Key, Value>* n); // Recomputes cached subtree data from n up to the root
+    virtual void _augmentRotation(AVLNode<Key, Value>* lower, AVLNode<Key, Value>* upper); // Same for the two nodes a rotation moved
+
+    bool relaxed_;              // Inserts and removes only mark their path as pending
+    size_t relaxedSteps_;       // Rebalancing steps piggybacked on each relaxed update
+};
 
+/**
+* Constructs an empty tree ordered by comp
+*/
+template<class Key, class Value, class Compare>
+AVLTree<Key, Value, Compare>::AVLTree(const Compare& comp) :
+    BinarySearchTree<Key, Value, Compare>(comp), relaxed_(false), relaxedSteps_(0)
+{
 
+}
 
-};
+/**
+* Copy constructor. Clones in the body rather than through the base copy
+* constructor, so that constructNode already builds AVL nodes. Pending
+* marks of a relaxed tree are copied along with the balances.
+*/
+template<class Key, class Value, class Compare>
+AVLTree<Key, Value, Compare>::AVLTree(const AVLTree& other) :
+    BinarySearchTree<Key, Value, Compare>(other.comp_), relaxed_(other.relaxed_), relaxedSteps_(other.relaxedSteps_)
+{
+    this->_copyFrom(other);
+}
+
+/**
+* Move constructor. Like the copy constructor it builds an empty base and
+* takes the nodes in the body. Throws std::invalid_argument if other is a
+* tree derived from AVLTree, which builds nodes of another type.
+*/
+template<class Key, class Value, class Compare>
+AVLTree<Key, Value, Compare>::AVLTree(AVLTree&& other) :
+    BinarySearchTree<Key, Value, Compare>(other.comp_), relaxed_(false), relaxedSteps_(0)
+{
+    this->_requireTreeType(other, typeid(AVLTree));
+    _swapContents(other);
+}
+
+template<class Key, class Value, class Compare>
+AVLTree<Key, Value, Compare>& AVLTree<Key, Value, Compare>::operator=(const AVLTree& other)
+{
+    BinarySearchTree<Key, Value, Compare>::operator=(other);
+    relaxed_ = other.relaxed_;
+    relaxedSteps_ = other.relaxedSteps_;
+    return *this;
+}
+
+template<class Key, class Value, class Compare>
+AVLTree<Key, Value, Compare>& AVLTree<Key, Value, Compare>::operator=(AVLTree&& other)
+{
+    BinarySearchTree<Key, Value, Compare>::operator=(std::move(other));
+    relaxed_ = other.relaxed_;
+    relaxedSteps_ = other.relaxedSteps_;
+    return *this;
+}
+
+/**
+* Exchanges contents in O(1), relaxed balancing settings included
+*/
+template<class Key, class Value, class Compare>
+void AVLTree<Key, Value, Compare>::swap(AVLTree& other)
+{
+    BinarySearchTree<Key, Value, Compare>::swap(other);
+    std::swap(relaxed_, other.relaxed_);
+    std::swap(relaxedSteps_, other.relaxedSteps_);
+}
+
+/*
+* Helper for the move constructors of AVLTree and the trees derived from it
+*/
+template<class Key, class Value, class Compare>
+void AVLTree<Key, Value, Compare>::_swapContents(AVLTree& other)
+{
+    BinarySearchTree<Key, Value, Compare>::_swapContents(other);
+    std::swap(relaxed_, other.relaxed_);
+    std::swap(relaxedSteps_, other.relaxedSteps_);
+}
+
+template<class Key, class Value, class Compare>
+void swap(AVLTree<Key, Value, Compare>& a, AVLTree<Key, Value, Compare>& b)
+{
+    a.swap(b);
+}
 
 /*
  * Recall: If key is already in the tree, you should 
  * overwrite the current value with the updated value.
  */
-template<class Key, class Value>
-void AVLTree<Key, Value>::insert(const std::pair<const Key, Value> &new_item)
+template<class Key, class Value, class Compare>
+void AVLTree<Key, Value, Compare>::insert(const std::pair<const Key, Value> &new_item)
 {
+    BST_TIMED(TREE_TIME_INSERT);
     if (this->empty()) 
     {
-        AVLNode<Key, Value>* current = new AVLNode<Key, Value>(new_item.first, new_item.second, nullptr);
+        AVLNode<Key, Value>* current = static_cast<AVLNode<Key, Value>*>(this->createNode(new_item.first, new_item.second, nullptr));
         current->setBalance(0);
         this->root_ = current;
+        this->size_ = 1;
+        if (this->maxSize_ < this->size_) this->maxSize_ = this->size_;
         return;
     }
     AVLNode<Key, Value>* current = static_cast<AVLNode<Key,Value>*>(this->root_);
-    AVLNode<Key, Value>* parent;
+    AVLNode<Key, Value>* parent = nullptr;
+    AVLNode<Key, Value>* candidate = nullptr; // Last node whose key is not less than the new key
+    bool goLeft = false;
+    size_t depth = 0;
 
-    // Similar to bst insert, finding an empty node in the correct spot
+    // Similar to bst insert, finding an empty node in the correct spot with one comparison per level
     while(current)
     {
-        if (new_item.first < current->getKey()) 
-        {
-            parent = current;
-            current = current->getLeft();
-        }
-        else if (new_item.first > current->getKey()) 
+        depth++;
+        parent = current;
+        if (this->comp_(current->getKey(), new_item.first))
         {
-            parent = current;
+            goLeft = false;
             current = current->getRight();
         }
-        else 
+        else
         {
-            current->setValue(new_item.second);
-            return;
+            candidate = current;
+            goLeft = true;
+            current = current->getLeft();
         }
     }
+    BST_STAT(treeStatsRecordSearch(depth, depth + (candidate ? 1 : 0)));
+
+    if (candidate && !this->comp_(new_item.first, candidate->getKey()))
+    {
+        candidate->setValue(new_item.second);
+        _augmentPath(candidate);
+        return;
+    }
+
+    _insertLeaf(parent, goLeft, new_item, depth);
+}
 
-    AVLNode<Key, Value>* node = new AVLNode<Key, Value>(new_item.first, new_item.second, parent); 
-    if (node->getKey() < parent->getKey()) parent->setLeft(node);
+/*
+* Helper for insert
+* Links a new node in as the left or right child of parent, found depth
+* levels below the root, then counts it and rebalances. Rotations move
+* nodes but never free them, so the returned node stays valid.
+*/
+template<class Key, class Value, class Compare>
+AVLNode<Key, Value>* AVLTree<Key, Value, Compare>::_insertLeaf(AVLNode<Key, Value>* parent, bool goLeft, const std::pair<const Key, Value>& new_item, size_t depth)
+{
+    AVLNode<Key, Value>* node = static_cast<AVLNode<Key, Value>*>(this->createNode(new_item.first, new_item.second, parent));
+    if (goLeft) parent->setLeft(node);
     else parent->setRight(node);
+    _augmentPath(parent);
+    this->size_++;
+    if (this->maxSize_ < this->size_) this->maxSize_ = this->size_;
 
     // Setting Balances
     node->setBalance(0);
+    if (relaxed_)
+    {
+        _markPending(parent);
+        size_t steps = depth >= _relaxedDepthLimit() ? depth : relaxedSteps_; // catch up as deep as the insert went
+        if (steps) _rebalanceFrom(parent, steps);
+        return node;
+    }
     if (node->getParent()->getBalance() == 0)
     {
         if (node->getParent()->getLeft() == node) node->getParent()->setBalance(-1);
         else if (node->getParent()->getRight() == node) node->getParent()->setBalance(1);
+        BST_STAT(uint64_t steps = treeStatsFixSteps(true));
         insertFix(node->getParent(), node);
+        BST_STAT(treeStatsRecordFix(true, treeStatsFixSteps(true) - steps));
     }
     else if (node->getParent()->getBalance() == -1 || node->getParent()->getBalance() == 1) 
     {
         node->getParent()->setBalance(0);
     }
+    return node;
 }
 
-template<class Key, class Value>
-void AVLTree<Key, Value>::insertFix(AVLNode<Key, Value>* p, AVLNode<Key, Value>* n)
+template<class Key, class Value, class Compare>
+void AVLTree<Key, Value, Compare>::insertFix(AVLNode<Key, Value>* p, AVLNode<Key, Value>* n)
 {
     if (!p) return;
     if (!p->getParent()) return;
+    BST_STAT(treeStatsFixStep(true));
 
     AVLNode<Key, Value>* g = p->getParent();
     if (g->getLeft() == p) insertFixLeft(n, p, g);
@@ -220,8 +368,8 @@ void AVLTree<Key, Value>::insertFix(AVLNode<Key, Value>* p, AVLNode<Key, Value>*
 * Helper function for insertFix
 * Updates balances when p is a left node of its parent
 */
-template<class Key, class Value>
-void AVLTree<Key, Value>::insertFixLeft(AVLNode<Key, Value>* n, AVLNode<Key, Value>* p, AVLNode<Key, Value>* g)
+template<class Key, class Value, class Compare>
+void AVLTree<Key, Value, Compare>::insertFixLeft(AVLNode<Key, Value>* n, AVLNode<Key, Value>* p, AVLNode<Key, Value>* g)
 {
     g->setBalance(g->getBalance() - 1);
     if (g->getBalance() == 0) return;
@@ -264,8 +412,8 @@ void AVLTree<Key, Value>::insertFixLeft(AVLNode<Key, Value>* n, AVLNode<Key, Val
 * Helper function for insertFix
 * Updates balances when p is a right node of its parent
 */
-template<class Key, class Value>
-void AVLTree<Key, Value>::insertFixRight(AVLNode<Key, Value>* n, AVLNode<Key, Value>* p, AVLNode<Key, Value>* g)
+template<class Key, class Value, class Compare>
+void AVLTree<Key, Value, Compare>::insertFixRight(AVLNode<Key, Value>* n, AVLNode<Key, Value>* p, AVLNode<Key, Value>* g)
 {
 
     g->setBalance(g->getBalance() + 1);
@@ -309,8 +457,8 @@ void AVLTree<Key, Value>::insertFixRight(AVLNode<Key, Value>* n, AVLNode<Key, Va
 * Helper function for the insert helper functions
 * Checks if there is a zigzig case at the given node using its balances
 */
-template<class Key, class Value>
-bool AVLTree<Key, Value>::zigzig(AVLNode<Key, Value>* n)
+template<class Key, class Value, class Compare>
+bool AVLTree<Key, Value, Compare>::zigzig(AVLNode<Key, Value>* n)
 {
     if (n->getBalance() < 0)
     {
@@ -327,26 +475,27 @@ bool AVLTree<Key, Value>::zigzig(AVLNode<Key, Value>* n)
 * Helper function for the insert helper functions
 * Checks if there is a zigzag case at the given node using its balances
 */
-template<class Key, class Value>
-bool AVLTree<Key, Value>::zigzag(AVLNode<Key, Value>* n)
+template<class Key, class Value, class Compare>
+bool AVLTree<Key, Value, Compare>::zigzag(AVLNode<Key, Value>* n)
 {
     if (n->getBalance() < 0)
     {
         if (n->getLeft()->getBalance() > 0) return 1;
     }
-    if (n->getRight() > 0)
+    if (n->getBalance() > 0)
     {
         if (n->getRight()->getBalance() < 0) return 1;
     }
     return 0;
 }
 
-template<class Key, class Value>
-void AVLTree<Key, Value>::rotateRight(AVLNode<Key, Value>* g)
+template<class Key, class Value, class Compare>
+void AVLTree<Key, Value, Compare>::rotateRight(AVLNode<Key, Value>* g)
 {
     AVLNode<Key, Value>* p = g->getLeft();
     AVLNode<Key, Value>* pRight = p->getRight();
     AVLNode<Key, Value>* gParent = g->getParent();
+    BST_STAT(treeStatsLocal().add(TREE_STAT_ROTATE_RIGHT, 1));
 
     // Updating necessary pointers and moving certain subtrees around
     p->setParent(gParent);
@@ -361,14 +510,16 @@ void AVLTree<Key, Value>::rotateRight(AVLNode<Key, Value>* g)
     if (pRight) pRight->setParent(g);
 
     if (this->root_ == g) this->root_ = p;
+    _augmentRotation(g, p);
 }
 
-template<class Key, class Value>
-void AVLTree<Key, Value>::rotateLeft(AVLNode<Key, Value>* g)
+template<class Key, class Value, class Compare>
+void AVLTree<Key, Value, Compare>::rotateLeft(AVLNode<Key, Value>* g)
 {
     AVLNode<Key, Value>* p = g->getRight();
     AVLNode<Key, Value>* pLeft = p->getLeft();
     AVLNode<Key, Value>* gParent = g->getParent();
+    BST_STAT(treeStatsLocal().add(TREE_STAT_ROTATE_LEFT, 1));
 
     // Updating necessary pointers and moving certain subtrees around
     p->setParent(gParent);
@@ -383,18 +534,17 @@ void AVLTree<Key, Value>::rotateLeft(AVLNode<Key, Value>* g)
     g->setRight(pLeft);
 
     if (this->root_ == g) this->root_ = p;
+    _augmentRotation(g, p);
 }
 
 /*
  * Recall: The writeup specifies that if a node has 2 children you
  * should swap with the predecessor and then remove.
  */
-template<class Key, class Value>
-void AVLTree<Key, Value>::remove(const Key& key)
+template<class Key, class Value, class Compare>
+void AVLTree<Key, Value, Compare>::removeNode(Node<Key, Value>* current)
 {
-    if (this->empty()) return;
-    AVLNode<Key, Value>* n = static_cast<AVLNode<Key, Value>*>(this->internalFind(key));
-    if (!n) return;
+    AVLNode<Key, Value>* n = static_cast<AVLNode<Key, Value>*>(current);
     bool isRoot = !n->getParent();
 
     AVLNode<Key, Value>* pPred = nullptr; // Parent of the predecessor node
@@ -422,7 +572,7 @@ void AVLTree<Key, Value>::remove(const Key& key)
         n->setParent(nullptr);
 
         if (isRoot) this->root_ = pred;
-        delete n;
+        this->destroyNode(n);
         n = nullptr;
     }
     else if (n->getLeft()) // If there is only a left child, swap with it
@@ -442,7 +592,7 @@ void AVLTree<Key, Value>::remove(const Key& key)
         if (n->getLeft()) n->getLeft()->setParent(n->getParent());
         if (n->getRight()) n->getRight()->setParent(n->getParent());
 
-        delete n;
+        this->destroyNode(n);
         n = nullptr;
     }
     else if (n->getRight()) // If there is only a right child, swap with it
@@ -462,17 +612,46 @@ void AVLTree<Key, Value>::remove(const Key& key)
         if (n->getLeft()) n->getLeft()->setParent(n->getParent());
         if (n->getRight()) n->getRight()->setParent(n->getParent());
 
-        delete n;
+        this->destroyNode(n);
+        n = nullptr;
+    }
+    else // If there are no children, unlink it and update its parent's balance
+    {
+        pPred = n->getParent();
+        if (isRoot) this->root_ = nullptr;
+        else if (pPred->getLeft() == n)
+        {
+            diff = 1;
+            pPred->setLeft(nullptr);
+        }
+        else
+        {
+            diff = -1;
+            pPred->setRight(nullptr);
+        }
+
+        this->destroyNode(n);
         n = nullptr;
     }
+    _augmentPath(pPred);
 
+    if (relaxed_)
+    {
+        _markPending(pPred);
+        if (relaxedSteps_) _rebalanceFrom(pPred, relaxedSteps_);
+        return;
+    }
+
+    BST_STAT(uint64_t steps = treeStatsFixSteps(false));
     removeFix(pPred, diff);
+    BST_STAT(if (pPred) treeStatsRecordFix(false, treeStatsFixSteps(false) - steps));
 }
 
-template<class Key, class Value>
-void AVLTree<Key, Value>::removeFix(AVLNode<Key, Value>* n, int diff)
+template<class Key, class Value, class Compare>
+void AVLTree<Key, Value, Compare>::removeFix(AVLNode<Key, Value>* n, int diff)
 {
     if (!n) return;
+    BST_STAT(treeStatsFixStep(false));
     AVLNode<Key, Value>* p = n->getParent();
     int ndiff = 0;
     if (p) 
@@ -590,14 +769,64 @@ void AVLTree<Key, Value>::removeFix(AVLNode<Key, Value>* n, int diff)
     }
 }
 
-template<class Key, class Value>
-void AVLTree<Key, Value>::nodeSwap(AVLNode<Key,Value>* n1, AVLNode<Key,Value>* n2)
+template<class Key, class Value, class Compare>
+void AVLTree<Key, Value, Compare>::nodeSwap(AVLNode<Key,Value>* n1, AVLNode<Key,Value>* n2)
 {
-    BinarySearchTree<Key, Value>::nodeSwap(n1, n2);
+    BinarySearchTree<Key, Value, Compare>::nodeSwap(n1, n2);
     int8_t tempB = n1->getBalance();
     n1->setBalance(n2->getBalance());
     n2->setBalance(tempB);
 }
 
+/*
+* Bulk loaders build AVL trees through this so every node carries a balance
+*/
+template<class Key, class Value, class Compare>
+Node<Key, Value>* AVLTree<Key, Value, Compare>::createNode(const Key& key, const Value& value, Node<Key, Value>* parent) const
+{
+    return new AVLNode<Key, Value>(key, value, static_cast<AVLNode<Key, Value>*>(parent));
+}
+
+/*
+* Copies build AVL nodes in their slab through this
+*/
+template<class Key, class Value, class Compare>
+Node<Key, Value>* AVLTree<Key, Value, Compare>::constructNode(void* place, const Key& key, const Value& value, Node<Key, Value>* parent) const
+{
+    return new (place) AVLNode<Key, Value>(key, value, static_cast<AVLNode<Key, Value>*>(parent));
+}
+
+template<class Key, class Value, class Compare>
+int8_t AVLTree<Key, Value, Compare>::getNodeBalance(const Node<Key, Value>* n) const
+{
+    return static_cast<const AVLNode<Key, Value>*>(n)->getBalance();
+}
+
+template<class Key, class Value, class Compare>
+void AVLTree<Key, Value, Compare>::setNodeBalance(Node<Key, Value>* n, int8_t balance) const
+{
+    static_cast<AVLNode<Key, Value>*>(n)->setBalance(balance);
+}
+
+template<class Key, class Value, class Compare>
+size_t AVLTree<Key, Value, Compare>::getNodeSize() const
+{
+    return sizeof(AVLNode<Key, Value>);
+}
+
+template<class Key, class Value, class Compare>
+void AVLTree<Key, Value, Compare>::_augmentPath(AVLNode<Key, Value>*)
+{
+
+}
+
+template<class Key, class Value, class Compare>
+void AVLTree<Key, Value, Compare>::_augmentRotation(AVLNode<Key, Value>*, AVLNode<Key, Value>*)
+{
+
+}
+
+// include relaxed balancing (in its own file because it's fairly long)
+#include "avl_relaxed.h"
 
 #endif
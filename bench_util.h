@@ -0,0 +1,81 @@
+#ifndef BENCH_UTIL_H
+#define BENCH_UTIL_H
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <random>
+#include <vector>
+
+/**
+* A simple wall-clock stopwatch for the benchmark programs.
+*/
+class BenchTimer
+{
+public:
+    BenchTimer() : start_(std::chrono::steady_clock::now()) {}
+
+    void restart()
+    {
+        start_ = std::chrono::steady_clock::now();
+    }
+
+    double seconds() const
+    {
+        return std::chrono::duration<double>(std::chrono::steady_clock::now() - start_).count();
+    }
+
+private:
+    std::chrono::steady_clock::time_point start_;
+};
+
+/*
+* Returns n distinct keys in random order, drawn from [0, 4n)
+*/
+inline std::vector<uint64_t> randomKeys(size_t n, uint64_t seed)
+{
+    std::mt19937_64 rng(seed);
+    std::vector<uint64_t> keys(4 * n);
+    for (size_t i = 0; i < keys.size(); i++) keys[i] = i;
+    std::shuffle(keys.begin(), keys.end(), rng);
+    keys.resize(n);
+    return keys;
+}
+
+/*
+* Returns n draws from a Zipf distribution with exponent s over the given
+* population of keys, so that population[0] is drawn most often
+*/
+inline std::vector<uint64_t> zipfKeys(size_t n, const std::vector<uint64_t>& population, double s, uint64_t seed)
+{
+    std::vector<double> cdf(population.size());
+    double total = 0;
+    for (size_t rank = 0; rank < population.size(); rank++)
+    {
+        total += 1.0 / std::pow((double)(rank + 1), s);
+        cdf[rank] = total;
+    }
+
+    std::mt19937_64 rng(seed);
+    std::uniform_real_distribution<double> uniform(0.0, total);
+    std::vector<uint64_t> keys(n);
+    for (size_t i = 0; i < n; i++)
+    {
+        size_t rank = std::lower_bound(cdf.begin(), cdf.end(), uniform(rng)) - cdf.begin();
+        keys[i] = population[rank < population.size() ? rank : population.size() - 1];
+    }
+    return keys;
+}
+
+/*
+* Reads a size argument (like "1000000") or falls back to def
+*/
+inline size_t benchSizeArg(int argc, char* argv[], int index, size_t def)
+{
+    if (argc > index) return (size_t)std::strtoull(argv[index], nullptr, 10);
+    return def;
+}
+
+#endif
@@ -0,0 +1,212 @@
+#include <algorithm>
+#include <cstdio>
+#include <map>
+#include <random>
+#include <string>
+#include <vector>
+#include "bst.h"
+#include "avlbst.h"
+#include "bench_util.h"
+
+using namespace std;
+
+// Times the basic operations of BinarySearchTree, AVLTree and std::map over
+// several key distributions and sizes, and prints the results as JSON.
+// Usage: ./bst-bench [largest size] [repetitions]
+//
+// Each figure is the best of the repetitions. The unbalanced tree is only
+// run on sorted and reverse-sorted keys up to DEGENERATE_LIMIT items, since
+// it turns into a linked list there and its recursive helpers would run out
+// of stack on larger inputs.
+
+#define DEGENERATE_LIMIT 10000
+
+static volatile uint64_t sink; // Keeps the optimizer from dropping lookups
+
+/*
+* One benchmark input: the keys to insert, keys that are present, keys
+* that are absent, and the order to remove keys in
+*/
+struct Workload
+{
+    string distribution;
+    vector<uint64_t> inserts;
+    vector<uint64_t> hits;
+    vector<uint64_t> misses;
+    vector<uint64_t> removals;
+};
+
+/*
+* Builds a workload. Present keys are even and absent keys are odd, so a
+* miss still lands in the middle of the tree instead of off one end.
+*/
+Workload makeWorkload(const string& distribution, size_t n)
+{
+    Workload w;
+    w.distribution = distribution;
+    vector<uint64_t> keys = randomKeys(n, 1234 + n);
+    for (size_t i = 0; i < n; i++) keys[i] *= 2;
+
+    if (distribution == "zipf")
+    {
+        // Popular keys are scattered across the key space instead of clustered at one end.
+        // Lookups are drawn from the insert stream itself, so they are just as skewed.
+        w.inserts = zipfKeys(n, keys, 0.99, 99 + n);
+        w.hits = w.inserts;
+        shuffle(w.hits.begin(), w.hits.end(), mt19937_64(101 + n));
+    }
+    else
+    {
+        w.inserts = keys;
+        if (distribution == "sorted") sort(w.inserts.begin(), w.inserts.end());
+        else if (distribution == "reverse") sort(w.inserts.rbegin(), w.inserts.rend());
+        w.hits = keys;
+    }
+
+    w.misses.resize(w.hits.size());
+    for (size_t i = 0; i < w.hits.size(); i++) w.misses[i] = w.hits[i] + 1;
+    w.removals = keys;
+    return w;
+}
+
+/*
+* Adapters so the same timing code can drive all three containers
+*/
+template<typename Key, typename Value>
+void eraseKey(BinarySearchTree<Key, Value>& tree, const Key& key) { tree.remove(key); }
+template<typename Key, typename Value>
+void eraseKey(AVLTree<Key, Value>& tree, const Key& key) { tree.remove(key); }
+template<typename Key, typename Value>
+void eraseKey(map<Key, Value>& tree, const Key& key) { tree.erase(key); }
+
+template<typename Key, typename Value>
+bool checkBalanced(const BinarySearchTree<Key, Value>& tree, bool& supported) { supported = true; return tree.isBalanced(); }
+template<typename Key, typename Value>
+bool checkBalanced(const map<Key, Value>& tree, bool& supported) { supported = false; return true; }
+
+/*
+* Collects the results and prints them as one JSON document
+*/
+class BenchReport
+{
+public:
+    BenchReport() : first_(true) {}
+
+    void begin(size_t repetitions)
+    {
+        printf("{\n  \"benchmark\": \"bst-bench\",\n  \"repetitions\": %zu,\n  \"results\": [", repetitions);
+    }
+
+    void add(const char* tree, const string& distribution, size_t n, const char* op, size_t ops, double seconds)
+    {
+        printf("%s\n    {\"tree\": \"%s\", \"distribution\": \"%s\", \"size\": %zu, \"op\": \"%s\", \"ops\": %zu, \"seconds\": %.9f, \"ns_per_op\": %.3f}",
+               first_ ? "" : ",", tree, distribution.c_str(), n, op, ops, seconds, ops ? seconds * 1e9 / ops : 0.0);
+        first_ = false;
+        fflush(stdout);
+    }
+
+    void end()
+    {
+        printf("\n  ]\n}\n");
+    }
+
+private:
+    bool first_;
+};
+
+/*
+* Runs every operation on a fresh Tree and reports the best time of each
+*/
+template<typename Tree>
+void runTree(BenchReport& report, const char* name, const Workload& w, size_t repetitions)
+{
+    enum { INSERT, FIND_HIT, FIND_MISS, ITERATE, IS_BALANCED, CLEAR, REMOVE, OPS };
+    const char* names[OPS] = { "insert", "find_hit", "find_miss", "iterate", "is_balanced", "clear", "remove" };
+    double best[OPS];
+    size_t counts[OPS] = { w.inserts.size(), w.hits.size(), w.misses.size(), 0, 1, 0, w.removals.size() };
+    bool balancedSupported = false;
+    for (int op = 0; op < OPS; op++) best[op] = 1e300;
+
+    for (size_t rep = 0; rep < repetitions; rep++)
+    {
+        double t[OPS];
+        uint64_t sum = 0;
+        BenchTimer timer;
+        {
+            Tree tree;
+            timer.restart();
+            for (size_t i = 0; i < w.inserts.size(); i++) tree.insert(make_pair(w.inserts[i], w.inserts[i]));
+            t[INSERT] = timer.seconds();
+
+            timer.restart();
+            for (size_t i = 0; i < w.hits.size(); i++) sum += tree.find(w.hits[i]) != tree.end();
+            t[FIND_HIT] = timer.seconds();
+
+            timer.restart();
+            for (size_t i = 0; i < w.misses.size(); i++) sum += tree.find(w.misses[i]) != tree.end();
+            t[FIND_MISS] = timer.seconds();
+
+            size_t items = 0;
+            timer.restart();
+            for (typename Tree::iterator it = tree.begin(); it != tree.end(); ++it)
+            {
+                sum += it->second;
+                items++;
+            }
+            t[ITERATE] = timer.seconds();
+            counts[ITERATE] = counts[CLEAR] = items;
+
+            timer.restart();
+            sum += checkBalanced(tree, balancedSupported);
+            t[IS_BALANCED] = timer.seconds();
+
+            timer.restart();
+            tree.clear();
+            t[CLEAR] = timer.seconds();
+        }
+        {
+            Tree tree;
+            for (size_t i = 0; i < w.inserts.size(); i++) tree.insert(make_pair(w.inserts[i], w.inserts[i]));
+            timer.restart();
+            for (size_t i = 0; i < w.removals.size(); i++) eraseKey(tree, w.removals[i]);
+            t[REMOVE] = timer.seconds();
+        }
+        sink = sum;
+
+        for (int op = 0; op < OPS; op++) best[op] = min(best[op], t[op]);
+    }
+
+    for (int op = 0; op < OPS; op++)
+    {
+        if (op == IS_BALANCED && !balancedSupported) continue;
+        report.add(name, w.distribution, w.inserts.size(), names[op], counts[op], best[op]);
+    }
+}
+
+int main(int argc, char* argv[])
+{
+    size_t largest = benchSizeArg(argc, argv, 1, 100000);
+    size_t repetitions = benchSizeArg(argc, argv, 2, 3);
+    if (repetitions == 0) repetitions = 1;
+    const char* distributions[] = { "random", "sorted", "reverse", "zipf" };
+
+    BenchReport report;
+    report.begin(repetitions);
+    for (size_t n = 1000; n <= largest; n *= 10)
+    {
+        for (size_t d = 0; d < sizeof(distributions) / sizeof(distributions[0]); d++)
+        {
+            Workload w = makeWorkload(distributions[d], n);
+            bool degenerate = w.distribution == "sorted" || w.distribution == "reverse";
+            if (!degenerate || n <= DEGENERATE_LIMIT)
+            {
+                runTree<BinarySearchTree<uint64_t, uint64_t> >(report, "BinarySearchTree", w, repetitions);
+            }
+            runTree<AVLTree<uint64_t, uint64_t> >(report, "AVLTree", w, repetitions);
+            runTree<map<uint64_t, uint64_t> >(report, "std::map", w, repetitions);
+        }
+    }
+    report.end();
+
+    return 0;
+}
@@ -1,18 +1,75 @@
+#include <algorithm>
+#include <cmath>
+#include <fstream>
 #include <iostream>
 #include <map>
+#include <set>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+#include <cstdlib>
+#include <dirent.h>
+#include <unistd.h>
 #include "bst.h"
 #include "avlbst.h"
+#include "bst_image.h"
+#include "avl_wal.h"
+#include "prefix_key.h"
+#include "bench_util.h"
+#include "bst_trace.h"
+#include "tree_export.h"
+#include "avl_augmented.h"
+#include "interval_map.h"
+#include "avl_multimap.h"
+#include "ordered_cache.h"
 
 using namespace std;
 
+// Prints a short demo, then runs the checks below and exits non-zero if
+// any of them failed. Each check names what it was testing.
 
-int main(int argc, char *argv[])
+static int failures = 0;
+
+#define CHECK(...) \
+    do { if (!(__VA_ARGS__)) { cerr << __FILE__ << ":" << __LINE__ << ": check failed: " << #__VA_ARGS__ << endl; failures++; } } while (0)
+
+#define CHECK_THROWS(expr, type) \
+    do { bool thrown = false; try { expr; } catch (const type&) { thrown = true; } \
+         if (!thrown) { cerr << __FILE__ << ":" << __LINE__ << ": expected " << #type << " from " << #expr << endl; failures++; } } while (0)
+
+/*
+* True if tree holds exactly the items of expected, in the same order
+*/
+template<typename Tree, typename Map>
+bool sameItems(const Tree& tree, const Map& expected)
+{
+    if (tree.size() != expected.size()) return false;
+    typename Map::const_iterator e = expected.begin();
+    for (typename Tree::iterator it = tree.begin(); it != tree.end(); ++it, ++e)
+    {
+        if (e == expected.end() || it->first != e->first || it->second != e->second) return false;
+    }
+    return e == expected.end();
+}
+
+/*
+* Returns the keys 0, 3, 6, ... in a scrambled but repeatable order
+*/
+vector<int> scrambledKeys(int n)
+{
+    vector<int> keys;
+    for (int i = 0; i < n; i++) keys.push_back(((i * 7919) % n) * 3);
+    return keys;
+}
+
+void demo()
 {
     // Binary Search Tree tests
     BinarySearchTree<char,int> bt;
     bt.insert(std::make_pair('a',1));
     bt.insert(std::make_pair('b',2));
-    
+
     cout << "Binary Search Tree contents:" << endl;
     for(BinarySearchTree<char,int>::iterator it = bt.begin(); it != bt.end(); ++it) {
         cout << it->first << " " << it->second << endl;
@@ -43,6 +100,1851 @@ int main(int argc, char *argv[])
     }
     cout << "Erasing b" << endl;
     at.remove('b');
+}
+
+// Tree images (bst_image.h)
+typedef MappedTree<int, int> IntImage;
+typedef TreeImage<int, int> IntImageWriter;
+
+void testImage()
+{
+    vector<int> keys = scrambledKeys(500);
+    AVLTree<int, int> tree;
+    map<int, int> expected;
+    for (size_t i = 0; i < keys.size(); i++)
+    {
+        tree.insert(make_pair(keys[i], (int)i));
+        expected[keys[i]] = (int)i;
+    }
+
+    // Round trip through a buffer
+    size_t bytes = IntImageWriter::imageSize(tree.size());
+    vector<uint64_t> buffer(bytes / sizeof(uint64_t) + 1);
+    CHECK(IntImageWriter::writeTo(tree, &buffer[0], bytes) == bytes);
+    {
+        IntImage image(&buffer[0], bytes);
+        CHECK(image.size() == tree.size());
+        CHECK(image.isAVL());
+        CHECK(image.verify());
+        for (map<int, int>::iterator it = expected.begin(); it != expected.end(); ++it)
+        {
+            const int* value = image.find(it->first);
+            CHECK(value && *value == it->second);
+            CHECK(!image.find(it->first + 1));
+        }
+
+        map<int, int> visited;
+        image.forEach([&visited](const int& k, const int& v) { visited[k] = v; });
+        CHECK(visited == expected);
+
+        AVLTree<int, int> loaded;
+        loaded.insert(make_pair(-1, -1)); // replaced by the load
+        IntImageWriter::load(image, loaded);
+        CHECK(sameItems(loaded, expected));
+        CHECK(loaded.isBalanced());
+    }
+
+    // Round trip through a file
+    string path = "/tmp/bst-test-" + to_string(getpid()) + ".img";
+    IntImageWriter::write(tree, path);
+    {
+        IntImage image(path);
+        AVLTree<int, int> loaded;
+        IntImageWriter::load(image, loaded);
+        CHECK(sameItems(loaded, expected));
+    }
+    ::unlink(path.c_str());
+
+    // An empty tree
+    AVLTree<int, int> none;
+    vector<uint64_t> small(IntImageWriter::imageSize(0) / sizeof(uint64_t) + 1);
+    IntImageWriter::writeTo(none, &small[0], IntImageWriter::imageSize(0));
+    {
+        IntImage image(&small[0], IntImageWriter::imageSize(0));
+        CHECK(image.empty() && image.verify() && !image.find(0));
+        IntImageWriter::load(image, tree);
+        CHECK(tree.empty());
+    }
+
+    // Damaged links: finds stay inside the records, load throws and leaves the tree empty
+    const TreeImageHeader* header = reinterpret_cast<const TreeImageHeader*>(&buffer[0]);
+    IntImageWriter::Record* records = reinterpret_cast<IntImageWriter::Record*>(reinterpret_cast<char*>(&buffer[0]) + header->dataOffset);
+    size_t linked = 0;
+    while (!records[linked].rightOffset) linked++;
+    uint64_t offsets[] = { records[linked].rightOffset + 1, (uint64_t)1 << 63, ~(uint64_t)0 };
+    for (size_t c = 0; c < 3; c++)
+    {
+        vector<uint64_t> damaged(buffer);
+        reinterpret_cast<IntImageWriter::Record*>(reinterpret_cast<char*>(&damaged[0]) + header->dataOffset)[linked].rightOffset = offsets[c];
+        IntImage image(&damaged[0], bytes);
+        CHECK(!image.verify());
+        for (map<int, int>::iterator it = expected.begin(); it != expected.end(); ++it) image.find(it->first);
+        image.forEach([](const int&, const int&) {});
+
+        AVLTree<int, int> loaded;
+        loaded.insert(make_pair(1, 1));
+        CHECK_THROWS(IntImageWriter::load(image, loaded), std::runtime_error);
+        CHECK(loaded.empty() && loaded.begin() == loaded.end());
+    }
+
+    // A header for another layout is refused
+    vector<uint64_t> wrong(buffer);
+    reinterpret_cast<TreeImageHeader*>(&wrong[0])->keySize = 8;
+    CHECK_THROWS(IntImage image(&wrong[0], bytes), std::runtime_error);
+    CHECK_THROWS(IntImage image(&buffer[0], bytes - sizeof(IntImageWriter::Record)), std::runtime_error);
+
+    // A balance that is neither AVL nor pending is refused
+    vector<uint64_t> badBalance(buffer);
+    reinterpret_cast<IntImageWriter::Record*>(reinterpret_cast<char*>(&badBalance[0]) + header->dataOffset)[1].balance = 5;
+    {
+        IntImage image(&badBalance[0], bytes);
+        AVLTree<int, int> loaded;
+        CHECK_THROWS(IntImageWriter::load(image, loaded), std::runtime_error);
+        BinarySearchTree<int, int> plainLoaded;
+        IntImageWriter::load(image, plainLoaded);
+        CHECK(sameItems(plainLoaded, expected));
+    }
+}
+
+/*
+* Writes tree to a buffer and loads it into target
+*/
+template<typename Tree>
+void imageRoundTrip(const BinarySearchTree<int, int>& tree, Tree& target)
+{
+    size_t bytes = IntImageWriter::imageSize(tree.size());
+    vector<uint64_t> buffer(bytes / sizeof(uint64_t) + 1);
+    IntImageWriter::writeTo(tree, &buffer[0], bytes);
+    IntImageWriter::load(IntImage(&buffer[0], bytes), target);
+}
+
+void testImageBalances()
+{
+    // A chain from a plain tree is rebalanced when it loads into an AVLTree
+    BinarySearchTree<int, int> chain;
+    map<int, int> expected;
+    for (int i = 0; i < 64; i++)
+    {
+        chain.insert(make_pair(i, i));
+        expected[i] = i;
+    }
+    AVLTree<int, int> fromChain;
+    imageRoundTrip(chain, fromChain);
+    CHECK(sameItems(fromChain, expected) && fromChain.isBalanced() && !fromChain.rebalancePending());
+    bool balanced = true;
+    for (int i = 0; i < 100; i++)
+    {
+        fromChain.insert(make_pair(100 + i, i));
+        fromChain.remove(i % 3 ? i : -1);
+        balanced = balanced && fromChain.isBalanced();
+    }
+    CHECK(balanced);
+
+    // Unrepaired nodes of a relaxed tree are repaired by a strict target and kept by a relaxed one
+    AVLTree<int, int> relaxed;
+    relaxed.setRelaxed(true, 0);
+    expected.clear();
+    vector<int> keys = scrambledKeys(500);
+    for (size_t i = 0; i < keys.size(); i++)
+    {
+        relaxed.insert(make_pair(keys[i], (int)i));
+        expected[keys[i]] = (int)i;
+    }
+    for (int i = 0; i < 1500; i += 7)
+    {
+        relaxed.insert(make_pair(2000 + i, i));
+        expected[2000 + i] = i;
+    }
+    CHECK(relaxed.rebalancePending());
+    AVLTree<int, int> strict;
+    imageRoundTrip(relaxed, strict);
+    CHECK(sameItems(strict, expected) && strict.isBalanced() && !strict.rebalancePending());
+    balanced = true;
+    for (size_t i = 0; i < keys.size(); i += 2)
+    {
+        strict.remove(keys[i]);
+        strict.insert(make_pair(-1 - (int)i, 0));
+        balanced = balanced && strict.isBalanced();
+    }
+    CHECK(balanced);
+
+    AVLTree<int, int> stillRelaxed;
+    stillRelaxed.setRelaxed(true, 0);
+    imageRoundTrip(relaxed, stillRelaxed);
+    CHECK(stillRelaxed.rebalancePending() && sameItems(stillRelaxed, expected));
+    stillRelaxed.setRelaxed(false);
+    CHECK(stillRelaxed.isBalanced());
+}
+
+// Streaming (bst_stream.h, stream_codec.h)
+
+/*
+* Stores small ints in two bytes, to check that serialize uses the codec it is given
+*/
+struct ShortIntCodec
+{
+    static void write(std::ostream& out, const int& item)
+    {
+        uint16_t narrow = (uint16_t)item;
+        out.write(reinterpret_cast<const char*>(&narrow), sizeof(narrow));
+    }
+
+    static int read(std::istream& in)
+    {
+        uint16_t narrow;
+        readStreamBytes(in, &narrow, sizeof(narrow));
+        return narrow;
+    }
+};
+
+void testStream()
+{
+    vector<int> keys = scrambledKeys(300);
+    AVLTree<int, int> numbers;
+    BinarySearchTree<string, string> words;
+    map<int, int> expected;
+    map<string, string> expectedWords;
+    for (size_t i = 0; i < keys.size(); i++)
+    {
+        numbers.insert(make_pair(keys[i], (int)i));
+        words.insert(make_pair("key" + to_string(keys[i]), string(i % 5, 'v')));
+        expected[keys[i]] = (int)i;
+        expectedWords["key" + to_string(keys[i])] = string(i % 5, 'v');
+    }
+
+    stringstream out;
+    numbers.serialize(out);
+    string bytes = out.str();
+    {
+        stringstream in(bytes);
+        AVLTree<int, int> copy;
+        copy.insert(make_pair(-1, -1)); // replaced by the stream
+        copy.deserialize(in);
+        CHECK(sameItems(copy, expected));
+        CHECK(copy.isBalanced());
+    }
+
+    stringstream textOut;
+    words.serialize(textOut);
+    {
+        stringstream in(textOut.str());
+        BinarySearchTree<string, string> copy;
+        copy.deserialize(in);
+        CHECK(sameItems(copy, expectedWords));
+        CHECK(copy.isBalanced());
+    }
+
+    // Only the kept keys are linked, and the result is still balanced
+    {
+        stringstream in(bytes);
+        AVLTree<int, int> even;
+        even.deserialize(in, [](const int& key) { return key % 2 == 0; });
+        map<int, int> expectedEven;
+        for (map<int, int>::iterator it = expected.begin(); it != expected.end(); ++it)
+        {
+            if (it->first % 2 == 0) expectedEven.insert(*it);
+        }
+        CHECK(sameItems(even, expectedEven));
+        CHECK(even.isBalanced());
+    }
+
+    // A custom codec
+    stringstream narrowOut;
+    numbers.serialize<ShortIntCodec, ShortIntCodec>(narrowOut);
+    CHECK(narrowOut.str().size() == 16 + numbers.size() * 4);
+    {
+        stringstream in(narrowOut.str());
+        AVLTree<int, int> copy;
+        copy.deserialize<ShortIntCodec, ShortIntCodec>(in);
+        CHECK(sameItems(copy, expected));
+    }
+
+    // Malformed streams throw and leave the tree empty
+    string unsorted(bytes);
+    std::swap_ranges(unsorted.begin() + 16, unsorted.begin() + 24, unsorted.begin() + 24);
+    string truncated = bytes.substr(0, bytes.size() - 3);
+    string foreign = "BSTX" + bytes.substr(4);
+    string bad[] = { unsorted, truncated, foreign };
+    for (size_t i = 0; i < 3; i++)
+    {
+        AVLTree<int, int> copy;
+        copy.insert(make_pair(1, 1));
+        stringstream in(bad[i]);
+        CHECK_THROWS(copy.deserialize(in), std::runtime_error);
+        CHECK(copy.empty() && copy.begin() == copy.end());
+
+        stringstream again(bad[i]);
+        CHECK_THROWS(copy.deserialize(again, [](const int&) { return true; }), std::runtime_error);
+        CHECK(copy.empty());
+    }
+
+    // A damaged string length runs out of stream instead of allocating it
+    string text("abc");
+    stringstream lengths;
+    StreamCodec<string>::write(lengths, text);
+    string huge = lengths.str();
+    huge[3] = (char)0xFF;
+    stringstream hugeIn(huge);
+    CHECK_THROWS(StreamCodec<string>::read(hugeIn), std::runtime_error);
+    string longText(200000, 'x');
+    longText[131072] = 'y';
+    stringstream longIn;
+    StreamCodec<string>::write(longIn, longText);
+    CHECK(StreamCodec<string>::read(longIn) == longText);
+}
+
+// Write-ahead log and recovery (avl_wal.h)
+
+/*
+* Appends bytes to every log segment in dir, as a crash in the middle of a write would
+*/
+void appendToLogs(const string& dir, const string& bytes)
+{
+    DIR* d = ::opendir(dir.c_str());
+    while (struct dirent* entry = ::readdir(d))
+    {
+        if (string(entry->d_name).compare(0, 4, "wal-") != 0) continue;
+        ofstream out((dir + "/" + entry->d_name).c_str(), ios::binary | ios::app);
+        out << bytes;
+    }
+    ::closedir(d);
+}
+
+void testWal()
+{
+    char pattern[] = "/tmp/bst-test-wal-XXXXXX";
+    string dir = ::mkdtemp(pattern);
+    typedef DurableAVLTree<int, string> Durable;
+
+    // The insert that triggers a checkpoint is kept
+    WalOptions options;
+    options.checkpointEveryOps = 3;
+    options.groupCommitOps = 1;
+    {
+        Durable tree(dir, options);
+        for (int i = 1; i <= 3; i++) tree.insert(make_pair(i, to_string(i)));
+        tree.sync();
+    }
+    {
+        Durable tree(dir, options);
+        CHECK(tree.size() == 3);
+        for (int i = 1; i <= 3; i++) CHECK(tree.find(i) != tree.end() && tree[i] == to_string(i));
+    }
+
+    // Inserts, overwrites and removes across several checkpoints and reopenings
+    map<int, string> expected;
+    for (int i = 1; i <= 3; i++) expected[i] = to_string(i);
+    options.checkpointEveryOps = 7;
+    options.groupCommitOps = 4;
+    for (int round = 0; round < 4; round++)
+    {
+        Durable tree(dir, options);
+        CHECK(sameItems(tree, expected));
+        for (int i = 0; i < 50; i++)
+        {
+            int key = (i * 37 + round * 11) % 60;
+            if (i % 3 == 2)
+            {
+                tree.remove(key);
+                expected.erase(key);
+            }
+            else
+            {
+                string value = string(i % 4, 'x') + to_string(round);
+                tree.insert(make_pair(key, value));
+                expected[key] = value;
+            }
+        }
+        CHECK(sameItems(tree, expected));
+    }
+
+    // A torn record, and a length that runs past the end of the log, end the replay
+    string torn("\x05\x00\x00\x00\x01\x02\x03\x04I\x01", 10);
+    string huge("\xff\xff\xff\xff\x00\x00\x00\x00", 8);
+    appendToLogs(dir, torn);
+    {
+        Durable tree(dir, options);
+        CHECK(sameItems(tree, expected));
+        tree.insert(make_pair(1000, string("after torn")));
+        expected[1000] = "after torn";
+    }
+    appendToLogs(dir, huge);
+    {
+        Durable tree(dir, options);
+        CHECK(sameItems(tree, expected));
+    }
+    CHECK(system(("rm -rf '" + dir + "'").c_str()) == 0);
+
+    // A comparator is given without naming the codecs, and recovery keeps its order
+    char descendingPattern[] = "/tmp/bst-test-wal-XXXXXX";
+    string descendingDir = ::mkdtemp(descendingPattern);
+    {
+        DurableAVLTree<int, string, std::greater<int> > tree(descendingDir, options);
+        for (int i = 0; i < 20; i++) tree.insert(make_pair(i, to_string(i)));
+        tree.sync();
+    }
+    {
+        DurableAVLTree<int, string, std::greater<int> > tree(descendingDir, options);
+        CHECK(tree.size() == 20 && tree.begin()->first == 19 && tree.isBalanced());
+    }
+    CHECK(system(("rm -rf '" + descendingDir + "'").c_str()) == 0);
+}
+
+// Comparators and heterogeneous lookups
+
+void testCompare()
+{
+    // A descending order
+    AVLTree<int, int, std::greater<int> > down;
+    BinarySearchTree<int, int, std::greater<int> > plainDown;
+    map<int, int, std::greater<int> > expected;
+    vector<int> keys = scrambledKeys(200);
+    for (size_t i = 0; i < keys.size(); i++)
+    {
+        down.insert(make_pair(keys[i], (int)i));
+        plainDown.insert(make_pair(keys[i], (int)i));
+        expected[keys[i]] = (int)i;
+    }
+    CHECK(sameItems(down, expected) && sameItems(plainDown, expected));
+    CHECK(down.isBalanced());
+    CHECK(down.lower_bound(100) != down.end() && down.lower_bound(100)->first == 99);
+    for (size_t i = 0; i < keys.size(); i += 2)
+    {
+        down.remove(keys[i]);
+        plainDown.remove(keys[i]);
+        expected.erase(keys[i]);
+    }
+    CHECK(sameItems(down, expected) && sameItems(plainDown, expected));
+    CHECK(down.isBalanced());
+
+    // const char* lookups into std::string keys
+    AVLTree<string, int, TransparentLess> words;
+    const char* names[] = { "pear", "apple", "fig", "banana", "kiwi", "cherry" };
+    for (int i = 0; i < 6; i++) words.insert(make_pair(string(names[i]), i));
+    CHECK(words.find("fig") != words.end() && words.find("fig")->second == 2);
+    CHECK(words.find("grape") == words.end());
+    CHECK(words.lower_bound("c")->first == "cherry");
+    CHECK(words.lower_bound("z") == words.end());
+    words.remove("apple");
+    words.remove("plum");
+    CHECK(words.size() == 5 && words.find("apple") == words.end());
+    CHECK(words.begin()->first == "banana");
+    CHECK(words.isBalanced());
+
+    BinarySearchTree<string, int, TransparentLess> plainWords;
+    for (int i = 0; i < 6; i++) plainWords.insert(make_pair(string(names[i]), i));
+    plainWords.remove("pear");
+    CHECK(plainWords.size() == 5 && plainWords.find("pear") == plainWords.end() && plainWords.find("kiwi")->second == 4);
+}
+
+// Prefix keys (prefix_key.h)
+
+void testPrefixKey()
+{
+    // Lengths around the cached prefix, embedded zeros and high bytes
+    vector<string> strings;
+    strings.push_back("");
+    strings.push_back("a");
+    strings.push_back(string("a\0", 2));
+    strings.push_back(string("a\0\0", 3));
+    strings.push_back("ab");
+    strings.push_back("\xff");
+    strings.push_back("\x80z");
+    strings.push_back("0123456789abcdef");
+    strings.push_back("0123456789abcdeg");
+    strings.push_back("0123456789abcdef0");
+    strings.push_back(string("0123456789abcdef\0", 17));
+    strings.push_back("0123456789abcdefxyz");
+    strings.push_back("0123456789abcdefxy");
+    strings.push_back("0123456789abcde");
+    strings.push_back("https://example.com/a");
+    strings.push_back("https://example.com/b");
+
+    for (size_t i = 0; i < strings.size(); i++)
+    {
+        for (size_t j = 0; j < strings.size(); j++)
+        {
+            PrefixKey a(strings[i]), b(strings[j]);
+            CHECK((a < b) == (strings[i] < strings[j]));
+            CHECK((a == b) == (strings[i] == strings[j]));
+            CHECK(PrefixKeyLess()(a, PrefixKeyView(strings[j])) == (strings[i] < strings[j]));
+            CHECK(PrefixKeyLess()(PrefixKeyView(strings[i]), b) == (strings[i] < strings[j]));
+        }
+    }
+
+    AVLTree<PrefixKey, int, PrefixKeyLess> tree;
+    map<string, int> expected;
+    for (size_t i = 0; i < strings.size(); i++)
+    {
+        tree.insert(make_pair(PrefixKey(strings[i]), (int)i));
+        expected[strings[i]] = (int)i;
+    }
+    map<string, int>::iterator e = expected.begin();
+    for (AVLTree<PrefixKey, int, PrefixKeyLess>::iterator it = tree.begin(); it != tree.end(); ++it, ++e)
+    {
+        CHECK(it->first.str() == e->first && it->second == e->second);
+    }
+    for (size_t i = 0; i < strings.size(); i++)
+    {
+        CHECK(tree.find(PrefixKeyView(strings[i])) != tree.end() && tree.find(PrefixKeyView(strings[i]))->second == (int)i);
+    }
+    CHECK(tree.find(PrefixKeyView("0123456789abcdefx")) == tree.end());
+    CHECK(tree.lower_bound(PrefixKeyView("0123456789abcdefx"))->first.str() == "0123456789abcdefxy");
+
+    stringstream stream;
+    tree.serialize(stream);
+    AVLTree<PrefixKey, int, PrefixKeyLess> copy;
+    copy.deserialize(stream);
+    CHECK(copy.size() == tree.size());
+    for (size_t i = 0; i < strings.size(); i++) CHECK(copy.find(PrefixKeyView(strings[i])) != copy.end());
+}
+
+// Instrumentation counters (bst_stats.h), only collected with -DBST_STATS
+
+void testStats()
+{
+    typedef AVLTree<int, int> Tree;
+    Tree::resetStats();
+    Tree tree;
+    for (int i = 0; i < 100; i++) tree.insert(make_pair(i, i));
+    for (int i = 0; i < 100; i++) tree.find(i);
+    std::thread other([&tree]() { for (int i = 0; i < 10; i++) tree.find(i); });
+    other.join();
+    for (int i = 0; i < 50; i++) tree.remove(i);
+    TreeStats stats = Tree::stats();
+
+    uint64_t histogramTotal = 0;
+    for (int i = 0; i < BST_STATS_DEPTH_BUCKETS; i++) histogramTotal += stats.depthHistogram[i];
+    CHECK(histogramTotal == stats.searches);
+#ifdef BST_STATS
+    // Every operation but the first insert descends, and the finds of the finished thread still count
+    CHECK(stats.searches == 99 + 100 + 10 + 50);
+    CHECK(stats.comparisons >= stats.searches && stats.nodesVisited >= stats.searches);
+    CHECK(stats.comparisonsPerSearch() <= 2 * 8);
+    CHECK(stats.rotateLeft > 0);
+    CHECK(stats.insertFixes > 0 && stats.insertFixSteps >= stats.insertFixes && stats.insertFixMaxDepth > 0);
+    CHECK(stats.removeFixes > 0);
+#else
+    CHECK(stats.searches == 0 && stats.comparisons == 0 && stats.rotateLeft == 0 && stats.insertFixes == 0);
+#endif
+
+    Tree::resetStats();
+    stats = Tree::stats();
+    CHECK(stats.searches == 0 && stats.rotateLeft == 0 && stats.insertFixMaxDepth == 0);
+}
+
+// Benchmark helpers (bench_util.h)
+
+void testBenchUtil()
+{
+    vector<uint64_t> keys = randomKeys(1000, 42);
+    set<uint64_t> distinct(keys.begin(), keys.end());
+    CHECK(keys.size() == 1000 && distinct.size() == 1000);
+    CHECK(*distinct.rbegin() < 4000);
+    CHECK(randomKeys(1000, 42) == keys && randomKeys(1000, 43) != keys);
+
+    vector<uint64_t> population(100);
+    for (size_t i = 0; i < population.size(); i++) population[i] = 1000 + i;
+    vector<uint64_t> draws = zipfKeys(10000, population, 1.2, 7);
+    map<uint64_t, size_t> counts;
+    for (size_t i = 0; i < draws.size(); i++) counts[draws[i]]++;
+    CHECK(draws.size() == 10000);
+    CHECK(counts.begin()->first >= 1000 && counts.rbegin()->first < 1100);
+    CHECK(counts[1000] > counts[1001] && counts[1001] > counts[1009] && counts[1000] > draws.size() / 10);
+    CHECK(zipfKeys(10000, population, 1.2, 7) == draws);
+
+    char program[] = "bench", size[] = "1234";
+    char* args[] = { program, size };
+    CHECK(benchSizeArg(2, args, 1, 99) == 1234 && benchSizeArg(1, args, 1, 99) == 99);
+
+    BenchTimer timer;
+    CHECK(timer.seconds() >= 0);
+}
+
+// Memory accounting (bst_memory.h)
+
+void testMemoryUsage()
+{
+    AVLTree<int, int> tree;
+    BinarySearchTree<int, int> plain;
+    TreeMemoryUsage empty = tree.memoryUsage();
+    CHECK(empty.nodes == 0 && empty.allocatedBytes == 0 && empty.bytesPerNode() == 0.0);
+    CHECK(empty.totalBytes() == sizeof(BinarySearchTree<int, int>));
+
+    for (int i = 0; i < 300; i++)
+    {
+        tree.insert(make_pair(i, i));
+        plain.insert(make_pair(i * 7 % 300, i));
+    }
+    TreeMemoryUsage avl = tree.memoryUsage();
+    TreeMemoryUsage bst = plain.memoryUsage();
+    CHECK(avl.nodes == 300 && bst.nodes == 300);
+    CHECK(avl.nodeSize == sizeof(AVLNode<int, int>) && bst.nodeSize == sizeof(Node<int, int>));
+    CHECK(avl.itemSize == sizeof(pair<const int, int>));
+    CHECK(avl.linkBytesPerNode() == avl.nodeSize - avl.itemSize);
+    CHECK(avl.requestedBytes == 300 * avl.nodeSize);
+    CHECK(avl.allocatedBytes >= avl.requestedBytes && avl.bytesPerNode() >= avl.nodeSize);
+    CHECK(avl.allocatorOverheadBytes() == avl.allocatedBytes - avl.requestedBytes);
+
+    // A copy keeps its nodes in one slab, which costs no per-node overhead
+    AVLTree<int, int> copy(tree);
+    TreeMemoryUsage slab = copy.memoryUsage();
+    CHECK(slab.nodes == 300 && slab.requestedBytes == avl.requestedBytes);
+    CHECK(slab.allocatedBytes >= slab.requestedBytes && slab.allocatedBytes <= avl.allocatedBytes);
+
+    for (int i = 0; i < 100; i++) tree.remove(i);
+    CHECK(tree.memoryUsage().nodes == 200);
+}
+
+// Workload traces (bst_trace.h)
+
+void testTrace()
+{
+    TracingTree<AVLTree<int, string> > tree;
+    tree.insert(make_pair(-1, string("before"))); // not recorded
+    CHECK(!tree.tracing());
+
+    stringstream trace;
+    tree.startTrace(trace);
+    CHECK(tree.tracing());
+    tree.insert(make_pair(5, string("five")));
+    tree.insert(make_pair(7, string("seven")));
+    tree.find(5);
+    tree[7] = "SEVEN";
+    tree.remove(5);
+    const TracingTree<AVLTree<int, string> >& view = tree;
+    CHECK(view[7] == "SEVEN");
+    tree.stopTrace();
+    tree.insert(make_pair(9, string("after"))); // not recorded either
+
+    string bytes = trace.str();
+    stringstream in(bytes);
+    vector<TraceRecord<int, string> > records = readTrace<int, string>(in);
+    char ops[] = { TRACE_INSERT, TRACE_INSERT, TRACE_FIND, TRACE_ACCESS, TRACE_REMOVE, TRACE_ACCESS };
+    int keys[] = { 5, 7, 5, 7, 5, 7 };
+    CHECK(records.size() == 6);
+    for (size_t i = 0; i < records.size() && i < 6; i++) CHECK(records[i].op == ops[i] && records[i].key == keys[i]);
+    CHECK(records.size() >= 2 && records[0].value == "five" && records[1].value == "seven");
+
+    // Replaying the inserts and removes on another container gives the traced contents
+    map<int, string> replayed;
+    replayed[-1] = "before";
+    for (size_t i = 0; i < records.size(); i++)
+    {
+        if (records[i].op == TRACE_INSERT) replayed[records[i].key] = records[i].value;
+        else if (records[i].op == TRACE_REMOVE) replayed.erase(records[i].key);
+    }
+    replayed[7] = "SEVEN";
+    replayed[9] = "after";
+    CHECK(sameItems(tree, replayed));
+
+    // A trace cut short keeps its whole records; a foreign header throws
+    stringstream torn(bytes.substr(0, bytes.size() - 2));
+    CHECK(readTrace<int, string>(torn).size() == 5);
+    stringstream foreign("BSTS" + bytes.substr(4));
+    CHECK_THROWS((readTrace<int, string>(foreign)), std::runtime_error);
+    string corrupt(bytes);
+    corrupt[8] = 'X';
+    stringstream badOp(corrupt);
+    CHECK_THROWS((readTrace<int, string>(badOp)), std::runtime_error);
+}
+
+// Latency histograms (latency_histogram.h), tree timings only with -DBST_TIMING
+
+void testLatencyHistogram()
+{
+    // Buckets tile the values without gaps, each within about 3% of its values
+    for (size_t i = 0; i + 1 < LATENCY_BUCKETS; i++)
+    {
+        CHECK(LatencyHistogram::bucketHigh(i) + 1 == LatencyHistogram::bucketLow(i + 1));
+    }
+    uint64_t samples[] = { 0, 1, 31, 32, 33, 1000, 123456789, (uint64_t)1 << 40, UINT64_MAX };
+    for (size_t i = 0; i < sizeof(samples) / sizeof(samples[0]); i++)
+    {
+        size_t bucket = LatencyHistogram::bucketOf(samples[i]);
+        CHECK(bucket < LATENCY_BUCKETS);
+        CHECK(LatencyHistogram::bucketLow(bucket) <= samples[i] && samples[i] <= LatencyHistogram::bucketHigh(bucket));
+        CHECK(LatencyHistogram::bucketHigh(bucket) - LatencyHistogram::bucketLow(bucket) <= samples[i] / LATENCY_SUB_BUCKETS);
+    }
+
+    LatencyHistogram h;
+    CHECK(h.count() == 0 && h.min() == 0 && h.max() == 0 && h.valueAtPercentile(99) == 0);
+    for (uint64_t v = 1; v <= 1000; v++) h.record(v);
+    CHECK(h.count() == 1000 && h.min() == 1 && h.max() == 1000 && h.mean() == 500.5);
+    CHECK(h.valueAtPercentile(50) >= 500 && h.valueAtPercentile(50) <= 500 + 500 / LATENCY_SUB_BUCKETS);
+    CHECK(h.valueAtPercentile(99) >= 990 && h.valueAtPercentile(100) == 1000);
+
+    BasicLatencyHistogram<RelaxedCounter> other;
+    other.record(5000);
+    h.merge(other);
+    CHECK(h.count() == 1001 && h.max() == 5000 && h.min() == 1);
+
+    stringstream text, json;
+    h.writeText(text, "op");
+    h.writeJson(json);
+    CHECK(text.str().find("op: count=1001 ") == 0);
+    CHECK(json.str().find("{\"count\": 1001, ") == 0 && json.str().find("[1, 1, 1]") != string::npos);
+
+    h.reset();
+    CHECK(h.count() == 0 && h.max() == 0);
+
+    typedef AVLTree<int, int> Tree;
+    Tree::resetTimings();
+    Tree tree;
+    for (int i = 0; i < 100; i++) tree.insert(make_pair(i, i));
+    for (int i = 0; i < 40; i++) tree.find(i);
+    TreeTimings timings = Tree::timings();
+#ifdef BST_TIMING
+    CHECK(timings.ops[TREE_TIME_INSERT].count() == 100 && timings.ops[TREE_TIME_FIND].count() == 40);
+#else
+    CHECK(timings.ops[TREE_TIME_INSERT].count() == 0 && timings.ops[TREE_TIME_FIND].count() == 0);
+#endif
+    Tree::resetTimings();
+    CHECK(Tree::timings().ops[TREE_TIME_INSERT].count() == 0);
+}
+
+// DOT and JSON export (tree_export.h)
+
+void testExport()
+{
+    AVLTree<int, int> tree;
+    for (int i = 1; i <= 7; i++) tree.insert(make_pair(i, i * 10));
+
+    stringstream full, shallow, range, balanced, dot;
+    TreeExporter<int, int>(tree).writeJson(full);
+    CHECK(full.str() == "{\"key\": 4, \"value\": 40, "
+        "\"left\": {\"key\": 2, \"value\": 20, \"left\": {\"key\": 1, \"value\": 10, \"left\": null, \"right\": null}, "
+        "\"right\": {\"key\": 3, \"value\": 30, \"left\": null, \"right\": null}}, "
+        "\"right\": {\"key\": 6, \"value\": 60, \"left\": {\"key\": 5, \"value\": 50, \"left\": null, \"right\": null}, "
+        "\"right\": {\"key\": 7, \"value\": 70, \"left\": null, \"right\": null}}}\n");
+
+    TreeExporter<int, int>(tree).maxDepth(2).writeJson(shallow);
+    CHECK(shallow.str() == "{\"key\": 4, \"value\": 40, "
+        "\"left\": {\"key\": 2, \"value\": 20, \"left\": {\"cut\": \"depth\"}, \"right\": {\"cut\": \"depth\"}}, "
+        "\"right\": {\"key\": 6, \"value\": 60, \"left\": {\"cut\": \"depth\"}, \"right\": {\"cut\": \"depth\"}}}\n");
+
+    // Nodes outside [3, 5] that lead into it are kept and marked
+    TreeExporter<int, int>(tree).keyRange(3, 5).writeJson(range);
+    CHECK(range.str() == "{\"key\": 4, \"value\": 40, \"inRange\": true, "
+        "\"left\": {\"key\": 2, \"value\": 20, \"inRange\": false, \"left\": {\"cut\": \"range\"}, "
+        "\"right\": {\"key\": 3, \"value\": 30, \"inRange\": true, \"left\": null, \"right\": null}}, "
+        "\"right\": {\"key\": 6, \"value\": 60, \"inRange\": false, "
+        "\"left\": {\"key\": 5, \"value\": 50, \"inRange\": true, \"left\": null, \"right\": null}, \"right\": {\"cut\": \"range\"}}}\n");
+
+    // A range starts at its highest node
+    TreeExporter<int, int>(tree).keyRange(5, 7).balances(true).writeJson(balanced);
+    CHECK(balanced.str().find("{\"key\": 6, \"value\": 60, \"balance\": 0, \"inRange\": true, ") == 0);
+
+    TreeExporter<int, int>(tree).maxDepth(2).keyRange(3, 5).writeDot(dot);
+    CHECK(dot.str() == "digraph tree {\n  node [shape=box, fontname=\"monospace\"];\n"
+        "  n0 [label=\"4\\n40\"];\n  n0 -> n1 [label=\"L\"];\n  n0 -> n2 [label=\"R\"];\n"
+        "  n1 [label=\"2\\n20\", style=dashed];\n  n1 -> n3 [label=\"R\"];\n  n3 [label=\"...\", shape=plaintext];\n"
+        "  n2 [label=\"6\\n60\", style=dashed];\n  n2 -> n4 [label=\"L\"];\n  n4 [label=\"...\", shape=plaintext];\n}\n");
+
+    // Text is escaped, and empty exports are null
+    AVLTree<char, string> text;
+    text.insert(make_pair('a', string("q\"\\\n")));
+    stringstream escaped, none;
+    TreeExporter<char, string>(text).writeJson(escaped);
+    CHECK(escaped.str() == "{\"key\": \"a\", \"value\": \"q\\\"\\\\\\n\", \"left\": null, \"right\": null}\n");
+    TreeExporter<int, int>(tree).keyRange(100, 200).writeJson(none);
+    CHECK(none.str() == "null\n");
+
+    // A degenerate tree is walked without recursion
+    BinarySearchTree<int, int> line;
+    for (int i = 0; i < 5000; i++) line.insert(make_pair(i, i));
+    stringstream deep, window;
+    TreeExporter<int, int>(line).writeJson(deep);
+    CHECK(deep.str().size() > 5000 * 40);
+    TreeExporter<int, int>(line).keyRange(4990, 4995).maxDepth(3).writeJson(window);
+    CHECK(window.str().find("{\"key\": 4990, ") == 0 && window.str().find("{\"cut\": \"depth\"}") != string::npos);
+}
+
+// Shape statistics (bst_shape.h)
+
+void testShapeStats()
+{
+    AVLTree<int, int> perfect;
+    for (int i = 1; i <= 7; i++) perfect.insert(make_pair(i, i));
+    TreeShapeStats<int> exact = perfect.shapeStats();
+    CHECK(!exact.sampled && exact.nodes == 7 && exact.leaves == 4 && exact.height == 3);
+    CHECK(exact.internalPathLength == 1 + 2 * 2 + 4 * 3 && exact.pathLengthRatio() == 1.0);
+    CHECK(exact.depthHistogram.size() == 4 && exact.depthHistogram[1] == 1 && exact.depthHistogram[2] == 2 && exact.depthHistogram[3] == 4);
+    CHECK(exact.balanceFactors.size() == 1 && exact.balanceFactors[0] == 7);
+    CHECK(exact.worstSubtrees.empty());
+
+    // A perfect tree and a path have no choices the sampler could get wrong
+    TreeShapeStats<int> sampled = perfect.sampleShapeStats(16);
+    CHECK(sampled.sampled && sampled.nodes == 7 && sampled.leaves == 4 && sampled.height == 3);
+    CHECK(sampled.internalPathLength == exact.internalPathLength && sampled.depthHistogram == exact.depthHistogram);
+
+    BinarySearchTree<int, int> line;
+    for (int i = 1; i <= 100; i++) line.insert(make_pair(i, i));
+    exact = line.shapeStats(3);
+    CHECK(exact.nodes == 100 && exact.leaves == 1 && exact.height == 100 && exact.internalPathLength == 5050);
+    CHECK(exact.averageDepth() == 50.5 && exact.pathLengthRatio() > 8);
+    CHECK(exact.balanceFactors[0] == 1 && exact.balanceFactors[1] == 1 && exact.balanceFactors[99] == 1);
+    CHECK(exact.worstSubtrees.size() == 3);
+    CHECK(exact.worstSubtrees[0].key == 1 && exact.worstSubtrees[0].heightDiff == 99 && exact.worstSubtrees[0].depth == 1 && exact.worstSubtrees[0].size == 100);
+    CHECK(exact.worstSubtrees[2].key == 3 && exact.worstSubtrees[2].heightDiff == 97);
+    sampled = line.sampleShapeStats(4);
+    CHECK(sampled.nodes == 100 && sampled.height == 100 && sampled.internalPathLength == 5050);
+
+    // Elsewhere the estimates vary, but repeat for a seed and never see deeper than the tree
+    BinarySearchTree<int, int> random;
+    vector<int> keys = scrambledKeys(2000);
+    for (size_t i = 0; i < keys.size(); i++) random.insert(make_pair(keys[i], 0));
+    sampled = random.sampleShapeStats(500, 5);
+    CHECK(sampled.nodes == random.sampleShapeStats(500, 5).nodes && sampled.nodes > 0);
+    CHECK(sampled.height <= random.shapeStats().height);
+
+    BinarySearchTree<int, int> none;
+    CHECK(none.shapeStats().nodes == 0 && none.shapeStats().height == 0 && none.sampleShapeStats(10).nodes == 0);
+}
+
+// Scapegoat rebuilds (bst_scapegoat.h)
+
+void testScapegoat()
+{
+    BinarySearchTree<int, int> tree;
+    for (int i = 0; i < 100; i++) tree.insert(make_pair(i, i));
+    CHECK(tree.shapeStats().height == 100);
+
+    // Turning the policy on rebuilds the tree into perfect balance
+    tree.setRebuildAlpha(0.7);
+    CHECK(tree.rebuildAlpha() == 0.7 && tree.shapeStats().height == 7);
+
+    // Sorted inserts stay alpha-height-balanced
+    map<int, int> expected;
+    for (int i = 0; i < 100; i++) expected[i] = i;
+    double logBase = std::log(1 / 0.7);
+    bool bounded = true;
+    for (int i = 100; i < 1500; i++)
+    {
+        tree.insert(make_pair(i, i));
+        expected[i] = i;
+        bounded = bounded && tree.shapeStats().height <= std::floor(std::log((double)tree.size()) / logBase) + 1;
+    }
+    CHECK(bounded);
+    CHECK(sameItems(tree, expected));
+
+    // Removes rebuild once the tree has shrunk enough, so the height stays within one more level
+    for (int i = 0; i < 1400; i++)
+    {
+        int key = i % 2 ? 1499 - i / 2 : i / 2;
+        tree.remove(key);
+        expected.erase(key);
+        if (!tree.empty()) bounded = bounded && tree.shapeStats().height <= std::floor(std::log((double)tree.size()) / logBase) + 2;
+    }
+    CHECK(bounded);
+    CHECK(sameItems(tree, expected));
 
+    CHECK_THROWS(tree.setRebuildAlpha(0.5), std::invalid_argument);
+    CHECK_THROWS(tree.setRebuildAlpha(1.0), std::invalid_argument);
+    tree.setRebuildAlpha(0);
+    CHECK(tree.rebuildAlpha() == 0);
+    for (int i = 2000; i < 2100; i++) tree.insert(make_pair(i, i));
+    CHECK(tree.shapeStats().height >= 100);
+}
+
+// Relaxed balancing (avl_relaxed.h)
+
+void testRelaxed()
+{
+    // Mixed updates with one piggybacked repair each
+    AVLTree<int, int> tree;
+    map<int, int> expected;
+    tree.setRelaxed(true, 1);
+    CHECK(tree.relaxed());
+    vector<int> keys = scrambledKeys(3000);
+    for (size_t i = 0; i < keys.size(); i++)
+    {
+        tree.insert(make_pair(keys[i], (int)i));
+        expected[keys[i]] = (int)i;
+        if (i % 3 == 2)
+        {
+            tree.remove(keys[i / 2]);
+            expected.erase(keys[i / 2]);
+        }
+    }
+    CHECK(sameItems(tree, expected));
+    CHECK(tree.rebalanceStep(5) <= 5);
+    tree.setRelaxed(false);
+    CHECK(!tree.relaxed() && !tree.rebalancePending() && tree.isBalanced());
+    CHECK(sameItems(tree, expected));
+
+    // A same-end burst without piggybacked repairs stays shallow
+    AVLTree<int, int> sorted;
+    sorted.setRelaxed(true, 0);
+    bool shallow = true;
+    for (int i = 0; i < 4000; i++)
+    {
+        sorted.insert(make_pair(i, i));
+        if (i % 50 == 0) shallow = shallow && sorted.shapeStats().height <= 3 * std::log2((double)sorted.size()) + 4;
+    }
+    CHECK(shallow);
+    sorted.setRelaxed(false);
+    CHECK(sorted.isBalanced() && sorted.size() == 4000);
+
+    // With a backlog of pending nodes elsewhere, a deep insert pays down part of it, not all
+    AVLTree<int, int> backlog;
+    backlog.setRelaxed(true, 0);
+    for (size_t i = 0; i < keys.size(); i++) backlog.insert(make_pair(keys[i], 0));
+    bool pending = true;
+    shallow = true;
+    for (int i = 0; i < 500; i++)
+    {
+        backlog.insert(make_pair(10000 + i, 0));
+        pending = pending && backlog.rebalancePending();
+        if (i % 50 == 0) shallow = shallow && backlog.shapeStats().height <= 6 * std::log2((double)backlog.size()) + 6;
+    }
+    CHECK(pending && shallow);
+    CHECK(backlog.rebalanceStep(SIZE_MAX) > 0 && !backlog.rebalancePending() && backlog.isBalanced());
+    CHECK(backlog.size() == keys.size() + 500);
+}
+
+// Copies, moves and swaps (bst.h, avlbst.h)
+
+void testCopyMove()
+{
+    AVLTree<int, int> tree;
+    map<int, int> expected;
+    vector<int> keys = scrambledKeys(2000);
+    for (size_t i = 0; i < keys.size(); i++)
+    {
+        tree.insert(make_pair(keys[i], (int)i));
+        expected[keys[i]] = (int)i;
+    }
+
+    // A copy has the same items and balances, and changes independently
+    AVLTree<int, int> copy(tree);
+    CHECK(sameItems(copy, expected) && copy.isBalanced());
+    CHECK(copy.shapeStats().height == tree.shapeStats().height);
+    for (int i = 0; i < 1000; i++) copy.remove(keys[i]);
+    for (int i = 0; i < 500; i++) copy.insert(make_pair(-1 - i, i));
+    CHECK(copy.size() == 1500 && copy.isBalanced());
+    copy[keys[1500]] = -7;
+    CHECK(sameItems(tree, expected) && tree[keys[1500]] == 1500);
+
+    // Assignment replaces what was there, and assigning a tree to itself keeps it
+    copy = tree;
+    CHECK(sameItems(copy, expected));
+    AVLTree<int, int>& alias = copy;
+    copy = alias;
+    CHECK(sameItems(copy, expected));
+    copy = AVLTree<int, int>();
+    CHECK(copy.empty() && copy.begin() == copy.end());
+
+    // A move takes the nodes and leaves the source empty but usable
+    AVLTree<int, int> moved(std::move(copy = tree));
+    CHECK(sameItems(moved, expected) && copy.empty() && copy.size() == 0);
+    copy.insert(make_pair(1, 1));
+    CHECK(copy.size() == 1 && copy.find(1) != copy.end());
+    copy = std::move(moved);
+    CHECK(sameItems(copy, expected) && moved.empty());
+
+    // swap exchanges contents and relaxed policies
+    AVLTree<int, int> other;
+    other.setRelaxed(true, 2);
+    other.insert(make_pair(5, 5));
+    swap(copy, other);
+    CHECK(other.size() == expected.size() && !other.relaxed());
+    CHECK(copy.size() == 1 && copy.relaxed() && copy[5] == 5);
+
+    // A copy of a relaxed tree keeps its pending repairs and can finish them
+    AVLTree<int, int> relaxed;
+    relaxed.setRelaxed(true, 0);
+    for (int i = 0; i < 1000; i++) relaxed.insert(make_pair(i, i));
+    AVLTree<int, int> relaxedCopy(relaxed);
+    CHECK(relaxedCopy.relaxed() && relaxedCopy.rebalancePending() == relaxed.rebalancePending());
+    relaxedCopy.setRelaxed(false);
+    CHECK(relaxedCopy.isBalanced() && relaxedCopy.size() == 1000 && relaxed.relaxed());
+
+    // A plain BST copy keeps its scapegoat policy and its comparator
+    BinarySearchTree<int, int, std::greater<int> > bst;
+    bst.setRebuildAlpha(0.75);
+    for (int i = 0; i < 300; i++) bst.insert(make_pair(i, i));
+    BinarySearchTree<int, int, std::greater<int> > bstCopy;
+    bstCopy = bst;
+    CHECK(bstCopy.rebuildAlpha() == 0.75 && bstCopy.size() == 300 && bstCopy.begin()->first == 299);
+    for (int i = 300; i < 600; i++) bstCopy.insert(make_pair(i, i));
+    CHECK(bstCopy.shapeStats().height <= std::log((double)bstCopy.size()) / std::log(1 / 0.75) + 1);
+    CHECK(bst.size() == 300);
+
+    BinarySearchTree<int, int> empty;
+    BinarySearchTree<int, int> emptyCopy(empty);
+    CHECK(emptyCopy.empty() && emptyCopy.size() == 0);
+
+    // Trees of different types never exchange nodes, and neither side changes
+    typedef BinarySearchTree<int, int> PlainTree;
+    typedef AVLTree<int, int> IntAVL;
+    BinarySearchTree<int, int> plain;
+    plain.insert(make_pair(1, 1));
+    AVLTree<int, int> avl;
+    avl.insert(make_pair(2, 2));
+    CHECK_THROWS(swap(plain, static_cast<PlainTree&>(avl)), std::invalid_argument);
+    CHECK_THROWS(plain = std::move(static_cast<PlainTree&>(avl)), std::invalid_argument);
+    CHECK_THROWS(PlainTree taken(std::move(static_cast<PlainTree&>(avl))), std::invalid_argument);
+    CHECK(plain.size() == 1 && plain.find(1) != plain.end() && avl.size() == 1 && avl.find(2) != avl.end());
+
+    AugmentedAVLTree<int, int, SumMonoid<int> > sums;
+    sums.insert(make_pair(3, 3));
+    AVLMultimap<int, int> multi;
+    multi.insert(make_pair(4, 4));
+    CHECK_THROWS(avl.swap(sums), std::invalid_argument);
+    CHECK_THROWS(swap(avl, static_cast<IntAVL&>(multi)), std::invalid_argument);
+    CHECK_THROWS(avl = std::move(static_cast<IntAVL&>(sums)), std::invalid_argument);
+    CHECK_THROWS(IntAVL taken(std::move(static_cast<IntAVL&>(sums))), std::invalid_argument);
+    avl.insert(make_pair(5, 5));
+    sums.insert(make_pair(6, 6));
+    CHECK(avl.size() == 2 && avl.isBalanced() && sums.aggregate() == 9 && multi.count(4) == 1);
+
+    // Derived trees still move and swap with their own type
+    AugmentedAVLTree<int, int, SumMonoid<int> > movedSums(std::move(sums));
+    AVLMultimap<int, int> movedMulti(std::move(multi));
+    movedMulti.insert(make_pair(4, 5));
+    CHECK(movedSums.aggregate() == 9 && sums.empty() && movedMulti.count(4) == 2 && multi.empty());
+    swap(multi, movedMulti);
+    sums = std::move(movedSums);
+    CHECK(multi.count(4) == 2 && movedMulti.empty() && sums.aggregate() == 9);
+    IntervalMap<int, string> windows;
+    windows.insert(1, 5, "a");
+    IntervalMap<int, string> movedWindows(std::move(windows));
+    CHECK(movedWindows.size() == 1 && windows.empty());
+}
+
+// Clearing and background reclamation (bst_reclaim.h)
+
+/*
+* A tree whose count can be put out of step with its nodes, as a failed
+* load or a bug elsewhere might leave it
+*/
+struct MiscountedTree : public AVLTree<int, int>
+{
+    void forgetCount() { this->size_ = 0; }
+};
+
+void testReclaim()
+{
+    AVLTree<int, int> tree;
+    vector<int> keys = scrambledKeys(5000);
+    for (size_t i = 0; i < keys.size(); i++) tree.insert(make_pair(keys[i], 0));
+
+    // Slab-only, mixed slab and heap, and empty trees all clear and stay usable
+    AVLTree<int, int> slabs(tree);
+    slabs.clear();
+    CHECK(slabs.empty() && slabs.size() == 0 && slabs.memoryUsage().nodes == 0);
+    slabs.insert(make_pair(1, 1));
+    CHECK(slabs.size() == 1 && slabs[1] == 1);
+
+    AVLTree<int, int> mixed(tree);
+    for (int i = 0; i < 100; i++) mixed.remove(keys[i]);
+    for (int i = 0; i < 100; i++) mixed.insert(make_pair(-1 - i, i));
+    CHECK(mixed.size() == keys.size());
+    mixed.clear();
+    CHECK(mixed.empty());
+
+    AVLTree<int, int> none;
+    none.clear();
+    none.clearInBackground();
+    CHECK(none.empty());
+
+    // Removing every node of a copy frees its slab on the way
+    AVLTree<int, int> drained(tree);
+    for (size_t i = 0; i < keys.size(); i++) drained.remove(keys[i]);
+    CHECK(drained.empty() && drained.memoryUsage().allocatedBytes == 0);
+
+    // The fast path counts the linked nodes instead of trusting size()
+    MiscountedTree miscounted;
+    for (int i = 0; i < 64; i++) miscounted.insert(make_pair(i, i));
+    miscounted.forgetCount();
+    miscounted.clear();
+    CHECK(miscounted.empty());
+    AVLTree<int, int> grown(tree);
+    grown.insert(make_pair(-1, -1));
+    static_cast<AVLTree<int, int>&>(miscounted) = grown;
+    miscounted.forgetCount();
+    miscounted.clearInBackground();
+    CHECK(miscounted.empty());
+
+    // Background clears of every kind, on one worker and on several
+    NodeReclaimer reclaimer(4);
+    AVLTree<int, int> big;
+    for (int i = 0; i < 100000; i++) big.insert(make_pair(i, i));
+    AVLTree<int, int> bigCopy(big);
+    AVLTree<int, string> strings;
+    for (int i = 0; i < 1000; i++) strings.insert(make_pair(i, string(40, 'a' + i % 26)));
+    AVLTree<int, string> stringsCopy(strings);
+    stringsCopy.insert(make_pair(-1, "heap"));
+    big.clearInBackground(reclaimer);
+    bigCopy.clearInBackground(reclaimer);
+    strings.clearInBackground(reclaimer);
+    stringsCopy.clearInBackground();
+    mixed = tree;
+    mixed.insert(make_pair(-1, -1));
+    mixed.clearInBackground(reclaimer);
+    CHECK(big.empty() && bigCopy.empty() && strings.empty() && stringsCopy.empty() && mixed.empty());
+
+    // The cleared trees are usable while the workers are still freeing
+    big.insert(make_pair(7, 7));
+    strings.insert(make_pair(7, "seven"));
+    CHECK(big.size() == 1 && strings[7] == "seven");
+    reclaimer.wait();
+    NodeReclaimer::shared().wait();
+    CHECK(reclaimer.threads() == 4);
+}
+
+// Batched lookups (bst_batch.h)
+
+/*
+* True if findBatch gives the same iterator as find for every key
+*/
+template<typename Tree, typename Key>
+bool batchMatchesFind(const Tree& tree, const vector<Key>& keys)
+{
+    vector<typename Tree::iterator> found;
+    tree.findBatch(keys, found);
+    if (found.size() != keys.size()) return false;
+    for (size_t i = 0; i < keys.size(); i++)
+    {
+        if (found[i] != tree.find(keys[i])) return false;
+    }
+    return true;
+}
+
+void testFindBatch()
+{
+    AVLTree<int, int> tree;
+    vector<int> keys = scrambledKeys(5000);
+    for (size_t i = 0; i < keys.size(); i++) tree.insert(make_pair(keys[i], (int)i));
+
+    // Hits, misses between and outside the keys, and repeats, in batches
+    // shorter and longer than the lanes
+    vector<int> probes;
+    for (int i = -5; i < 15200; i += 7) probes.push_back(i);
+    probes.push_back(0);
+    probes.push_back(0);
+    CHECK(batchMatchesFind(tree, probes));
+    for (size_t n = 0; n <= 40; n++) CHECK(batchMatchesFind(tree, vector<int>(probes.begin(), probes.begin() + n)));
+
+    vector<AVLTree<int, int>::iterator> found(1, tree.begin());
+    tree.findBatch(vector<int>(), found);
+    CHECK(found.empty());
+    found.resize(3);
+    int raw[3] = { 3, 4, 14997 };
+    tree.findBatch(raw, 3, &found[0]);
+    CHECK(found[0]->second == tree[3] && found[1] == tree.end() && found[2]->first == 14997);
+
+    // An empty tree, a degenerate one and a reversed order
+    AVLTree<int, int> empty;
+    CHECK(batchMatchesFind(empty, probes));
+    BinarySearchTree<int, int, std::greater<int> > line;
+    for (int i = 0; i < 500; i++) line.insert(make_pair(i, i));
+    CHECK(batchMatchesFind(line, probes));
+
+    AVLTree<string, int> words;
+    vector<string> wordProbes;
+    for (int i = 0; i < 300; i++)
+    {
+        if (i % 2) words.insert(make_pair("w" + to_string(i), i));
+        wordProbes.push_back("w" + to_string(i));
+    }
+    CHECK(batchMatchesFind(words, wordProbes));
+}
+
+// Merge joins (bst_join.h)
+
+/*
+* Joins sorted keys against tree and checks each callback against expected,
+* in input order. Returns the number of matches, or -1 on a mismatch.
+*/
+template<typename Tree, typename Map>
+long joinMatchesMap(const Tree& tree, const vector<int>& keys, const Map& expected)
+{
+    size_t next = 0;
+    bool same = true;
+    size_t matches = tree.mergeJoin(keys.begin(), keys.end(),
+        [&](const pair<const int, int>& item)
+        {
+            typename Map::const_iterator e = expected.find(keys[next]);
+            same = same && e != expected.end() && item.first == e->first && item.second == e->second;
+            next++;
+        },
+        [&](const int& key)
+        {
+            same = same && key == keys[next] && expected.find(key) == expected.end();
+            next++;
+        });
+    return same && next == keys.size() ? (long)matches : -1;
+}
+
+void testMergeJoin()
+{
+    AVLTree<int, int> tree;
+    map<int, int> expected;
+    vector<int> keys = scrambledKeys(4000);
+    for (size_t i = 0; i < keys.size(); i++)
+    {
+        tree.insert(make_pair(keys[i], (int)i));
+        expected[keys[i]] = (int)i;
+    }
+
+    // Dense, sparse and repeated keys, and keys before and past the tree
+    for (int stride = 1; stride <= 4097; stride *= 4)
+    {
+        vector<int> probes;
+        for (int k = -10; k < 12100; k += stride) probes.push_back(k);
+        long matches = 0;
+        for (size_t i = 0; i < probes.size(); i++) matches += expected.count(probes[i]);
+        CHECK(joinMatchesMap(tree, probes, expected) == matches);
+    }
+    int repeated[] = { -3, 0, 0, 0, 1, 3, 3, 11997, 11997, 11998, 20000, 20000 };
+    CHECK(joinMatchesMap(tree, vector<int>(repeated, repeated + 12), expected) == 7);
+    CHECK(joinMatchesMap(tree, vector<int>(), expected) == 0);
+
+    // Random gaps from a skewed tree
+    BinarySearchTree<int, int> line;
+    map<int, int> lineExpected;
+    for (int i = 0; i < 1000; i++)
+    {
+        line.insert(make_pair(i * 2, i));
+        lineExpected[i * 2] = i;
+    }
+    vector<int> gaps;
+    srand(5);
+    for (int k = 0; k < 2100; k += 1 + rand() % 40) gaps.push_back(k);
+    CHECK(joinMatchesMap(line, gaps, lineExpected) >= 0);
+
+    AVLTree<int, int> empty;
+    CHECK(joinMatchesMap(empty, gaps, map<int, int>()) == 0);
+
+    // Matched items can be updated in place, and a reversed tree joins keys sorted its way
+    int bumped[] = { 0, 3, 6 };
+    tree.mergeJoin(bumped, bumped + 3, [](pair<const int, int>& item) { item.second = -item.first; }, [](const int&) {});
+    CHECK(tree[0] == 0 && tree[3] == -3 && tree[6] == -6 && tree[9] == expected[9]);
+
+    BinarySearchTree<int, int, std::greater<int> > reversed;
+    for (int i = 0; i < 100; i++) reversed.insert(make_pair(i, i));
+    int descending[] = { 200, 99, 50, 50, 49, -1 };
+    vector<int> unmatched;
+    size_t hits = reversed.mergeJoin(descending, descending + 6, [](pair<const int, int>&) {}, [&](const int& k) { unmatched.push_back(k); });
+    CHECK(hits == 4 && unmatched.size() == 2 && unmatched[0] == 200 && unmatched[1] == -1);
+}
+
+// Finger search (bst_finger.h)
+
+void testFinger()
+{
+    AVLTree<int, int> tree;
+    vector<int> keys = scrambledKeys(3000);
+    for (size_t i = 0; i < keys.size(); i++) tree.insert(make_pair(keys[i], (int)i));
+
+    // A cursor that walks back and forth agrees with searches from the root
+    AVLTree<int, int>::finger cursor(tree);
+    CHECK(cursor.position() == tree.end());
+    srand(11);
+    bool same = true;
+    int k = 4500;
+    for (int i = 0; i < 5000; i++)
+    {
+        k += rand() % 41 - 20;
+        if (i % 500 == 0) k = rand() % 9100 - 50;
+        same = same && cursor.find(k) == tree.find(k) && cursor.lower_bound(k) == tree.lower_bound(k);
+        same = same && (tree.lower_bound(k) == tree.end() || cursor.position() == tree.lower_bound(k));
+    }
+    CHECK(same);
+
+    // Past the last key the finger stays where it was
+    AVLTree<int, int>::iterator last = cursor.lower_bound(8997);
+    CHECK(last != tree.end() && last->first == 8997);
+    CHECK(cursor.find(9000) == tree.end() && cursor.lower_bound(9000) == tree.end() && cursor.position() == last);
+
+    // The finger survives inserts, rotations and removes of other keys
+    cursor.find(4500);
+    for (int i = 0; i < 2000; i++) tree.insert(make_pair(-1 - i, i));
+    for (int i = 0; i < 500; i++) tree.remove(keys[i] == 4500 ? keys[2999] : keys[i]);
+    CHECK(cursor.position()->first == 4500 && tree.isBalanced());
+    same = true;
+    for (int key = 4500; key > -2100; key -= 13) same = same && cursor.find(key) == tree.find(key);
+    CHECK(same);
+
+    // After a reset it searches from the root again
+    tree.remove(cursor.position()->first);
+    cursor.reset();
+    CHECK(cursor.position() == tree.end() && cursor.find(3) == tree.find(3));
+
+    AVLTree<int, int> empty;
+    AVLTree<int, int>::finger nothing(empty);
+    CHECK(nothing.find(1) == empty.end() && nothing.lower_bound(1) == empty.end());
+
+    // A plain BST with a reversed order
+    BinarySearchTree<int, int, std::greater<int> > reversed;
+    for (size_t i = 0; i < keys.size(); i++) reversed.insert(make_pair(keys[i], 0));
+    BinarySearchTree<int, int, std::greater<int> >::finger back(reversed);
+    same = true;
+    for (int key = 0; key < 9000; key += 5) same = same && back.lower_bound(key) == reversed.lower_bound(key);
+    CHECK(same);
+}
+
+// Range aggregates (avl_augmented.h)
+
+/*
+* Concatenates values in key order, which shows the order they were
+* combined in as well as which ones
+*/
+struct ConcatMonoid
+{
+    typedef string value_type;
+    string identity() const { return string(); }
+    string lift(const string& value) const { return value; }
+    string combine(const string& a, const string& b) const { return a + b; }
+};
+
+/*
+* True if tree's aggregate of every range [lo, hi] in a sample matches
+* concatenating the values of expected in that range
+*/
+template<typename Tree>
+bool aggregatesMatch(const Tree& tree, const map<int, string>& expected, int maxKey)
+{
+    string all;
+    for (map<int, string>::const_iterator it = expected.begin(); it != expected.end(); ++it) all += it->second;
+    if (tree.aggregate() != all) return false;
+
+    for (int lo = -3; lo <= maxKey + 3; lo += 1 + maxKey / 37)
+    {
+        for (int hi = lo - 2; hi <= maxKey + 3; hi += 1 + maxKey / 29)
+        {
+            string want;
+            for (map<int, string>::const_iterator it = expected.lower_bound(lo); it != expected.end() && it->first <= hi; ++it) want += it->second;
+            if (tree.aggregate(lo, hi) != want) return false;
+        }
+    }
+    return true;
+}
+
+void testAugmented()
+{
+    typedef AugmentedAVLTree<int, string, ConcatMonoid> ConcatTree;
+    ConcatTree tree;
+    map<int, string> expected;
+    CHECK(tree.aggregate() == "" && tree.aggregate(0, 100) == "");
+
+    // Inserts, overwrites and removes keep every node's aggregate current
+    vector<int> keys = scrambledKeys(600);
+    for (size_t i = 0; i < keys.size(); i++)
+    {
+        string value(1, (char)('a' + i % 26));
+        tree.insert(make_pair(keys[i], value));
+        expected[keys[i]] = value;
+    }
+    CHECK(aggregatesMatch(tree, expected, 1800));
+    for (int i = 0; i < 600; i += 3)
+    {
+        tree.insert(make_pair(keys[i], string("X")));
+        expected[keys[i]] = "X";
+        if (i % 2 == 0)
+        {
+            tree.remove(keys[i + 1]);
+            expected.erase(keys[i + 1]);
+        }
+    }
+    CHECK(aggregatesMatch(tree, expected, 1800) && tree.isBalanced());
+    CHECK(tree[keys[0]] == "X");
+
+    // Copies, moves, swaps and bulk loads carry the aggregates with them
+    ConcatTree copy(tree);
+    CHECK(aggregatesMatch(copy, expected, 1800));
+    ConcatTree moved(std::move(copy));
+    CHECK(aggregatesMatch(moved, expected, 1800) && copy.aggregate() == "");
+    ConcatTree other;
+    other.insert(make_pair(1, string("one")));
+    other.swap(moved);
+    CHECK(aggregatesMatch(other, expected, 1800) && moved.aggregate() == "one");
+
+    stringstream stream;
+    tree.serialize(stream);
+    ConcatTree read;
+    read.deserialize(stream);
+    CHECK(aggregatesMatch(read, expected, 1800));
+
+    // Relaxed rebalancing keeps the aggregates through its deferred rotations
+    AugmentedAVLTree<int, int, SumMonoid<int> > sums;
+    AugmentedAVLTree<int, int, MinMonoid<int> > mins;
+    AugmentedAVLTree<double, double, MaxMonoid<double> > maxes;
+    sums.setRelaxed(true, 1);
+    long total = 0;
+    for (int i = 0; i < 2000; i++)
+    {
+        sums.insert(make_pair(i, i % 17));
+        mins.insert(make_pair(i, 5000 - i));
+        maxes.insert(make_pair(i, i * 0.5));
+        total += i % 17;
+    }
+    CHECK(sums.aggregate() == total);
+    sums.setRelaxed(false);
+    long range = 0;
+    for (int i = 100; i <= 1500; i++) range += i % 17;
+    CHECK(sums.aggregate(100, 1500) == range && sums.isBalanced());
+
+    size_t bytes = IntImageWriter::imageSize(sums.size());
+    vector<uint64_t> buffer(bytes / sizeof(uint64_t) + 1);
+    IntImageWriter::writeTo(sums, &buffer[0], bytes);
+    AugmentedAVLTree<int, int, SumMonoid<int> > loaded;
+    IntImageWriter::load(IntImage(&buffer[0], bytes), loaded);
+    CHECK(loaded.aggregate() == total && loaded.aggregate(100, 1500) == range);
+    CHECK(mins.aggregate() == 3001 && mins.aggregate(0, 9) == 4991 && mins.aggregate(3000, 2000) == std::numeric_limits<int>::max());
+    CHECK(maxes.aggregate(-1.0, 10.5) == 5.0 && maxes.aggregate(3000, 4000) == -std::numeric_limits<double>::infinity());
+}
+
+// Interval maps (interval_map.h)
+
+/*
+* Collects the intervals a query visits as "start-end:value" strings
+*/
+struct IntervalCollector
+{
+    vector<string>* out;
+    void operator()(const int& start, const int& end, string& value) const
+    {
+        out->push_back(to_string(start) + "-" + to_string(end) + ":" + value);
+    }
+};
+
+/*
+* The same query by brute force over a list of intervals in start order
+*/
+vector<string> overlapsOf(const multimap<int, pair<int, string> >& all, int lo, int hi)
+{
+    vector<string> found;
+    for (multimap<int, pair<int, string> >::const_iterator it = all.begin(); it != all.end(); ++it)
+    {
+        if (it->first <= hi && it->second.first >= lo) found.push_back(to_string(it->first) + "-" + to_string(it->second.first) + ":" + it->second.second);
+    }
+    return found;
+}
+
+void testIntervalMap()
+{
+    IntervalMap<int, string> leases;
+    multimap<int, pair<int, string> > expected;
+    vector<string> found;
+    IntervalCollector collect = { &found };
+    CHECK(leases.stabbing(0, collect) == 0 && found.empty());
+
+    // Intervals sharing a start are all kept, in insertion order
+    srand(3);
+    for (int i = 0; i < 800; i++)
+    {
+        int start = rand() % 1000;
+        int end = start + (i % 10 == 0 ? rand() % 400 : rand() % 20);
+        string value = "v" + to_string(i);
+        leases.insert(start, end, value);
+        expected.insert(make_pair(start, make_pair(end, value)));
+    }
+    leases.insert(500, 510, "first");
+    leases.insert(500, 505, "second");
+    leases.insert(500, 510, "third");
+    expected.insert(make_pair(500, make_pair(510, string("first"))));
+    expected.insert(make_pair(500, make_pair(505, string("second"))));
+    expected.insert(make_pair(500, make_pair(510, string("third"))));
+    CHECK(leases.size() == expected.size() && leases.isBalanced());
+    CHECK(leases.count(500) == expected.count(500) && leases.count(-1) == 0);
+
+    bool same = true;
+    for (int lo = -10; lo < 1500; lo += 37)
+    {
+        for (int hi = lo; hi < lo + 300; hi += 71)
+        {
+            found.clear();
+            size_t n = leases.overlapping(lo, hi, collect);
+            same = same && n == found.size() && found == overlapsOf(expected, lo, hi);
+        }
+        found.clear();
+        leases.stabbing(lo, collect);
+        same = same && found == overlapsOf(expected, lo, lo);
+    }
+    CHECK(same);
+
+    // removeOne takes the oldest interval with that start and end, remove takes them all
+    CHECK(leases.removeOne(500, 510) && !leases.removeOne(500, 999) && !leases.removeOne(-5, 0));
+    for (multimap<int, pair<int, string> >::iterator it = expected.lower_bound(500); it != expected.end(); ++it)
+    {
+        if (it->second.first == 510)
+        {
+            expected.erase(it);
+            break;
+        }
+    }
+    found.clear();
+    leases.stabbing(500, collect);
+    CHECK(found == overlapsOf(expected, 500, 500));
+
+    for (int start = 0; start < 1000; start += 3)
+    {
+        leases.remove(start);
+        expected.erase(start);
+    }
+    CHECK(leases.size() == expected.size() && leases.count(0) == 0 && leases.isBalanced());
+    found.clear();
+    leases.overlapping(0, 2000, collect);
+    CHECK(found == overlapsOf(expected, 0, 2000));
+
+    // Copies keep the largest ends, and inverted intervals are refused
+    IntervalMap<int, string> copy(leases);
+    found.clear();
+    copy.overlapping(200, 260, collect);
+    CHECK(found == overlapsOf(expected, 200, 260));
+    CHECK_THROWS(leases.insert(5, 4, "backwards"), std::invalid_argument);
+    Interval<int, string> backwards = { 4, "backwards" };
+    CHECK_THROWS(leases.insert(make_pair(5, backwards)), std::invalid_argument);
+    CHECK(leases.size() == expected.size());
+}
+
+// Multimaps (avl_multimap.h)
+
+/*
+* True if the multimap holds exactly the items of expected, in the same
+* order (for duplicates, insertion order)
+*/
+template<typename Tree>
+bool sameMultiItems(const Tree& tree, const multimap<int, int>& expected)
+{
+    if (tree.size() != expected.size()) return false;
+    multimap<int, int>::const_iterator e = expected.begin();
+    for (typename Tree::iterator it = tree.begin(); it != tree.end(); ++it, ++e)
+    {
+        if (it->first != e->first || it->second != e->second) return false;
+    }
+    return true;
+}
+
+void testMultimap()
+{
+    AVLMultimap<int, int> tree;
+    multimap<int, int> expected;
+    CHECK(tree.count(1) == 0 && tree.equal_range(1).first == tree.end() && !tree.removeOne(1));
+
+    // Duplicates are kept in insertion order through rotations
+    for (int i = 0; i < 3000; i++)
+    {
+        int key = (i * 7919) % 300;
+        tree.insert(make_pair(key, i));
+        expected.insert(make_pair(key, i));
+    }
+    CHECK(sameMultiItems(tree, expected) && tree.isBalanced());
+    CHECK(tree.count(17) == 10 && tree.find(17)->second == expected.find(17)->second && tree[17] == tree.find(17)->second);
+    CHECK(tree.upper_bound(17)->first == 18 && tree.upper_bound(299) == tree.end());
+    size_t run = 0;
+    pair<AVLMultimap<int, int>::iterator, AVLMultimap<int, int>::iterator> range = tree.equal_range(42);
+    for (AVLMultimap<int, int>::iterator it = range.first; it != range.second; ++it) run += it->first == 42;
+    CHECK(run == 10 && tree.equal_range(1000).first == tree.equal_range(1000).second);
+
+    // removeOne takes the oldest, removeAll and remove the whole run, erase one item
+    CHECK(tree.removeOne(17));
+    expected.erase(expected.find(17));
+    CHECK(tree.removeAll(18) == 10 && tree.removeAll(18) == 0);
+    expected.erase(18);
+    tree.remove(19);
+    expected.erase(19);
+    AVLMultimap<int, int>::iterator next = tree.erase(tree.find(20));
+    expected.erase(expected.find(20));
+    CHECK(next->first == 20 && next->second == expected.find(20)->second);
+    CHECK(sameMultiItems(tree, expected) && tree.isBalanced());
+    for (int key = 0; key < 300; key += 2)
+    {
+        tree.remove(key);
+        expected.erase(key);
+    }
+    CHECK(sameMultiItems(tree, expected) && tree.isBalanced());
+
+    // Copies and relaxed balancing keep the runs
+    AVLMultimap<int, int> copy(tree);
+    CHECK(sameMultiItems(copy, expected));
+    AVLMultimap<int, int> relaxed;
+    relaxed.setRelaxed(true, 1);
+    multimap<int, int> relaxedExpected;
+    for (int i = 0; i < 2000; i++)
+    {
+        relaxed.insert(make_pair(i / 4, i));
+        relaxedExpected.insert(make_pair(i / 4, i));
+    }
+    relaxed.setRelaxed(false);
+    CHECK(sameMultiItems(relaxed, relaxedExpected) && relaxed.isBalanced());
+
+    // Heterogeneous removes mean the same as removes by key
+    AVLMultimap<string, int, TransparentLess> words;
+    words.insert(make_pair(string("fig"), 1));
+    words.insert(make_pair(string("fig"), 2));
+    words.insert(make_pair(string("kiwi"), 3));
+    words.insert(make_pair(string("fig"), 4));
+    words.remove("fig");
+    CHECK(words.size() == 1 && words.count("fig") == 0);
+    words.insert(make_pair(string("kiwi"), 5));
+    words.remove(string("kiwi"));
+    CHECK(words.empty());
+}
+
+// Ordered LRU/TTL caches (ordered_cache.h)
+
+/*
+* A clock that only moves when told to
+*/
+struct ManualClock
+{
+    typedef std::chrono::milliseconds duration;
+    typedef duration::rep rep;
+    typedef duration::period period;
+    typedef std::chrono::time_point<ManualClock> time_point;
+    static const bool is_steady = true;
+
+    static time_point now() { return time_point(duration(ticks)); }
+    static void advance(long ms) { ticks += ms; }
+
+    static long ticks;
+};
+
+long ManualClock::ticks = 0;
+
+void testOrderedCache()
+{
+    typedef OrderedCache<int, int, std::less<int>, ManualClock> Cache;
+    typedef std::chrono::milliseconds ms;
+
+    // Random gets and puts evict exactly what a list-based LRU would
+    Cache lru(50);
+    vector<int> order; // least recently used first
+    srand(9);
+    bool same = true;
+    for (int i = 0; i < 20000 && same; i++)
+    {
+        int key = rand() % 120;
+        vector<int>::iterator pos = std::find(order.begin(), order.end(), key);
+        if (rand() % 2)
+        {
+            int* value = lru.get(key);
+            same = (value != nullptr) == (pos != order.end()) && (!value || *value == key * 2);
+            if (pos == order.end()) continue;
+            order.erase(pos);
+        }
+        else
+        {
+            lru.put(key, key * 2);
+            if (pos != order.end()) order.erase(pos);
+            else if (order.size() == 50) order.erase(order.begin());
+        }
+        order.push_back(key);
+        same = same && lru.size() == order.size();
+    }
+    CHECK(same);
+    set<int> held(order.begin(), order.end());
+    vector<int> scanned;
+    for (Cache::iterator it = lru.begin(); it != lru.end(); ++it) scanned.push_back(it->first);
+    CHECK(scanned == vector<int>(held.begin(), held.end()));
+    CacheStats stats = lru.stats();
+    CHECK(stats.hits + stats.misses > 0 && stats.evictions > 0 && stats.expirations == 0);
+
+    // Shrinking evicts the least recently used, and a capacity of 0 has no limit
+    lru.setCapacity(10);
+    CHECK(lru.size() == 10 && lru.peek(order[order.size() - 10]) && !lru.peek(order[order.size() - 11]));
+    lru.setCapacity(0);
+    for (int i = 0; i < 500; i++) lru.put(1000 + i, i);
+    CHECK(lru.size() == 510);
+    lru.clear();
+    CHECK(lru.empty() && lru.begin() == lru.end() && !lru.get(1000));
+    lru.resetStats();
+    CHECK(lru.stats().hits == 0 && lru.stats().misses == 0);
+
+    // Entries expire a time to live after their last write or touch, not their last read
+    Cache ttl(0, ms(100));
+    CHECK(ttl.ttl() == ms(100));
+    ttl.put(1, 10);
+    ttl.put(2, 20);
+    ManualClock::advance(60);
+    ttl.put(3, 30);
+    CHECK(ttl.get(1) && *ttl.get(1) == 10);
+    CHECK(ttl.touch(2));
+    ManualClock::advance(50);
+    CHECK(!ttl.get(1) && ttl.peek(2) && ttl.peek(3));
+    CHECK(ttl.stats().expirations == 1 && ttl.size() == 2);
+    ttl.put(3, 31);
+    ManualClock::advance(70);
+    CHECK(ttl.expire() == 1 && !ttl.peek(2) && *ttl.peek(3) == 31);
+    CHECK(!ttl.touch(4) && ttl.erase(3) && !ttl.erase(3) && ttl.empty());
+
+    // A full cache drops an expired entry before the least recently used
+    Cache both(3, ms(100));
+    both.put(1, 1);
+    ManualClock::advance(50);
+    both.put(2, 2);
+    both.put(3, 3);
+    both.get(1);
+    ManualClock::advance(60);
+    both.put(4, 4);
+    CHECK(both.size() == 3 && !both.peek(1) && both.peek(2) && both.peek(4));
+    CHECK(both.stats().expirations == 1 && both.stats().evictions == 0);
+    both.put(5, 5);
+    CHECK(!both.peek(2) && both.stats().evictions == 1);
+
+    // Without a time to live nothing expires
+    Cache forever(0);
+    forever.put(1, 1);
+    ManualClock::advance(1000000);
+    CHECK(forever.expire() == 0 && forever.get(1) && *forever.get(1) == 1);
+}
+
+// Hot-key lookup cache (bst_lookup_cache.h)
+
+/*
+* A key type without a std::hash
+*/
+struct Unhashed
+{
+    int id;
+    bool operator<(const Unhashed& other) const { return id < other.id; }
+};
+
+ostream& operator<<(ostream& out, const Unhashed& key)
+{
+    return out << key.id;
+}
+
+void testLookupCache()
+{
+    AVLTree<int, int> tree;
+    CHECK(tree.lookupCacheSlots() == 0 && tree.lookupCacheStats().slots == 0);
+    tree.setLookupCache(100);
+    CHECK(tree.lookupCacheSlots() == 128);
+
+    // Repeated finds of a few keys hit after their first miss
+    vector<int> keys = scrambledKeys(2000);
+    map<int, int> all;
+    for (size_t i = 0; i < keys.size(); i++)
+    {
+        tree.insert(make_pair(keys[i], (int)i));
+        all[keys[i]] = (int)i;
+    }
+    for (int round = 0; round < 10; round++)
+    {
+        for (int k = 0; k < 30; k += 3) CHECK(tree.find(k) != tree.end() && tree.find(k)->first == k);
+    }
+    LookupCacheStats stats = tree.lookupCacheStats();
+    CHECK(stats.hits + stats.misses == 200 && stats.misses <= 20 && stats.hitRate() >= 0.9);
+    CHECK(tree.find(1) == tree.end() && tree.lookupCacheStats().misses == stats.misses + 1);
+
+    // A small table with many collisions stays correct through every kind of update
+    AVLTree<int, int> small;
+    map<int, int> expected;
+    small.setLookupCache(4);
+    srand(13);
+    bool same = true;
+    for (int i = 0; i < 20000; i++)
+    {
+        int key = rand() % 300;
+        switch (rand() % 4)
+        {
+        case 0:
+            small.insert(make_pair(key, i));
+            expected[key] = i;
+            break;
+        case 1:
+            small.remove(key);
+            expected.erase(key);
+            break;
+        default:
+            AVLTree<int, int>::iterator it = small.find(key);
+            map<int, int>::iterator e = expected.find(key);
+            same = same && (it == small.end()) == (e == expected.end()) && (it == small.end() || it->second == e->second);
+        }
+    }
+    CHECK(same && sameItems(small, expected));
+    CHECK(small.lookupCacheStats().invalidations > 0 && small.lookupCacheStats().hits > 0);
+
+    // Removing a cached key drops its slot
+    small.insert(make_pair(1000, 1));
+    small.find(1000);
+    small.resetLookupCacheStats();
+    small.remove(1000);
+    CHECK(small.lookupCacheStats().invalidations == 1 && small.find(1000) == small.end());
+    small.insert(make_pair(1000, 5));
+    CHECK(small.find(1000)->second == 5 && small[1000] == 5);
+
+    // Clearing and loading empty the table; copies get an empty one of the same size
+    small.clear();
+    CHECK(small.find(1000) == small.end() && small.lookupCacheSlots() == 4);
+    AVLTree<int, int> copy(tree);
+    CHECK(copy.lookupCacheSlots() == 128 && copy.lookupCacheStats().hits == 0);
+    CHECK(copy.find(3) != copy.end() && copy.find(3) != tree.find(3));
+    copy.remove(3);
+    CHECK(copy.find(3) == copy.end() && tree.find(3)->first == 3);
+    stringstream stream;
+    tree.serialize(stream);
+    copy.deserialize(stream);
+    CHECK(sameItems(copy, all) && copy.find(3)->first == 3);
+
+    // Plain trees with scapegoat rebuilds relink nodes without invalidating slots
+    BinarySearchTree<int, int> plain;
+    plain.setLookupCache(64);
+    plain.setRebuildAlpha(0.6);
+    same = true;
+    for (int i = 0; i < 3000; i++)
+    {
+        plain.insert(make_pair(i, -i));
+        same = same && plain.find(i / 2)->second == -(i / 2);
+    }
+    for (int i = 0; i < 2500; i++)
+    {
+        plain.remove(i);
+        same = same && plain.find(i) == plain.end() && plain.find(2999)->second == -2999;
+    }
+    CHECK(same && plain.size() == 500);
+
+    // Turning it off, and keys that cannot be hashed
+    tree.setLookupCache(0);
+    CHECK(tree.lookupCacheSlots() == 0 && tree.find(3)->first == 3);
+    AVLTree<Unhashed, int> unhashed;
+    CHECK_THROWS(unhashed.setLookupCache(16), std::invalid_argument);
+    unhashed.setLookupCache(0);
+    Unhashed one = { 1 };
+    unhashed.insert(make_pair(one, 1));
+    CHECK(unhashed.find(one) != unhashed.end() && unhashed.lookupCacheSlots() == 0);
+}
+
+int main(int argc, char *argv[])
+{
+    demo();
+
+    testImage();
+    testImageBalances();
+    testStream();
+    testWal();
+    testCompare();
+    testPrefixKey();
+    testStats();
+    testBenchUtil();
+    testMemoryUsage();
+    testTrace();
+    testLatencyHistogram();
+    testExport();
+    testShapeStats();
+    testScapegoat();
+    testRelaxed();
+    testCopyMove();
+    testReclaim();
+    testFindBatch();
+    testMergeJoin();
+    testFinger();
+    testAugmented();
+    testIntervalMap();
+    testMultimap();
+    testOrderedCache();
+    testLookupCache();
+
+    if (failures)
+    {
+        cerr << failures << " check(s) failed" << endl;
+        return 1;
+    }
+    cout << "\nAll checks passed" << endl;
     return 0;
 }
@@ -5,6 +5,32 @@
 #include <exception>
 #include <cstdlib>
 #include <utility>
+#include <functional>
+#include <stdexcept>
+#include <cstdint>
+#include <new>
+#include <typeinfo>
+#include <vector>
+#include "stream_codec.h"
+#include "bst_stats.h"
+#include "bst_memory.h"
+#include "latency_histogram.h"
+
+/**
+ * A comparator that orders any two types with operator<. It is transparent,
+ * so trees using it accept lookup keys of other types (for example a
+ * const char* into a tree of std::string) without building a temporary Key.
+ */
+struct TransparentLess
+{
+    typedef void is_transparent;
+
+    template<typename A, typename B>
+    bool operator()(const A& a, const B& b) const
+    {
+        return a < b;
+    }
+};
 
 /**
  * A templated class for a Node in a search tree.
@@ -186,24 +212,65 @@ void Node<Key, Value>::setValue(const Value& value)
   ---------------------------------------
 */
 
+template <typename Key>
+struct TreeShapeStats; // see bst_shape.h
+
+class NodeReclaimer; // see bst_reclaim.h
+struct LookupCacheStats; // see bst_lookup_cache.h
+template<typename Key, typename Value> struct LookupCache;
+
 /**
 * A templated unbalanced binary search tree.
 */
-template <typename Key, typename Value>
+template <typename Key, typename Value, typename Compare = std::less<Key> >
 class BinarySearchTree
 {
 public:
-    BinarySearchTree(); //TODO
+    typedef Key key_type;
+    typedef Value mapped_type;
+    typedef std::pair<const Key, Value> value_type;
+    typedef Compare key_compare;
+
+    explicit BinarySearchTree(const Compare& comp = Compare()); //TODO
+    BinarySearchTree(const BinarySearchTree& other); // Clones the structure of other into one block of nodes
+    BinarySearchTree(BinarySearchTree&& other); // Takes the nodes of other, leaving it empty (other must be a plain BinarySearchTree)
+    BinarySearchTree& operator=(const BinarySearchTree& other);
+    BinarySearchTree& operator=(BinarySearchTree&& other); // Both trees must be of the same type
     virtual ~BinarySearchTree(); //TODO
+    void swap(BinarySearchTree& other); // Exchanges contents in O(1); both trees must be of the same type
     virtual void insert(const std::pair<const Key, Value>& keyValuePair); //TODO
     virtual void remove(const Key& key); //TODO
+    template<typename K, typename C = Compare, typename = typename C::is_transparent>
+    void remove(const K& key); // Heterogeneous remove, only available with a transparent Compare
     void clear(); //TODO
+    void clearInBackground(); // Empties the tree in O(1), freeing the nodes on another thread (see bst_reclaim.h)
+    void clearInBackground(NodeReclaimer& reclaimer);
     bool isBalanced() const; //TODO
     void print() const;
     bool empty() const;
+    size_t size() const;
+
+    // Opt-in scapegoat balancing (see bst_scapegoat.h): with alpha in (0.5, 1)
+    // an insert deeper than log base 1/alpha of size() rebuilds the subtree
+    // that is out of balance, and removes rebuild the whole tree once it has
+    // shrunk below alpha times its largest size. 0 turns it off (the default).
+    void setRebuildAlpha(double alpha);
+    double rebuildAlpha() const;
+
+    // Streaming in sorted order (see bst_stream.h for the format)
+    template<typename KeyCodec = StreamCodec<Key>, typename ValueCodec = StreamCodec<Value> >
+    void serialize(std::ostream& out) const;
+    template<typename KeyCodec = StreamCodec<Key>, typename ValueCodec = StreamCodec<Value> >
+    void deserialize(std::istream& in);
+    template<typename KeyCodec = StreamCodec<Key>, typename ValueCodec = StreamCodec<Value>, typename Filter>
+    void deserialize(std::istream& in, Filter keep);
 
     template<typename PPKey, typename PPValue>
     friend void prettyPrintBST(BinarySearchTree<PPKey, PPValue> & tree);
+    template<typename IKey, typename IValue, typename ICompare>
+    friend class TreeImage;
+    template<typename EKey, typename EValue, typename ECompare>
+    friend class TreeExporter;
 public:
     /**
     * An internal iterator class for traversing the contents of the BST.
@@ -222,7 +289,9 @@ public:
         iterator& operator++();
 
     protected:
-        friend class BinarySearchTree<Key, Value>;
+        friend class BinarySearchTree<Key, Value, Compare>;
+        template<typename MKey, typename MValue, typename MCompare>
+        friend class AVLMultimap;
         iterator(Node<Key,Value>* ptr);
         Node<Key, Value> *current_;
     };
@@ -231,8 +300,66 @@ public:
     iterator begin() const;
     iterator end() const;
     iterator find(const Key& key) const;
+    iterator lower_bound(const Key& key) const;
+    // Many lookups with their cache misses overlapped (see bst_batch.h)
+    void findBatch(const Key* keys, size_t count, iterator* out) const;
+    void findBatch(const std::vector<Key>& keys, std::vector<iterator>& out) const;
+    // One in-order pass over the tree for a sorted stream of keys (see bst_join.h)
+    template<typename InputIt, typename Matched, typename Unmatched>
+    size_t mergeJoin(InputIt first, InputIt last, Matched matched, Unmatched unmatched) const;
+
+    /**
+    * A remembered position that searches start from, so that lookups near
+    * the previous one cost O(log d) for a distance d (see bst_finger.h)
+    */
+    class finger
+    {
+    public:
+        explicit finger(const BinarySearchTree& tree);
+
+        iterator find(const Key& key);
+        iterator lower_bound(const Key& key);
+        iterator position() const;
+        void reset();
+
+    private:
+        Node<Key, Value>* _seek(const Key& key); // Finds the lower bound of key and moves there
+
+        const BinarySearchTree* tree_;
+        Node<Key, Value>* node_; // Where the last search ended, or null
+    };
     Value& operator[](const Key& key);
     Value const & operator[](const Key& key) const;
+    Compare key_comp() const;
+
+    // Instrumentation counters, only collected when built with -DBST_STATS (see bst_stats.h)
+    static TreeStats stats();
+    static void resetStats();
+
+    // Per-operation latency histograms, only collected when built with -DBST_TIMING (see latency_histogram.h)
+    static TreeTimings timings();
+    static void resetTimings();
+
+    // A small cache of hot key -> node pointers in front of find() and
+    // operator[] (see bst_lookup_cache.h). 0 slots turns it off (the default).
+    void setLookupCache(size_t slots);
+    size_t lookupCacheSlots() const;
+    LookupCacheStats lookupCacheStats() const;
+    void resetLookupCacheStats();
+
+    // Node count, bytes per node and allocator overhead (see bst_memory.h)
+    TreeMemoryUsage memoryUsage() const;
+
+    // Height, depth distribution, path length and imbalance (see bst_shape.h)
+    TreeShapeStats<Key> shapeStats(size_t worstSubtrees = 5) const;
+    TreeShapeStats<Key> sampleShapeStats(size_t paths, uint64_t seed = 1) const;
+
+    // Heterogeneous lookups (e.g. a const char* into std::string keys),
+    // only available when Compare defines is_transparent
+    template<typename K, typename C = Compare, typename = typename C::is_transparent>
+    iterator find(const K& key) const;
+    template<typename K, typename C = Compare, typename = typename C::is_transparent>
+    iterator lower_bound(const K& key) const;
 
 protected:
     // Mandatory helper functions
@@ -245,23 +372,63 @@ protected:
     // Provided helper functions
     virtual void printRoot (Node<Key, Value> *r) const;
     virtual void nodeSwap( Node<Key,Value>* n1, Node<Key,Value>* n2) ;
+    virtual void removeNode(Node<Key, Value>* current); // Unlinks and frees a node found by remove
+    void _eraseNode(Node<Key, Value>* current); // removeNode plus the size, rebuild and lookup cache bookkeeping
+
+    // Node hooks so that bulk loaders can build nodes of the right type
+    virtual Node<Key, Value>* createNode(const Key& key, const Value& value, Node<Key, Value>* parent) const; // Allocates a node of the type stored by this tree
+    virtual int8_t getNodeBalance(const Node<Key, Value>* n) const; // Returns the stored balance of a node (always 0 for a plain BST)
+    virtual void setNodeBalance(Node<Key, Value>* n, int8_t balance) const; // Stores a balance on a node (ignored by a plain BST)
+    virtual size_t getNodeSize() const; // Returns sizeof the node type allocated by createNode
+    virtual Node<Key, Value>* constructNode(void* place, const Key& key, const Value& value, Node<Key, Value>* parent) const; // Builds a node of that type in getNodeSize() bytes at place
+    void destroyNode(Node<Key, Value>* n); // Frees a node, whether it came from createNode or from a slab
+    void _copyFrom(const BinarySearchTree& other); // Copies the comparator, policy and nodes of other into this empty tree
+    void _swapContents(BinarySearchTree& other); // Exchanges nodes, comparators, policies and caches without checking the tree types
+    static void _requireTreeType(const BinarySearchTree& tree, const std::type_info& type); // Throws std::invalid_argument unless tree is exactly of type
+    virtual bool nodesTriviallyDestructible() const; // True if nodes may be freed without running their destructors
+    virtual void augmentSubtree(Node<Key, Value>* root); // Recomputes what nodes cache about their subtrees after a bulk build (nothing for a plain BST)
+    static bool _slabsHoldAllNodes(Node<Key, Value>* root, const std::vector<NodeSlab>& slabs); // True if no node under root came from createNode
+    static void _releaseSubtree(Node<Key, Value>* n, const std::vector<NodeSlab>& slabs, bool trivial); // Frees a detached subtree without recursion
+    static void _releaseNode(Node<Key, Value>* n, const std::vector<NodeSlab>& slabs, bool trivial);
+    template<typename NextNode>
+    Node<Key, Value>* _buildBalanced(size_t n, Node<Key, Value>* parent, NextNode& next, int& height); // Links the next n in-order nodes into a perfectly balanced subtree
+    static void _deleteSubtree(Node<Key, Value>* root); // Frees a detached subtree without touching root_
+    void _rebuildAfterInsert(Node<Key, Value>* node, size_t depth); // Rebuilds the scapegoat above a node inserted too deep
+    void _rebuildAfterRemove(); // Rebuilds the whole tree once it has shrunk enough
+    Node<Key, Value>* _rebuildSubtree(Node<Key, Value>* root); // Relinks a subtree into perfect balance in place
+    static size_t _countSubtree(Node<Key, Value>* root); // Counts the nodes of a subtree without recursion
 
     // Add helper functions here
     static Node<Key, Value>* _rightMost(Node<Key, Value>* current); // Finds the right-most node of the subtree of the given node
     static Node<Key, Value>* _walkUpPred(Node<Key, Value>* current); // Walks up the tree starting at the given node until it finds a right child
     void postOrderClear(Node<Key, Value>* root); // Uses post-order traversal to clear the tree
     Node<Key, Value>* _getSmallestNode(Node<Key, Value>* current) const; // Uses recursion to find the smallest node in the list
-    Node<Key, Value>* _internalFind(Node<Key, Value>* current, const Key& key) const; // Uses recursion to find the a certain node in the list
+    template<typename K>
+    Node<Key, Value>* _internalFind(Node<Key, Value>* current, const K& key) const; // Finds the node equivalent to key, using one comparison per level
+    template<typename K>
+    Node<Key, Value>* _lowerBound(Node<Key, Value>* current, const K& key) const; // Finds the first node not ordered before key
+    template<typename K>
+    Node<Key, Value>* _lowerBoundAfter(Node<Key, Value>* finger, const K& key) const; // Same, starting from a node ordered before key
+    template<typename K>
+    Node<Key, Value>* _lowerBoundBefore(Node<Key, Value>* finger, const K& key) const; // Same, starting from a node not ordered before key
     bool _heightBalanced(const Node<Key, Value>* root) const; // Uses recursion to ensure that the difference of the height of each subtree is not greater than 1
     static Node<Key, Value>* successor(Node<Key, Value>* current);
     static Node<Key, Value>* _leftMost(Node<Key, Value>* current); // Finds the left-most node of the subtree of the given node
     static Node<Key, Value>* _walkUpSucc(Node<Key, Value>* current); // Walks up the tree starting at the given node until it finds a left child
     int _getHeight(const Node<Key, Value>* root) const; // Returns the height of the tree
+    Node<Key, Value>* _cachedFind(const Key& key) const; // internalFind through the lookup cache
+    void _lookupCacheForget(Node<Key, Value>* n); // Drops the cache slot pointing at a node about to be freed
 
 
 protected:
     Node<Key, Value>* root_;
-    // You should not need other data members
+    Compare comp_;
+    size_t size_;           // Number of nodes
+    size_t maxSize_;        // Largest size_ since the last full rebuild
+    double rebuildAlpha_;   // Scapegoat balance factor, 0 when off
+    double rebuildLogBase_; // log(1 / rebuildAlpha_)
+    std::vector<NodeSlab> slabs_; // Blocks of cloned nodes that are still in use
+    LookupCache<Key, Value>* lookupCache_; // Hot-key cache for internalFind, null when off
 };
 
 /*
@@ -273,8 +440,8 @@ Begin implementations for the BinarySearchTree::iterator class.
 /**
 * Explicit constructor that initializes an iterator with a given node pointer.
 */
-template<class Key, class Value>
-BinarySearchTree<Key, Value>::iterator::iterator(Node<Key,Value> *ptr)
+template<class Key, class Value, class Compare>
+BinarySearchTree<Key, Value, Compare>::iterator::iterator(Node<Key,Value> *ptr)
 {
     current_ = ptr;
 }
@@ -282,8 +449,8 @@ BinarySearchTree<Key, Value>::iterator::iterator(Node<Key,Value> *ptr)
 /**
 * A default constructor that initializes the iterator to NULL.
 */
-template<class Key, class Value>
-BinarySearchTree<Key, Value>::iterator::iterator() 
+template<class Key, class Value, class Compare>
+BinarySearchTree<Key, Value, Compare>::iterator::iterator() 
 {
     current_ = nullptr;
 }
@@ -291,9 +458,9 @@ BinarySearchTree<Key, Value>::iterator::iterator()
 /**
 * Provides access to the item.
 */
-template<class Key, class Value>
+template<class Key, class Value, class Compare>
 std::pair<const Key,Value> &
-BinarySearchTree<Key, Value>::iterator::operator*() const
+BinarySearchTree<Key, Value, Compare>::iterator::operator*() const
 {
     return current_->getItem();
 }
@@ -301,9 +468,9 @@ BinarySearchTree<Key, Value>::iterator::operator*() const
 /**
 * Provides access to the address of the item.
 */
-template<class Key, class Value>
+template<class Key, class Value, class Compare>
 std::pair<const Key,Value> *
-BinarySearchTree<Key, Value>::iterator::operator->() const
+BinarySearchTree<Key, Value, Compare>::iterator::operator->() const
 {
     return &(current_->getItem());
 }
@@ -312,10 +479,10 @@ BinarySearchTree<Key, Value>::iterator::operator->() const
 * Checks if 'this' iterator's internals have the same value
 * as 'rhs'
 */
-template<class Key, class Value>
+template<class Key, class Value, class Compare>
 bool
-BinarySearchTree<Key, Value>::iterator::operator==(
-    const BinarySearchTree<Key, Value>::iterator& rhs) const
+BinarySearchTree<Key, Value, Compare>::iterator::operator==(
+    const BinarySearchTree<Key, Value, Compare>::iterator& rhs) const
 {
     return this->current_ == rhs.current_;
 }
@@ -324,10 +491,10 @@ BinarySearchTree<Key, Value>::iterator::operator==(
 * Checks if 'this' iterator's internals have a different value
 * as 'rhs'
 */
-template<class Key, class Value>
+template<class Key, class Value, class Compare>
 bool
-BinarySearchTree<Key, Value>::iterator::operator!=(
-    const BinarySearchTree<Key, Value>::iterator& rhs) const
+BinarySearchTree<Key, Value, Compare>::iterator::operator!=(
+    const BinarySearchTree<Key, Value, Compare>::iterator& rhs) const
 {
     return this->current_ != rhs.current_;
 }
@@ -336,10 +503,11 @@ BinarySearchTree<Key, Value>::iterator::operator!=(
 /**
 * Advances the iterator's location using an in-order sequencing
 */
-template<class Key, class Value>
-typename BinarySearchTree<Key, Value>::iterator&
-BinarySearchTree<Key, Value>::iterator::operator++()
+template<class Key, class Value, class Compare>
+typename BinarySearchTree<Key, Value, Compare>::iterator&
+BinarySearchTree<Key, Value, Compare>::iterator::operator++()
 {
+    BST_TIMED(TREE_TIME_ITERATE);
     this->current_ = successor(this->current_);
 
     return *this;
@@ -359,30 +527,142 @@ Begin implementations for the BinarySearchTree class.
 
 /**
 * Default constructor for a BinarySearchTree, which sets the root to NULL.
+* Keys are ordered by comp, which defaults to std::less<Key>.
 */
-template<class Key, class Value>
-BinarySearchTree<Key, Value>::BinarySearchTree() 
+template<class Key, class Value, class Compare>
+BinarySearchTree<Key, Value, Compare>::BinarySearchTree(const Compare& comp) :
+    root_(nullptr), comp_(comp), size_(0), maxSize_(0), rebuildAlpha_(0), rebuildLogBase_(0), lookupCache_(nullptr)
 {
-    root_ = nullptr;
+
 }
 
-template<typename Key, typename Value>
-BinarySearchTree<Key, Value>::~BinarySearchTree()
+/**
+* Copy constructor. Clones the shape, items and balances of other in
+* O(n) without comparing keys (see _copyFrom).
+*/
+template<class Key, class Value, class Compare>
+BinarySearchTree<Key, Value, Compare>::BinarySearchTree(const BinarySearchTree& other) :
+    root_(nullptr), comp_(other.comp_), size_(0), maxSize_(0), rebuildAlpha_(0), rebuildLogBase_(0), lookupCache_(nullptr)
+{
+    _copyFrom(other);
+}
+
+/**
+* Move constructor. Takes the nodes of other in O(1), leaving it empty.
+* Throws std::invalid_argument if other is a derived tree, whose nodes
+* this tree could not handle; derived trees move through their own
+* constructors, which take the nodes with _swapContents.
+*/
+template<class Key, class Value, class Compare>
+BinarySearchTree<Key, Value, Compare>::BinarySearchTree(BinarySearchTree&& other) :
+    root_(nullptr), comp_(other.comp_), size_(0), maxSize_(0), rebuildAlpha_(0), rebuildLogBase_(0), lookupCache_(nullptr)
+{
+    _requireTreeType(other, typeid(BinarySearchTree));
+    _swapContents(other);
+}
+
+/**
+* Copy assignment. Clones into this tree, so the nodes are always of
+* this tree's own type.
+*/
+template<class Key, class Value, class Compare>
+BinarySearchTree<Key, Value, Compare>& BinarySearchTree<Key, Value, Compare>::operator=(const BinarySearchTree& other)
+{
+    if (this != &other)
+    {
+        clear();
+        _copyFrom(other);
+    }
+    return *this;
+}
+
+/**
+* Move assignment. Frees the current nodes and takes those of other.
+* Throws std::invalid_argument, changing neither tree, if they are of
+* different types.
+*/
+template<class Key, class Value, class Compare>
+BinarySearchTree<Key, Value, Compare>& BinarySearchTree<Key, Value, Compare>::operator=(BinarySearchTree&& other)
+{
+    if (this != &other)
+    {
+        _requireTreeType(other, typeid(*this));
+        clear();
+        _swapContents(other);
+    }
+    return *this;
+}
+
+template<typename Key, typename Value, typename Compare>
+BinarySearchTree<Key, Value, Compare>::~BinarySearchTree()
 {
     clear();
+    delete lookupCache_;
+}
+
+/**
+* Exchanges the contents, comparators, rebuild policies and lookup caches
+* of two trees. Throws std::invalid_argument if they are of different
+* types, since each would be left with nodes it does not build.
+*/
+template<class Key, class Value, class Compare>
+void BinarySearchTree<Key, Value, Compare>::swap(BinarySearchTree& other)
+{
+    _requireTreeType(other, typeid(*this));
+    _swapContents(other);
+}
+
+/*
+* Helper for swap and the move operations
+*/
+template<class Key, class Value, class Compare>
+void BinarySearchTree<Key, Value, Compare>::_swapContents(BinarySearchTree& other)
+{
+    std::swap(root_, other.root_);
+    std::swap(comp_, other.comp_);
+    std::swap(size_, other.size_);
+    std::swap(maxSize_, other.maxSize_);
+    std::swap(rebuildAlpha_, other.rebuildAlpha_);
+    std::swap(rebuildLogBase_, other.rebuildLogBase_);
+    slabs_.swap(other.slabs_);
+    std::swap(lookupCache_, other.lookupCache_);
+}
+
+/*
+* Helper for swap and the move operations
+*/
+template<class Key, class Value, class Compare>
+void BinarySearchTree<Key, Value, Compare>::_requireTreeType(const BinarySearchTree& tree, const std::type_info& type)
+{
+    if (typeid(tree) != type) throw std::invalid_argument("Cannot move or swap nodes between trees of different types");
+}
+
+template<class Key, class Value, class Compare>
+void swap(BinarySearchTree<Key, Value, Compare>& a, BinarySearchTree<Key, Value, Compare>& b)
+{
+    a.swap(b);
 }
 
 /**
  * Returns true if tree is empty
 */
-template<class Key, class Value>
-bool BinarySearchTree<Key, Value>::empty() const
+template<class Key, class Value, class Compare>
+bool BinarySearchTree<Key, Value, Compare>::empty() const
 {
     return root_ == NULL;
 }
 
-template<typename Key, typename Value>
-void BinarySearchTree<Key, Value>::print() const
+/**
+ * Returns the number of items in the tree
+*/
+template<class Key, class Value, class Compare>
+size_t BinarySearchTree<Key, Value, Compare>::size() const
+{
+    return size_;
+}
+
+template<typename Key, typename Value, typename Compare>
+void BinarySearchTree<Key, Value, Compare>::print() const
 {
     printRoot(root_);
     std::cout << "\n";
@@ -391,22 +671,22 @@ void BinarySearchTree<Key, Value>::print() const
 /**
 * Returns an iterator to the "smallest" item in the tree
 */
-template<class Key, class Value>
-typename BinarySearchTree<Key, Value>::iterator
-BinarySearchTree<Key, Value>::begin() const
+template<class Key, class Value, class Compare>
+typename BinarySearchTree<Key, Value, Compare>::iterator
+BinarySearchTree<Key, Value, Compare>::begin() const
 {
-    BinarySearchTree<Key, Value>::iterator begin(getSmallestNode());
+    BinarySearchTree<Key, Value, Compare>::iterator begin(getSmallestNode());
     return begin;
 }
 
 /**
 * Returns an iterator whose value means INVALID
 */
-template<class Key, class Value>
-typename BinarySearchTree<Key, Value>::iterator
-BinarySearchTree<Key, Value>::end() const
+template<class Key, class Value, class Compare>
+typename BinarySearchTree<Key, Value, Compare>::iterator
+BinarySearchTree<Key, Value, Compare>::end() const
 {
-    BinarySearchTree<Key, Value>::iterator end(NULL);
+    BinarySearchTree<Key, Value, Compare>::iterator end(NULL);
     return end;
 }
 
@@ -414,28 +694,145 @@ BinarySearchTree<Key, Value>::end() const
 * Returns an iterator to the item with the given key, k
 * or the end iterator if k does not exist in the tree
 */
-template<class Key, class Value>
-typename BinarySearchTree<Key, Value>::iterator
-BinarySearchTree<Key, Value>::find(const Key & k) const
+template<class Key, class Value, class Compare>
+typename BinarySearchTree<Key, Value, Compare>::iterator
+BinarySearchTree<Key, Value, Compare>::find(const Key & k) const
 {
+    BST_TIMED(TREE_TIME_FIND);
     Node<Key, Value> *curr = internalFind(k);
-    BinarySearchTree<Key, Value>::iterator it(curr);
+    BinarySearchTree<Key, Value, Compare>::iterator it(curr);
     return it;
 }
 
+/**
+* Heterogeneous version of find, comparing k against keys directly
+* instead of converting it to a Key first
+*/
+template<class Key, class Value, class Compare>
+template<typename K, typename C, typename>
+typename BinarySearchTree<Key, Value, Compare>::iterator
+BinarySearchTree<Key, Value, Compare>::find(const K & k) const
+{
+    BST_TIMED(TREE_TIME_FIND);
+    BinarySearchTree<Key, Value, Compare>::iterator it(_internalFind(root_, k));
+    return it;
+}
+
+/**
+* Returns an iterator to the first item whose key is not less than k,
+* or the end iterator if there is none
+*/
+template<class Key, class Value, class Compare>
+typename BinarySearchTree<Key, Value, Compare>::iterator
+BinarySearchTree<Key, Value, Compare>::lower_bound(const Key & k) const
+{
+    BinarySearchTree<Key, Value, Compare>::iterator it(_lowerBound(root_, k));
+    return it;
+}
+
+/**
+* Heterogeneous version of lower_bound
+*/
+template<class Key, class Value, class Compare>
+template<typename K, typename C, typename>
+typename BinarySearchTree<Key, Value, Compare>::iterator
+BinarySearchTree<Key, Value, Compare>::lower_bound(const K & k) const
+{
+    BinarySearchTree<Key, Value, Compare>::iterator it(_lowerBound(root_, k));
+    return it;
+}
+
+/**
+* Returns a copy of the comparison object used to order the keys
+*/
+template<class Key, class Value, class Compare>
+Compare BinarySearchTree<Key, Value, Compare>::key_comp() const
+{
+    return comp_;
+}
+
+/**
+* Returns a snapshot of the instrumentation counters, summed over all
+* threads and all trees. Every counter is zero unless BST_STATS is defined.
+*/
+template<class Key, class Value, class Compare>
+TreeStats BinarySearchTree<Key, Value, Compare>::stats()
+{
+    return treeStatsSnapshot();
+}
+
+/**
+* Zeroes the instrumentation counters
+*/
+template<class Key, class Value, class Compare>
+void BinarySearchTree<Key, Value, Compare>::resetStats()
+{
+    treeStatsReset();
+}
+
+/**
+* Returns the latency histograms of every find, insert, remove and
+* iterator step, merged over all threads and all trees. They are empty
+* unless BST_TIMING is defined.
+*/
+template<class Key, class Value, class Compare>
+TreeTimings BinarySearchTree<Key, Value, Compare>::timings()
+{
+    return treeTimingsSnapshot();
+}
+
+/**
+* Clears the latency histograms
+*/
+template<class Key, class Value, class Compare>
+void BinarySearchTree<Key, Value, Compare>::resetTimings()
+{
+    treeTimingsReset();
+}
+
+/**
+* Walks the tree and reports how much memory its nodes take, including the
+* allocator's rounding of each node
+*/
+template<class Key, class Value, class Compare>
+TreeMemoryUsage BinarySearchTree<Key, Value, Compare>::memoryUsage() const
+{
+    TreeMemoryUsage usage;
+    usage.nodes = 0;
+    usage.nodeSize = getNodeSize();
+    usage.itemSize = sizeof(std::pair<const Key, Value>);
+    usage.allocatedBytes = 0;
+    usage.treeBytes = sizeof(*this);
+
+    for (Node<Key, Value>* n = getSmallestNode(); n; n = successor(n))
+    {
+        bool inSlab = false;
+        for (size_t i = 0; i < slabs_.size() && !inSlab; i++) inSlab = slabs_[i].contains(n);
+
+        usage.nodes++;
+        if (!inSlab) usage.allocatedBytes += allocationSize(n, usage.nodeSize);
+    }
+    for (size_t i = 0; i < slabs_.size(); i++)
+    {
+        usage.allocatedBytes += allocationSize(slabs_[i].begin, slabs_[i].end - slabs_[i].begin);
+    }
+    usage.requestedBytes = usage.nodes * usage.nodeSize;
+    return usage;
+}
+
 /**
  * @precondition The key exists in the map
  * Returns the value associated with the key
  */
-template<class Key, class Value>
-Value& BinarySearchTree<Key, Value>::operator[](const Key& key)
+template<class Key, class Value, class Compare>
+Value& BinarySearchTree<Key, Value, Compare>::operator[](const Key& key)
 {
     Node<Key, Value> *curr = internalFind(key);
     if(curr == NULL) throw std::out_of_range("Invalid key");
     return curr->getValue();
 }
-template<class Key, class Value>
-Value const & BinarySearchTree<Key, Value>::operator[](const Key& key) const
+template<class Key, class Value, class Compare>
+Value const & BinarySearchTree<Key, Value, Compare>::operator[](const Key& key) const
 {
     Node<Key, Value> *curr = internalFind(key);
     if(curr == NULL) throw std::out_of_range("Invalid key");
@@ -448,44 +845,59 @@ Value const & BinarySearchTree<Key, Value>::operator[](const Key& key) const
 * Recall: If key is already in the tree, you should 
 * overwrite the current value with the updated value.
 */
-template<class Key, class Value>
-void BinarySearchTree<Key, Value>::insert(const std::pair<const Key, Value> &keyValuePair)
+template<class Key, class Value, class Compare>
+void BinarySearchTree<Key, Value, Compare>::insert(const std::pair<const Key, Value> &keyValuePair)
 {
+    BST_TIMED(TREE_TIME_INSERT);
     if (empty()) 
     {
         Node<Key, Value>* newNode = new Node<Key, Value>(keyValuePair.first, keyValuePair.second, nullptr); 
         root_ = newNode;
+        size_ = 1;
+        if (maxSize_ < size_) maxSize_ = size_;
         return;
     }
     else
     {
         Node<Key, Value>* current = root_;
-        Node<Key, Value>* parent;
+        Node<Key, Value>* parent = nullptr;
+        Node<Key, Value>* candidate = nullptr; // Last node whose key is not less than the new key
+        bool goLeft = false;
+        size_t depth = 0;
 
-        // Traverses the tree, comparing values, until it finds an empty spot
+        // Traverses the tree until it finds an empty spot, with one comparison per level
         while(current)
         {
-            if (keyValuePair.first < current->getKey()) 
+            depth++;
+            parent = current;
+            if (comp_(current->getKey(), keyValuePair.first))
             {
-                parent = current;
-                current = current->getLeft();
-            }
-            else if (keyValuePair.first > current->getKey()) 
-            {
-                parent = current;
+                goLeft = false;
                 current = current->getRight();
             }
-            else 
+            else
             {
-                current->setValue(keyValuePair.second);
-                return;
+                candidate = current;
+                goLeft = true;
+                current = current->getLeft();
             }
         }
+        BST_STAT(treeStatsRecordSearch(depth, depth + (candidate ? 1 : 0)));
+
+        // The key is already present exactly when the candidate is not greater than it
+        if (candidate && !comp_(keyValuePair.first, candidate->getKey()))
+        {
+            candidate->setValue(keyValuePair.second);
+            return;
+        }
 
-        // Makes a new node after ensuring that there is no other node with the same key
         Node<Key, Value>* node = new Node<Key, Value>(keyValuePair.first, keyValuePair.second, parent); 
-        if (node->getKey() < parent->getKey()) parent->setLeft(node);
+        if (goLeft) parent->setLeft(node);
         else parent->setRight(node);
+
+        size_++;
+        if (maxSize_ < size_) maxSize_ = size_;
+        if (rebuildAlpha_ > 0) _rebuildAfterInsert(node, depth);
     }
 }
 
@@ -494,13 +906,55 @@ void BinarySearchTree<Key, Value>::insert(const std::pair<const Key, Value> &key
 * Recall: The writeup specifies that if a node has 2 children you
 * should swap with the predecessor and then remove.
 */
-template<typename Key, typename Value>
-void BinarySearchTree<Key, Value>::remove(const Key& key)
+template<typename Key, typename Value, typename Compare>
+void BinarySearchTree<Key, Value, Compare>::remove(const Key& key)
 {
+    BST_TIMED(TREE_TIME_REMOVE);
     if (empty()) return;
 
     Node<Key, Value>* current = internalFind(key);
     if (!current) return;
+
+    _eraseNode(current);
+}
+
+/**
+* Heterogeneous version of remove
+*/
+template<typename Key, typename Value, typename Compare>
+template<typename K, typename C, typename>
+void BinarySearchTree<Key, Value, Compare>::remove(const K& key)
+{
+    BST_TIMED(TREE_TIME_REMOVE);
+    if (empty()) return;
+
+    Node<Key, Value>* current = _internalFind(root_, key);
+    if (!current) return;
+
+    _eraseNode(current);
+}
+
+/*
+* Helper for the remove functions
+* Removes a node that was already found, keeping the size, rebuild policy
+* and lookup cache current
+*/
+template<typename Key, typename Value, typename Compare>
+void BinarySearchTree<Key, Value, Compare>::_eraseNode(Node<Key, Value>* current)
+{
+    if (lookupCache_) _lookupCacheForget(current);
+    removeNode(current);
+    size_--;
+    if (rebuildAlpha_ > 0) _rebuildAfterRemove();
+}
+
+/*
+* Helper for the remove functions
+* Unlinks the given node from the tree and frees it
+*/
+template<typename Key, typename Value, typename Compare>
+void BinarySearchTree<Key, Value, Compare>::removeNode(Node<Key, Value>* current)
+{
     bool isRoot = !current->getParent();
 
     if (current->getLeft() && current->getRight()) // If there are two children, swap with predecessor
@@ -520,7 +974,7 @@ void BinarySearchTree<Key, Value>::remove(const Key& key)
         current->setParent(nullptr);
 
         if (isRoot) root_ = pred;
-        delete current;
+        destroyNode(current);
         current = nullptr;
     }
     else if (current->getLeft()) // If there is only a left child, swap with it
@@ -534,7 +988,7 @@ void BinarySearchTree<Key, Value>::remove(const Key& key)
         if (current->getLeft()) current->getLeft()->setParent(current->getParent());
         if (current->getRight()) current->getRight()->setParent(current->getParent());
 
-        delete current;
+        destroyNode(current);
         current = nullptr;
     }
     else if (current->getRight()) // If there is only a right child, swap with it
@@ -548,7 +1002,16 @@ void BinarySearchTree<Key, Value>::remove(const Key& key)
         if (current->getLeft()) current->getLeft()->setParent(current->getParent());
         if (current->getRight()) current->getRight()->setParent(current->getParent());
 
-        delete current;
+        destroyNode(current);
+        current = nullptr;
+    }
+    else // If there are no children, just unlink it from its parent
+    {
+        if (isRoot) root_ = nullptr;
+        else if (current->getParent()->getLeft() == current) current->getParent()->setLeft(nullptr);
+        else current->getParent()->setRight(nullptr);
+
+        destroyNode(current);
         current = nullptr;
     }
 
@@ -559,8 +1022,8 @@ void BinarySearchTree<Key, Value>::remove(const Key& key)
 /*
 * Finds the node that is before the current one in the ordered list
 */
-template<class Key, class Value>
-Node<Key, Value>* BinarySearchTree<Key, Value>::predecessor(Node<Key, Value>* current)
+template<class Key, class Value, class Compare>
+Node<Key, Value>* BinarySearchTree<Key, Value, Compare>::predecessor(Node<Key, Value>* current)
 {
     if (!current) return nullptr;
 
@@ -573,8 +1036,8 @@ Node<Key, Value>* BinarySearchTree<Key, Value>::predecessor(Node<Key, Value>* cu
 * Helper for the predecessor member function
 * Finds the right-most node of the subtree of the given node
 */
-template<class Key, class Value>
-Node<Key, Value>* BinarySearchTree<Key, Value>::_rightMost(Node<Key, Value>* current)
+template<class Key, class Value, class Compare>
+Node<Key, Value>* BinarySearchTree<Key, Value, Compare>::_rightMost(Node<Key, Value>* current)
 {
     if (!current->getRight()) return current;
     else return _rightMost(current->getRight());
@@ -584,8 +1047,8 @@ Node<Key, Value>* BinarySearchTree<Key, Value>::_rightMost(Node<Key, Value>* cur
 * Helper for the predecessor member function
 * Walks up the tree starting at the given node until it finds a right child
 */
-template<class Key, class Value>
-Node<Key, Value>* BinarySearchTree<Key, Value>::_walkUpPred(Node<Key, Value>* current)
+template<class Key, class Value, class Compare>
+Node<Key, Value>* BinarySearchTree<Key, Value, Compare>::_walkUpPred(Node<Key, Value>* current)
 {
     if (!current->getParent() || !current) return nullptr;
     else if (current->getParent()->getRight() == current) return current;
@@ -596,8 +1059,8 @@ Node<Key, Value>* BinarySearchTree<Key, Value>::_walkUpPred(Node<Key, Value>* cu
 /*
 * Finds the node that is after the current one in the ordered list
 */
-template<class Key, class Value>
-Node<Key, Value>* BinarySearchTree<Key, Value>::successor(Node<Key, Value>* current)
+template<class Key, class Value, class Compare>
+Node<Key, Value>* BinarySearchTree<Key, Value, Compare>::successor(Node<Key, Value>* current)
 {
     if (!current) return nullptr;
 
@@ -609,8 +1072,8 @@ Node<Key, Value>* BinarySearchTree<Key, Value>::successor(Node<Key, Value>* curr
 * Helper for the successpr member function
 * Finds the left-most node of the subtree of the given node
 */
-template<class Key, class Value>
-Node<Key, Value>* BinarySearchTree<Key, Value>::_leftMost(Node<Key, Value>* current)
+template<class Key, class Value, class Compare>
+Node<Key, Value>* BinarySearchTree<Key, Value, Compare>::_leftMost(Node<Key, Value>* current)
 {
     if (!current->getLeft()) return current;
     else return _leftMost(current->getLeft());
@@ -620,8 +1083,8 @@ Node<Key, Value>* BinarySearchTree<Key, Value>::_leftMost(Node<Key, Value>* curr
 * Helper for the successor member function
 * Walks up the tree starting at the given node until it finds a left child
 */
-template<class Key, class Value>
-Node<Key, Value>* BinarySearchTree<Key, Value>::_walkUpSucc(Node<Key, Value>* current)
+template<class Key, class Value, class Compare>
+Node<Key, Value>* BinarySearchTree<Key, Value, Compare>::_walkUpSucc(Node<Key, Value>* current)
 {
     if (!current || !current->getParent()) return nullptr;
     else if (current->getParent()->getLeft() == current) return current->getParent();
@@ -633,25 +1096,35 @@ Node<Key, Value>* BinarySearchTree<Key, Value>::_walkUpSucc(Node<Key, Value>* cu
 * A method to remove all contents of the tree and
 * reset the values in the tree for use again.
 */
-template<typename Key, typename Value>
-void BinarySearchTree<Key, Value>::clear()
+template<typename Key, typename Value, typename Compare>
+void BinarySearchTree<Key, Value, Compare>::clear()
 {
+    if (root_ && nodesTriviallyDestructible() && _slabsHoldAllNodes(root_, slabs_))
+    {
+        // Nothing to destroy node by node
+        for (size_t i = 0; i < slabs_.size(); i++) ::operator delete(slabs_[i].begin);
+        slabs_.clear();
+        root_ = nullptr;
+    }
     postOrderClear(root_);
+    size_ = 0;
+    maxSize_ = 0;
+    if (lookupCache_) lookupCache_->reset();
 }
 
 /*
 * Helper for the clear member function
 * Uses post-order traversal to clear the tree
 */
-template<typename Key, typename Value>
-void BinarySearchTree<Key, Value>::postOrderClear(Node<Key, Value>* root)
+template<typename Key, typename Value, typename Compare>
+void BinarySearchTree<Key, Value, Compare>::postOrderClear(Node<Key, Value>* root)
 {
     if (!root) return;
 
     postOrderClear(root->getLeft());
     postOrderClear(root->getRight());
 
-    delete root;
+    destroyNode(root);
     root = nullptr;
     root_ = nullptr;
 }
@@ -659,8 +1132,8 @@ void BinarySearchTree<Key, Value>::postOrderClear(Node<Key, Value>* root)
 /**
 * A helper function to find the smallest node in the tree.
 */
-template<typename Key, typename Value>
-Node<Key, Value>* BinarySearchTree<Key, Value>::getSmallestNode() const
+template<typename Key, typename Value, typename Compare>
+Node<Key, Value>* BinarySearchTree<Key, Value, Compare>::getSmallestNode() const
 {
     return _getSmallestNode(root_);
 }
@@ -670,8 +1143,8 @@ Node<Key, Value>* BinarySearchTree<Key, Value>::getSmallestNode() const
 * Uses recursion to find the smallest node in the list
 * (Similar to the _leftMost helper function)
 */
-template<typename Key, typename Value>
-Node<Key, Value>* BinarySearchTree<Key, Value>::_getSmallestNode(Node<Key, Value>* current) const
+template<typename Key, typename Value, typename Compare>
+Node<Key, Value>* BinarySearchTree<Key, Value, Compare>::_getSmallestNode(Node<Key, Value>* current) const
 {
     if (!current) return nullptr;
 
@@ -684,31 +1157,57 @@ Node<Key, Value>* BinarySearchTree<Key, Value>::_getSmallestNode(Node<Key, Value
 * return a pointer to it or NULL if no item with that key
 * exists
 */
-template<typename Key, typename Value>
-Node<Key, Value>* BinarySearchTree<Key, Value>::internalFind(const Key& key) const
+template<typename Key, typename Value, typename Compare>
+Node<Key, Value>* BinarySearchTree<Key, Value, Compare>::internalFind(const Key& key) const
 {
+    if (lookupCache_) return _cachedFind(key);
     return _internalFind(root_, key);
 }
 
 /*
 * Helper function for the internalFind function
-* Uses recursion to find the a certain node in the list
+* Finds the lower bound of key and then checks it for equivalence, so each
+* level of the descent costs exactly one comparison
 */
-template<typename Key, typename Value>
-Node<Key, Value>* BinarySearchTree<Key, Value>::_internalFind(Node<Key, Value>* current, const Key& key) const
+template<typename Key, typename Value, typename Compare>
+template<typename K>
+Node<Key, Value>* BinarySearchTree<Key, Value, Compare>::_internalFind(Node<Key, Value>* current, const K& key) const
 {
-    if (!current) return nullptr;
+    Node<Key, Value>* candidate = _lowerBound(current, key);
+    BST_STAT(if (candidate) treeStatsLocal().add(TREE_STAT_COMPARISONS, 1));
+    if (candidate && !comp_(key, candidate->getKey())) return candidate;
+    return nullptr;
+}
 
-    if (current->getKey() == key) return current;
-    else if (current->getKey() < key) return _internalFind(current->getRight(), key);
-    else return _internalFind(current->getLeft(), key);
+/*
+* Helper function for the lower_bound and find functions
+* Finds the first node in the subtree whose key is not less than key
+*/
+template<typename Key, typename Value, typename Compare>
+template<typename K>
+Node<Key, Value>* BinarySearchTree<Key, Value, Compare>::_lowerBound(Node<Key, Value>* current, const K& key) const
+{
+    Node<Key, Value>* candidate = nullptr;
+    BST_STAT(uint64_t depth = 0);
+    while (current)
+    {
+        BST_STAT(depth++);
+        if (comp_(current->getKey(), key)) current = current->getRight();
+        else
+        {
+            candidate = current;
+            current = current->getLeft();
+        }
+    }
+    BST_STAT(treeStatsRecordSearch(depth, depth));
+    return candidate;
 }
 
 /**
  * Return true iff the BST is balanced.
  */
-template<typename Key, typename Value>
-bool BinarySearchTree<Key, Value>::isBalanced() const
+template<typename Key, typename Value, typename Compare>
+bool BinarySearchTree<Key, Value, Compare>::isBalanced() const
 {
     if (empty()) return true;
 
@@ -719,8 +1218,8 @@ bool BinarySearchTree<Key, Value>::isBalanced() const
 * Helper function for the isBalanced member function
 * Uses recursion to ensure that the difference of the height of each subtree is not greater than 1
 */
-template<typename Key, typename Value>
-bool BinarySearchTree<Key, Value>::_heightBalanced(const Node<Key, Value>* root) const
+template<typename Key, typename Value, typename Compare>
+bool BinarySearchTree<Key, Value, Compare>::_heightBalanced(const Node<Key, Value>* root) const
 {
 	if (!root) return 1;
 
@@ -735,8 +1234,8 @@ bool BinarySearchTree<Key, Value>::_heightBalanced(const Node<Key, Value>* root)
 * Helper function for _heightBalanced
 * Finds the height of a given subtree
 */
-template<typename Key, typename Value>
-int BinarySearchTree<Key, Value>::_getHeight(const Node<Key, Value>* root) const
+template<typename Key, typename Value, typename Compare>
+int BinarySearchTree<Key, Value, Compare>::_getHeight(const Node<Key, Value>* root) const
 {
 	if (!root) return 0;
 
@@ -748,8 +1247,8 @@ int BinarySearchTree<Key, Value>::_getHeight(const Node<Key, Value>* root) const
 }
 
 
-template<typename Key, typename Value>
-void BinarySearchTree<Key, Value>::nodeSwap( Node<Key,Value>* n1, Node<Key,Value>* n2)
+template<typename Key, typename Value, typename Compare>
+void BinarySearchTree<Key, Value, Compare>::nodeSwap( Node<Key,Value>* n1, Node<Key,Value>* n2)
 {
     if((n1 == n2) || (n1 == NULL) || (n2 == NULL) ) {
         return;
@@ -832,6 +1331,159 @@ void BinarySearchTree<Key, Value>::nodeSwap( Node<Key,Value>* n1, Node<Key,Value
 
 }
 
+/*
+* Allocates a plain node, derived trees override this to allocate their own node type
+*/
+template<typename Key, typename Value, typename Compare>
+Node<Key, Value>* BinarySearchTree<Key, Value, Compare>::createNode(const Key& key, const Value& value, Node<Key, Value>* parent) const
+{
+    return new Node<Key, Value>(key, value, parent);
+}
+
+/*
+* A plain BST stores no balance information
+*/
+template<typename Key, typename Value, typename Compare>
+int8_t BinarySearchTree<Key, Value, Compare>::getNodeBalance(const Node<Key, Value>* n) const
+{
+    return 0;
+}
+
+/*
+* A plain BST stores no balance information, so this does nothing
+*/
+template<typename Key, typename Value, typename Compare>
+void BinarySearchTree<Key, Value, Compare>::setNodeBalance(Node<Key, Value>* n, int8_t balance) const
+{
+
+}
+
+/*
+* A plain BST allocates plain nodes
+*/
+template<typename Key, typename Value, typename Compare>
+size_t BinarySearchTree<Key, Value, Compare>::getNodeSize() const
+{
+    return sizeof(Node<Key, Value>);
+}
+
+/*
+* A plain BST builds plain nodes
+*/
+template<typename Key, typename Value, typename Compare>
+Node<Key, Value>* BinarySearchTree<Key, Value, Compare>::constructNode(void* place, const Key& key, const Value& value, Node<Key, Value>* parent) const
+{
+    return new (place) Node<Key, Value>(key, value, parent);
+}
+
+/*
+* Deletes a node from createNode, or destroys a cloned node in place and
+* frees its slab along with the slab's last node
+*/
+template<typename Key, typename Value, typename Compare>
+void BinarySearchTree<Key, Value, Compare>::destroyNode(Node<Key, Value>* n)
+{
+    for (size_t i = 0; i < slabs_.size(); i++)
+    {
+        if (!slabs_[i].contains(n)) continue;
+
+        n->~Node<Key, Value>();
+        if (--slabs_[i].live == 0)
+        {
+            ::operator delete(slabs_[i].begin);
+            slabs_.erase(slabs_.begin() + i);
+        }
+        return;
+    }
+    delete n;
+}
+
+/*
+* Helper for the copy constructors and copy assignment
+* Clones other into this empty tree: the whole structure goes into one
+* slab allocated up front, in pre-order so that a node and its left child
+* are neighbours. Walks with an explicit stack, compares no keys and does no
+* rebalancing; balances are copied as they are.
+*/
+template<typename Key, typename Value, typename Compare>
+void BinarySearchTree<Key, Value, Compare>::_copyFrom(const BinarySearchTree& other)
+{
+    comp_ = other.comp_;
+    rebuildAlpha_ = other.rebuildAlpha_;
+    rebuildLogBase_ = other.rebuildLogBase_;
+    setLookupCache(other.lookupCacheSlots());
+    if (!other.root_) return;
+
+    size_t nodeSize = getNodeSize();
+    char* block = static_cast<char*>(::operator new(other.size_ * nodeSize));
+    NodeSlab slab = { block, block + other.size_ * nodeSize, 0 };
+    slabs_.push_back(slab);
+
+    struct Frame
+    {
+        const Node<Key, Value>* source;
+        Node<Key, Value>* parent; // the clone to link the copy under
+        bool left;
+    };
+    std::vector<Frame> stack;
+    Frame top = { other.root_, nullptr, false };
+    stack.push_back(top);
+
+    try
+    {
+        while (!stack.empty())
+        {
+            Frame f = stack.back();
+            stack.pop_back();
+
+            Node<Key, Value>* copy = constructNode(block, f.source->getKey(), f.source->getValue(), f.parent);
+            block += nodeSize;
+            slabs_.back().live++;
+            setNodeBalance(copy, other.getNodeBalance(f.source));
+
+            if (!f.parent) root_ = copy;
+            else if (f.left) f.parent->setLeft(copy);
+            else f.parent->setRight(copy);
+
+            if (f.source->getRight())
+            {
+                Frame right = { f.source->getRight(), copy, false };
+                stack.push_back(right);
+            }
+            if (f.source->getLeft())
+            {
+                Frame left = { f.source->getLeft(), copy, true };
+                stack.push_back(left);
+            }
+        }
+    }
+    catch (...)
+    {
+        // Every node built so far is linked in, so clear() destroys them all
+        bool empty = slabs_.back().live == 0;
+        if (empty)
+        {
+            ::operator delete(slabs_.back().begin);
+            slabs_.pop_back();
+        }
+        clear();
+        throw;
+    }
+
+    size_ = maxSize_ = other.size_;
+    augmentSubtree(root_);
+}
+
+/*
+* Bulk builders (copies, deserialize, image loads, scapegoat rebuilds)
+* call this on what they built. Plain and AVL trees cache nothing.
+*/
+template<typename Key, typename Value, typename Compare>
+void BinarySearchTree<Key, Value, Compare>::augmentSubtree(Node<Key, Value>*)
+{
+
+}
+
 /**
  * Lastly, we are providing you with a print function,
    BinarySearchTree::printRoot().
@@ -846,6 +1498,30 @@ void BinarySearchTree<Key, Value>::nodeSwap( Node<Key,Value>* n1, Node<Key,Value
 // include print function (in its own file because it's fairly long)
 #include "print_bst.h"
 
+// include stream serialization (in its own file for the same reason)
+#include "bst_stream.h"
+
+// include shape analytics (in its own file for the same reason)
+#include "bst_shape.h"
+
+// include the scapegoat rebuild policy (in its own file for the same reason)
+#include "bst_scapegoat.h"
+
+// include background reclamation (in its own file for the same reason)
+#include "bst_reclaim.h"
+
+// include batched lookups (in its own file for the same reason)
+#include "bst_batch.h"
+
+// include the sorted-stream merge join (in its own file for the same reason)
+#include "bst_join.h"
+
+// include finger searches (in its own file for the same reason)
+#include "bst_finger.h"
+
+// include the hot-key lookup cache (in its own file for the same reason)
+#include "bst_lookup_cache.h"
+
 /*
 ---------------------------------------------------
 End implementations for the BinarySearchTree class.
@@ -0,0 +1,103 @@
+#ifndef BST_BATCH_H
+#define BST_BATCH_H
+
+/*
+  Batched lookups
+
+  Each find() is a chain of dependent cache misses: the next node's address
+  is only known once the current one has arrived. findBatch() looks up many
+  keys at once, keeping BST_FIND_BATCH_LANES of them in flight. Every round
+  advances each lookup by one level and prefetches the node it moves to, so
+  by the time a lookup comes round again its node is usually on the way in
+  and the misses of all the lanes overlap. A lane that finishes takes the
+  next key from the batch. On a tree much larger than the last-level cache
+  this gives several times the throughput of a loop of find().
+
+  Results are the same as from find(). Lookups are counted with BST_STATS
+  but not timed with BST_TIMING, which only measures single operations.
+
+    std::vector<int> keys = ...;
+    std::vector<AVLTree<int, int>::iterator> found;
+    tree.findBatch(keys, found);        // found[i] == tree.find(keys[i])
+*/
+
+#if defined(__GNUC__)
+#define BST_PREFETCH(p) __builtin_prefetch(p)
+#else
+#define BST_PREFETCH(p) ((void)0)
+#endif
+
+#define BST_FIND_BATCH_LANES 16
+
+/**
+* Looks up count keys, storing find(keys[i]) in out[i]
+*/
+template<typename Key, typename Value, typename Compare>
+void BinarySearchTree<Key, Value, Compare>::findBatch(const Key* keys, size_t count, iterator* out) const
+{
+    struct Lane
+    {
+        Node<Key, Value>* current;
+        Node<Key, Value>* candidate; // the lower bound so far, as in _lowerBound
+        size_t index;
+        BST_STAT(uint64_t depth;)
+    };
+    Lane lanes[BST_FIND_BATCH_LANES];
+
+    size_t next = 0;
+    size_t active = 0;
+    while (active < BST_FIND_BATCH_LANES && next < count)
+    {
+        Lane lane = { root_, nullptr, next++ };
+        BST_STAT(lane.depth = 0);
+        lanes[active++] = lane;
+    }
+
+    while (active)
+    {
+        for (size_t i = 0; i < active; )
+        {
+            Lane& lane = lanes[i];
+            if (lane.current)
+            {
+                BST_STAT(lane.depth++);
+                if (comp_(lane.current->getKey(), keys[lane.index])) lane.current = lane.current->getRight();
+                else
+                {
+                    lane.candidate = lane.current;
+                    lane.current = lane.current->getLeft();
+                }
+                BST_PREFETCH(lane.current);
+                i++;
+                continue;
+            }
+
+            // This lookup is done: check the lower bound for equivalence
+            Node<Key, Value>* found = lane.candidate;
+            BST_STAT(treeStatsRecordSearch(lane.depth, lane.depth + (found ? 1 : 0)));
+            if (found && comp_(keys[lane.index], found->getKey())) found = nullptr;
+            out[lane.index] = iterator(found);
+
+            if (next < count)
+            {
+                Lane refill = { root_, nullptr, next++ };
+                BST_STAT(refill.depth = 0);
+                lane = refill;
+                i++;
+            }
+            else lane = lanes[--active]; // the last lane moves here and runs next
+        }
+    }
+}
+
+/**
+* Looks up every key, resizing out to hold find(keys[i]) in out[i]
+*/
+template<typename Key, typename Value, typename Compare>
+void BinarySearchTree<Key, Value, Compare>::findBatch(const std::vector<Key>& keys, std::vector<iterator>& out) const
+{
+    out.resize(keys.size());
+    if (!keys.empty()) findBatch(keys.data(), keys.size(), out.data());
+}
+
+#endif
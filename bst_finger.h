@@ -0,0 +1,123 @@
+#ifndef BST_FINGER_H
+#define BST_FINGER_H
+
+/*
+  Finger search
+
+  find() always descends from the root. A finger remembers the node its
+  last search ended on and starts the next search there: it climbs parent
+  links only until the subtree it is in must hold the key, then descends.
+  A key d positions away costs O(log d) instead of O(log n), so cursors
+  that move forward or back a little at a time (time series, scans with
+  look-ups near the current row) mostly stay in cache at the bottom of the
+  tree.
+
+  A finger stays valid across inserts and rebalancing, and across removes
+  of any key but the one it is on; like an iterator, it must be reset()
+  (or not used again) once its node is removed or the tree is cleared.
+
+    AVLTree<long, Sample>::finger cursor(series);
+    for (long t = start; t < end; t += step)
+        if (cursor.find(t) != series.end()) ...
+*/
+
+/**
+* Makes a finger on tree, with no position yet
+*/
+template<typename Key, typename Value, typename Compare>
+BinarySearchTree<Key, Value, Compare>::finger::finger(const BinarySearchTree& tree) :
+    tree_(&tree), node_(nullptr)
+{
+
+}
+
+/**
+* Returns an iterator to the item with the given key, or the end iterator,
+* searching from the finger's position and moving it near the key
+*/
+template<typename Key, typename Value, typename Compare>
+typename BinarySearchTree<Key, Value, Compare>::iterator
+BinarySearchTree<Key, Value, Compare>::finger::find(const Key& key)
+{
+    BST_TIMED(TREE_TIME_FIND);
+    Node<Key, Value>* found = _seek(key);
+    if (found && tree_->comp_(key, found->getKey())) found = nullptr;
+    return iterator(found);
+}
+
+/**
+* Returns an iterator to the first item whose key is not less than key,
+* searching from the finger's position and moving it there
+*/
+template<typename Key, typename Value, typename Compare>
+typename BinarySearchTree<Key, Value, Compare>::iterator
+BinarySearchTree<Key, Value, Compare>::finger::lower_bound(const Key& key)
+{
+    return iterator(_seek(key));
+}
+
+/**
+* Returns an iterator to the node the finger is on (end if none)
+*/
+template<typename Key, typename Value, typename Compare>
+typename BinarySearchTree<Key, Value, Compare>::iterator
+BinarySearchTree<Key, Value, Compare>::finger::position() const
+{
+    return iterator(node_);
+}
+
+/**
+* Forgets the position, so that the next search starts at the root
+*/
+template<typename Key, typename Value, typename Compare>
+void BinarySearchTree<Key, Value, Compare>::finger::reset()
+{
+    node_ = nullptr;
+}
+
+/*
+* Helper for find and lower_bound
+* Finds the lower bound of key from the finger's position and moves there.
+* When every key is before key, the finger stays where it was.
+*/
+template<typename Key, typename Value, typename Compare>
+Node<Key, Value>* BinarySearchTree<Key, Value, Compare>::finger::_seek(const Key& key)
+{
+    Node<Key, Value>* found;
+    if (!node_) found = tree_->_lowerBound(tree_->root_, key);
+    else if (tree_->comp_(node_->getKey(), key)) found = tree_->_lowerBoundAfter(node_, key);
+    else found = tree_->_lowerBoundBefore(node_, key);
+
+    if (found) node_ = found;
+    return found;
+}
+
+/*
+* Helper for finger searches
+* Finds the first node not ordered before key, given a node that is not
+* ordered before it either. Checks the left child first, which settles
+* nearby keys without climbing. Otherwise climbs until it comes up as a right
+* child of a node before key; the subtree it stopped at then holds the answer.
+*/
+template<typename Key, typename Value, typename Compare>
+template<typename K>
+Node<Key, Value>* BinarySearchTree<Key, Value, Compare>::_lowerBoundBefore(Node<Key, Value>* finger, const K& key) const
+{
+    Node<Key, Value>* left = finger->getLeft();
+    if (left && comp_(left->getKey(), key))
+    {
+        Node<Key, Value>* found = _lowerBound(left->getRight(), key);
+        return found ? found : finger;
+    }
+
+    Node<Key, Value>* current = finger;
+    Node<Key, Value>* parent = current->getParent();
+    while (parent && !(parent->getRight() == current && comp_(parent->getKey(), key)))
+    {
+        current = parent;
+        parent = parent->getParent();
+    }
+    return _lowerBound(current, key);
+}
+
+#endif
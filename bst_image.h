@@ -0,0 +1,526 @@
+#ifndef BST_IMAGE_H
+#define BST_IMAGE_H
+
+#include <cstring>
+#include <cstdint>
+#include <functional>
+#include <new>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include <utility>
+#include <vector>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "bst.h"
+#include "avlbst.h"
+
+/*
+  On-disk tree image format (version 1)
+
+  A tree image is a header followed by one fixed-size record per node,
+  stored in pre-order. A node's left child (if any) is always the very
+  next record, and its right child is found rightOffset records further
+  on. Because every link is relative, a mapped file can be searched in
+  place without any deserialization.
+
+  Images use the native byte order and layout of the machine that wrote
+  them, so they are only meant to be reloaded on the same platform.
+
+  Opening an image checks only its header, so that it stays O(1). find()
+  and forEach() never follow a link past the last record, but on an image
+  whose links are damaged they can miss keys. TreeImage::load checks every
+  link as it goes, and MappedTree::verify does the same check without
+  building a tree, for images that do not come from a trusted writer.
+*/
+
+#define TREE_IMAGE_VERSION 1
+#define TREE_IMAGE_BYTE_ORDER 0x01020304u
+#define TREE_IMAGE_FLAG_AVL 0x1u
+
+struct TreeImageHeader
+{
+    char magic[8];          // "BSTIMG\0\0"
+    uint32_t version;       // TREE_IMAGE_VERSION
+    uint32_t byteOrder;     // TREE_IMAGE_BYTE_ORDER as written by the producer
+    uint32_t flags;         // TREE_IMAGE_FLAG_AVL if the balances are meaningful
+    uint32_t keySize;       // sizeof(Key)
+    uint32_t valueSize;     // sizeof(Value)
+    uint32_t recordSize;    // sizeof(TreeImageRecord<Key, Value>)
+    uint64_t nodeCount;
+    uint64_t dataOffset;    // byte offset of the first record
+};
+
+template <typename Key, typename Value>
+struct TreeImageRecord
+{
+    TreeImageRecord(const Key& k, const Value& v, int8_t bal, bool left) :
+        rightOffset(0), balance(bal), hasLeft(left ? 1 : 0), key(k), value(v)
+    {}
+
+    uint64_t rightOffset;   // records from this one to its right child, 0 if there is none
+    int8_t balance;         // AVL balance of the node (AVL_PENDING_BALANCE while a relaxed tree has not repaired it), 0 for a plain BST
+    uint8_t hasLeft;        // 1 if the next record is this node's left child
+    Key key;
+    Value value;
+};
+
+/**
+* A read-only view of a tree image, either mapped from a file or
+* pointing at a caller-owned buffer. Lookups walk the records directly.
+*/
+template <typename Key, typename Value, typename Compare = std::less<Key> >
+class MappedTree
+{
+public:
+    explicit MappedTree(const std::string& path, const Compare& comp = Compare());
+    MappedTree(const void* data, size_t size, const Compare& comp = Compare());
+    ~MappedTree();
+
+    size_t size() const;
+    bool empty() const;
+    bool isAVL() const;
+    bool verify() const;
+    const Value* find(const Key& key) const;
+
+    template<typename Visitor>
+    void forEach(Visitor visit) const;
+
+    const TreeImageRecord<Key, Value>* records() const;
+
+private:
+    MappedTree(const MappedTree&);              // not copyable
+    MappedTree& operator=(const MappedTree&);
+
+    void validate(size_t size);
+
+    const char* data_;
+    size_t mappedSize_; // non-zero only when data_ is our own mapping
+    const TreeImageHeader* header_;
+    const TreeImageRecord<Key, Value>* records_;
+    Compare comp_;
+};
+
+/**
+* Writes trees out as images and loads images back into mutable trees.
+*/
+template <typename Key, typename Value, typename Compare = std::less<Key> >
+class TreeImage
+{
+public:
+    typedef TreeImageRecord<Key, Value> Record;
+
+    static size_t imageSize(size_t nodeCount);
+    static size_t writeTo(const BinarySearchTree<Key, Value, Compare>& tree, void* buffer, size_t bufferSize);
+    static void write(const BinarySearchTree<Key, Value, Compare>& tree, const std::string& path);
+    static void load(const MappedTree<Key, Value, Compare>& image, BinarySearchTree<Key, Value, Compare>& tree);
+
+private:
+    static size_t countNodes(const BinarySearchTree<Key, Value, Compare>& tree);
+    static size_t dataOffset();
+};
+
+/*
+  -----------------------------------------------
+  Begin implementations for the MappedTree class.
+  -----------------------------------------------
+*/
+
+/**
+* Maps the image at path read-only. Throws std::runtime_error if the file
+* cannot be mapped or is not a valid image for this Key/Value pair.
+*/
+template<typename Key, typename Value, typename Compare>
+MappedTree<Key, Value, Compare>::MappedTree(const std::string& path, const Compare& comp) :
+    data_(nullptr), mappedSize_(0), header_(nullptr), records_(nullptr), comp_(comp)
+{
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) throw std::runtime_error("Cannot open tree image " + path);
+
+    struct stat st;
+    if (::fstat(fd, &st) != 0 || st.st_size < (off_t)sizeof(TreeImageHeader))
+    {
+        ::close(fd);
+        throw std::runtime_error("Truncated tree image " + path);
+    }
+
+    void* mapped = ::mmap(nullptr, (size_t)st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if (mapped == MAP_FAILED) throw std::runtime_error("Cannot map tree image " + path);
+
+    data_ = static_cast<const char*>(mapped);
+    mappedSize_ = (size_t)st.st_size;
+    try
+    {
+        validate(mappedSize_);
+    }
+    catch (...)
+    {
+        ::munmap(mapped, mappedSize_);
+        throw;
+    }
+}
+
+/**
+* Wraps an image that already lives in memory. The buffer must outlive the view.
+*/
+template<typename Key, typename Value, typename Compare>
+MappedTree<Key, Value, Compare>::MappedTree(const void* data, size_t size, const Compare& comp) :
+    data_(static_cast<const char*>(data)), mappedSize_(0), header_(nullptr), records_(nullptr), comp_(comp)
+{
+    if (size < sizeof(TreeImageHeader)) throw std::runtime_error("Truncated tree image");
+    validate(size);
+}
+
+template<typename Key, typename Value, typename Compare>
+MappedTree<Key, Value, Compare>::~MappedTree()
+{
+    if (mappedSize_) ::munmap(const_cast<char*>(data_), mappedSize_);
+}
+
+/*
+* Checks that the header matches this Key/Value layout and the records fit in the buffer
+*/
+template<typename Key, typename Value, typename Compare>
+void MappedTree<Key, Value, Compare>::validate(size_t size)
+{
+    header_ = reinterpret_cast<const TreeImageHeader*>(data_);
+    if (std::memcmp(header_->magic, "BSTIMG\0\0", 8) != 0) throw std::runtime_error("Not a tree image");
+    if (header_->version != TREE_IMAGE_VERSION) throw std::runtime_error("Unsupported tree image version");
+    if (header_->byteOrder != TREE_IMAGE_BYTE_ORDER) throw std::runtime_error("Tree image has foreign byte order");
+    if (header_->keySize != sizeof(Key) || header_->valueSize != sizeof(Value) ||
+        header_->recordSize != sizeof(TreeImageRecord<Key, Value>))
+    {
+        throw std::runtime_error("Tree image was written for a different key/value type");
+    }
+    if (header_->dataOffset % alignof(TreeImageRecord<Key, Value>) != 0 || header_->dataOffset > size ||
+        (size - header_->dataOffset) / sizeof(TreeImageRecord<Key, Value>) < header_->nodeCount)
+    {
+        throw std::runtime_error("Truncated tree image");
+    }
+    records_ = reinterpret_cast<const TreeImageRecord<Key, Value>*>(data_ + header_->dataOffset);
+}
+
+template<typename Key, typename Value, typename Compare>
+size_t MappedTree<Key, Value, Compare>::size() const
+{
+    return header_->nodeCount;
+}
+
+template<typename Key, typename Value, typename Compare>
+bool MappedTree<Key, Value, Compare>::empty() const
+{
+    return header_->nodeCount == 0;
+}
+
+/**
+* Returns true if the image was written from an AVLTree
+*/
+template<typename Key, typename Value, typename Compare>
+bool MappedTree<Key, Value, Compare>::isAVL() const
+{
+    return (header_->flags & TREE_IMAGE_FLAG_AVL) != 0;
+}
+
+/**
+* Returns true if the links of the records form one pre-order tree that
+* uses every record exactly once, in O(n) time
+*/
+template<typename Key, typename Value, typename Compare>
+bool MappedTree<Key, Value, Compare>::verify() const
+{
+    uint64_t n = header_->nodeCount;
+    std::vector<uint64_t> pendingRight; // record indices still expected as right children
+
+    for (uint64_t i = 0; i < n; i++)
+    {
+        if (i > 0 && !records_[i - 1].hasLeft)
+        {
+            if (pendingRight.empty() || pendingRight.back() != i) return false;
+            pendingRight.pop_back();
+        }
+
+        uint64_t offset = records_[i].rightOffset;
+        if (offset >= n - i) return false;
+        if (offset) pendingRight.push_back(i + offset);
+    }
+    return pendingRight.empty() && !(n && records_[n - 1].hasLeft);
+}
+
+template<typename Key, typename Value, typename Compare>
+const TreeImageRecord<Key, Value>* MappedTree<Key, Value, Compare>::records() const
+{
+    return records_;
+}
+
+/**
+* Returns a pointer to the value stored with key inside the image,
+* or nullptr if the key is not present
+*/
+template<typename Key, typename Value, typename Compare>
+const Value* MappedTree<Key, Value, Compare>::find(const Key& key) const
+{
+    uint64_t n = header_->nodeCount;
+    uint64_t i = 0;
+    while (i < n)
+    {
+        const TreeImageRecord<Key, Value>& rec = records_[i];
+        if (comp_(key, rec.key))
+        {
+            if (!rec.hasLeft) return nullptr;
+            i += 1;
+        }
+        else if (comp_(rec.key, key))
+        {
+            if (!rec.rightOffset || rec.rightOffset >= n - i) return nullptr;
+            i += rec.rightOffset;
+        }
+        else return &rec.value;
+    }
+    return nullptr;
+}
+
+/**
+* Calls visit(key, value) for every record in ascending key order
+*/
+template<typename Key, typename Value, typename Compare>
+template<typename Visitor>
+void MappedTree<Key, Value, Compare>::forEach(Visitor visit) const
+{
+    uint64_t n = header_->nodeCount;
+    std::vector<uint64_t> pending; // records whose left subtree is being visited
+    uint64_t i = 0;
+    bool descending = n > 0;
+
+    while (descending || !pending.empty())
+    {
+        if (descending)
+        {
+            pending.push_back(i);
+            if (records_[i].hasLeft && i + 1 < n) i += 1;
+            else descending = false;
+        }
+        else
+        {
+            uint64_t top = pending.back();
+            pending.pop_back();
+            const TreeImageRecord<Key, Value>& rec = records_[top];
+            visit(rec.key, rec.value);
+            if (rec.rightOffset && rec.rightOffset < n - top)
+            {
+                i = top + rec.rightOffset;
+                descending = true;
+            }
+        }
+    }
+}
+
+/*
+  ---------------------------------------------
+  End implementations for the MappedTree class.
+  ---------------------------------------------
+*/
+
+/*
+  ----------------------------------------------
+  Begin implementations for the TreeImage class.
+  ----------------------------------------------
+*/
+
+/*
+* Records start at the first suitably aligned offset after the header
+*/
+template<typename Key, typename Value, typename Compare>
+size_t TreeImage<Key, Value, Compare>::dataOffset()
+{
+    size_t align = alignof(Record);
+    return (sizeof(TreeImageHeader) + align - 1) / align * align;
+}
+
+/**
+* Returns the number of bytes needed for an image of nodeCount nodes
+*/
+template<typename Key, typename Value, typename Compare>
+size_t TreeImage<Key, Value, Compare>::imageSize(size_t nodeCount)
+{
+    return dataOffset() + nodeCount * sizeof(Record);
+}
+
+template<typename Key, typename Value, typename Compare>
+size_t TreeImage<Key, Value, Compare>::countNodes(const BinarySearchTree<Key, Value, Compare>& tree)
+{
+    size_t count = 0;
+    for (typename BinarySearchTree<Key, Value, Compare>::iterator it = tree.begin(); it != tree.end(); ++it) count++;
+    return count;
+}
+
+/**
+* Serializes the tree into buffer, which must hold at least
+* imageSize(number of nodes) bytes. Returns the number of bytes used.
+*/
+template<typename Key, typename Value, typename Compare>
+size_t TreeImage<Key, Value, Compare>::writeTo(const BinarySearchTree<Key, Value, Compare>& tree, void* buffer, size_t bufferSize)
+{
+    static_assert(std::is_trivially_copyable<Key>::value && std::is_trivially_copyable<Value>::value,
+                  "Tree images need trivially copyable keys and values");
+
+    size_t count = countNodes(tree);
+    size_t bytes = imageSize(count);
+    if (bufferSize < bytes) throw std::length_error("Buffer too small for tree image");
+
+    char* out = static_cast<char*>(buffer);
+    std::memset(out, 0, dataOffset());
+
+    TreeImageHeader* header = reinterpret_cast<TreeImageHeader*>(out);
+    std::memcpy(header->magic, "BSTIMG\0\0", 8);
+    header->version = TREE_IMAGE_VERSION;
+    header->byteOrder = TREE_IMAGE_BYTE_ORDER;
+    header->flags = dynamic_cast<const AVLTree<Key, Value, Compare>*>(&tree) ? TREE_IMAGE_FLAG_AVL : 0;
+    header->keySize = sizeof(Key);
+    header->valueSize = sizeof(Value);
+    header->recordSize = sizeof(Record);
+    header->nodeCount = count;
+    header->dataOffset = dataOffset();
+
+    Record* records = reinterpret_cast<Record*>(out + dataOffset());
+
+    // Pre-order walk; each stack entry remembers which record is waiting for it as a right child
+    std::vector<std::pair<Node<Key, Value>*, size_t> > stack;
+    if (tree.root_) stack.push_back(std::make_pair(tree.root_, (size_t)-1));
+    size_t i = 0;
+    while (!stack.empty())
+    {
+        Node<Key, Value>* n = stack.back().first;
+        size_t waiting = stack.back().second;
+        stack.pop_back();
+
+        // Zero the slot first so that padding bytes are deterministic
+        std::memset(static_cast<void*>(&records[i]), 0, sizeof(Record));
+        new (&records[i]) Record(n->getKey(), n->getValue(), tree.getNodeBalance(n), n->getLeft() != nullptr);
+        if (waiting != (size_t)-1) records[waiting].rightOffset = i - waiting;
+
+        if (n->getRight()) stack.push_back(std::make_pair(n->getRight(), i));
+        if (n->getLeft()) stack.push_back(std::make_pair(n->getLeft(), (size_t)-1));
+        i++;
+    }
+    return bytes;
+}
+
+/**
+* Writes the tree to path as an image that MappedTree can map directly.
+* Throws std::runtime_error on I/O failure.
+*/
+template<typename Key, typename Value, typename Compare>
+void TreeImage<Key, Value, Compare>::write(const BinarySearchTree<Key, Value, Compare>& tree, const std::string& path)
+{
+    size_t bytes = imageSize(countNodes(tree));
+
+    int fd = ::open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) throw std::runtime_error("Cannot create tree image " + path);
+    if (::ftruncate(fd, (off_t)bytes) != 0)
+    {
+        ::close(fd);
+        throw std::runtime_error("Cannot size tree image " + path);
+    }
+
+    void* mapped = ::mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (mapped == MAP_FAILED)
+    {
+        ::close(fd);
+        throw std::runtime_error("Cannot map tree image " + path);
+    }
+
+    writeTo(tree, mapped, bytes);
+
+    int failed = ::msync(mapped, bytes, MS_SYNC);
+    ::munmap(mapped, bytes);
+    ::close(fd);
+    if (failed) throw std::runtime_error("Cannot flush tree image " + path);
+}
+
+/**
+* Replaces the contents of tree with the image in one linear pass over
+* the records. Balances are restored as stored, so an image written from
+* an AVLTree loads into an AVLTree without any rotations. Nodes a relaxed
+* tree had not repaired yet keep their pending marks, and an image written
+* from a plain tree loads with every node pending; an AVLTree that is not
+* relaxed then repairs them before load returns, O(n log n) at worst.
+* Throws std::runtime_error, leaving tree empty, if a link or balance is damaged.
+*/
+template<typename Key, typename Value, typename Compare>
+void TreeImage<Key, Value, Compare>::load(const MappedTree<Key, Value, Compare>& image, BinarySearchTree<Key, Value, Compare>& tree)
+{
+    tree.clear();
+
+    AVLTree<Key, Value, Compare>* avl = dynamic_cast<AVLTree<Key, Value, Compare>*>(&tree);
+    bool unbalanced = avl && !image.isAVL(); // a plain tree's shape says nothing about AVL balances
+
+    const Record* records = image.records();
+    size_t count = image.size();
+
+    // Nodes that still expect a right child, and the record index of that child
+    std::vector<std::pair<Node<Key, Value>*, size_t> > pendingRight;
+    Node<Key, Value>* prev = nullptr;
+
+    for (size_t i = 0; i < count; i++)
+    {
+        const Record& rec = records[i];
+        Node<Key, Value>* parent = nullptr;
+        bool isLeft = false;
+
+        if (i > 0 && records[i - 1].hasLeft)
+        {
+            parent = prev;
+            isLeft = true;
+        }
+        else if (i > 0)
+        {
+            if (pendingRight.empty() || pendingRight.back().second != i)
+            {
+                tree.clear();
+                throw std::runtime_error("Corrupt tree image");
+            }
+            parent = pendingRight.back().first;
+            pendingRight.pop_back();
+        }
+
+        // Pending nodes must form the top of the tree (see avl_relaxed.h)
+        int8_t balance = unbalanced ? AVL_PENDING_BALANCE : rec.balance;
+        bool badBalance = avl && (balance == AVL_PENDING_BALANCE ?
+            parent && tree.getNodeBalance(parent) != AVL_PENDING_BALANCE : balance < -1 || balance > 1);
+        if (rec.rightOffset >= count - i || badBalance)
+        {
+            tree.clear();
+            throw std::runtime_error("Corrupt tree image");
+        }
+
+        Node<Key, Value>* n = tree.createNode(rec.key, rec.value, parent);
+        tree.setNodeBalance(n, balance);
+        if (!parent) tree.root_ = n;
+        else if (isLeft) parent->setLeft(n);
+        else parent->setRight(n);
+        tree.size_++; // counted as it is linked, so clear() frees a partial tree
+
+        if (rec.rightOffset) pendingRight.push_back(std::make_pair(n, i + rec.rightOffset));
+        prev = n;
+    }
+
+    if (!pendingRight.empty() || (count && records[count - 1].hasLeft))
+    {
+        tree.clear();
+        throw std::runtime_error("Corrupt tree image");
+    }
+    tree.maxSize_ = count;
+    tree.augmentSubtree(tree.root_);
+    if (avl && !avl->relaxed()) avl->rebalanceStep(SIZE_MAX);
+}
+
+/*
+  --------------------------------------------
+  End implementations for the TreeImage class.
+  --------------------------------------------
+*/
+
+#endif
@@ -0,0 +1,82 @@
+#ifndef BST_JOIN_H
+#define BST_JOIN_H
+
+/*
+  Merge join with a sorted key stream
+
+  Probing a tree with m sorted keys through find() costs m full descents,
+  O(m log n). mergeJoin() walks the tree once, in order, keeping a finger
+  on the lower bound of the previous key. The next key is usually at or
+  just after the finger; otherwise the finger climbs parent links only
+  until an ancestor is not before the key, then descends from there. A gap
+  of d nodes costs O(log d), so the whole join costs O(m log(n/m + 1)):
+  O(n + m) when the keys are dense and O(m log n) at worst.
+
+  Keys must be sorted by the tree's comparator (repeats are fine), as for
+  std::set_intersection. Each key produces exactly one callback, in input
+  order: matched(item) with the tree's item, or unmatched(key).
+
+    size_t hits = tree.mergeJoin(keys.begin(), keys.end(),
+        [&](std::pair<const int, Row>& item) { enrich(item.second); },
+        [&](const int& key) { missing.push_back(key); });
+*/
+
+/**
+* Joins the sorted keys in [first, last) against the tree, calling
+* matched(item) or unmatched(key) for each. Returns the number of matches.
+*/
+template<typename Key, typename Value, typename Compare>
+template<typename InputIt, typename Matched, typename Unmatched>
+size_t BinarySearchTree<Key, Value, Compare>::mergeJoin(InputIt first, InputIt last, Matched matched, Unmatched unmatched) const
+{
+    size_t matches = 0;
+    Node<Key, Value>* finger = nullptr; // lower bound of the previous key, null past the end
+    bool started = false;
+    for (; first != last; ++first)
+    {
+        const Key& key = *first;
+        if (!started)
+        {
+            finger = _lowerBound(root_, key);
+            started = true;
+        }
+        else if (finger && comp_(finger->getKey(), key)) finger = _lowerBoundAfter(finger, key);
+
+        if (finger && !comp_(key, finger->getKey()))
+        {
+            matched(finger->getItem());
+            matches++;
+        }
+        else unmatched(key);
+    }
+    return matches;
+}
+
+/*
+* Helper for mergeJoin and finger searches
+* Finds the first node not ordered before key, given a node that is.
+* Checks the right child first, which settles nearby keys without climbing.
+* Otherwise climbs while the parent is still before key; the climb stops at
+* a left child whose parent bounds the answer from above, so it is in the
+* right subtree of where the climb stopped or it is that parent.
+*/
+template<typename Key, typename Value, typename Compare>
+template<typename K>
+Node<Key, Value>* BinarySearchTree<Key, Value, Compare>::_lowerBoundAfter(Node<Key, Value>* finger, const K& key) const
+{
+    Node<Key, Value>* right = finger->getRight();
+    if (right && !comp_(right->getKey(), key)) return _lowerBound(right, key);
+
+    Node<Key, Value>* current = finger;
+    Node<Key, Value>* parent = current->getParent();
+    while (parent && comp_(parent->getKey(), key))
+    {
+        current = parent;
+        parent = parent->getParent();
+    }
+
+    Node<Key, Value>* found = _lowerBound(current->getRight(), key);
+    return found ? found : parent;
+}
+
+#endif
@@ -0,0 +1,200 @@
+#ifndef BST_LOOKUP_CACHE_H
+#define BST_LOOKUP_CACHE_H
+
+/*
+  Hot-key lookup cache
+
+  When a few keys get most of the find() and operator[] calls, each of them
+  still pays a full descent from the root. setLookupCache(slots) puts a
+  direct-mapped table of key -> node pointers in front of those lookups: a
+  key hashes to one slot, and a hit (same hash, equivalent key) returns the
+  node straight away. A miss descends as usual and, if the key is there,
+  takes over the slot. A hit costs one hash and two key comparisons.
+
+  Nodes never change their key: rotations, rebuilds and the predecessor
+  swap in remove relink nodes without copying items between them. So an
+  insert never makes a slot wrong, and a remove only has to drop the slot
+  of the one node it frees. clear() and everything built on it (loads,
+  deserialize) empty the table; copies get an empty table of the same size.
+
+  Keys are hashed with LookupCacheHash<Key>, which uses std::hash when
+  there is one. Specialize it for other key types. Keys that are equivalent
+  under Compare but hash differently (e.g. a case-insensitive Compare) only
+  cost hits, not correctness, since a hit is always checked with Compare.
+
+  With the cache on, lookups write to the table, so concurrent readers of
+  one tree need a lock. Hits, misses and invalidations are counted per tree
+  to help pick the size:
+
+    tree.setLookupCache(256);
+    ...
+    LookupCacheStats s = tree.lookupCacheStats();   // s.hitRate()
+*/
+
+/**
+* Counters of one tree's lookup cache
+*/
+struct LookupCacheStats
+{
+    size_t slots;
+    uint64_t hits;
+    uint64_t misses;
+    uint64_t invalidations; // slots dropped because their node was removed
+
+    double hitRate() const { return hits + misses ? (double)hits / (hits + misses) : 0.0; }
+};
+
+template<typename T>
+struct LookupCacheVoid
+{
+    typedef void type;
+};
+
+/**
+* Hashes keys for the lookup cache. available is false for key types
+* without a std::hash, which then cannot turn the cache on.
+*/
+template<typename Key, typename = void>
+struct LookupCacheHash
+{
+    static const bool available = false;
+    size_t operator()(const Key&) const { return 0; }
+};
+
+template<typename Key>
+struct LookupCacheHash<Key, typename LookupCacheVoid<decltype(std::hash<Key>()(std::declval<const Key&>()))>::type>
+{
+    static const bool available = true;
+    size_t operator()(const Key& key) const { return std::hash<Key>()(key); }
+};
+
+/**
+* The table behind setLookupCache
+*/
+template<typename Key, typename Value>
+struct LookupCache
+{
+    struct Slot
+    {
+        uint64_t hash; // mixed hash of the node's key
+        Node<Key, Value>* node; // null when empty
+    };
+
+    explicit LookupCache(size_t size) : slots(size), mask(size - 1)
+    {
+        reset();
+        stats.slots = size;
+        stats.hits = stats.misses = stats.invalidations = 0;
+    }
+
+    void reset()
+    {
+        for (size_t i = 0; i < slots.size(); i++) slots[i].node = nullptr;
+    }
+
+    /*
+    * Spreads a hash over all 64 bits (std::hash of an integer is often the
+    * integer itself), so that strided keys do not share slots
+    */
+    static uint64_t mix(size_t hash)
+    {
+        return (uint64_t)hash * 0x9E3779B97F4A7C15ull;
+    }
+
+    Slot& slotFor(uint64_t mixed)
+    {
+        return slots[(mixed >> 32) & mask];
+    }
+
+    std::vector<Slot> slots;
+    uint64_t mask;
+    LookupCacheStats stats;
+};
+
+/**
+* Turns the lookup cache on with slots slots (rounded up to a power of two,
+* at most 2^31), resizes it, or turns it off with 0. Resizing empties it
+* and resets its counters.
+* Throws std::invalid_argument if slots is not 0 and Key cannot be hashed.
+*/
+template<typename Key, typename Value, typename Compare>
+void BinarySearchTree<Key, Value, Compare>::setLookupCache(size_t slots)
+{
+    if (slots && !LookupCacheHash<Key>::available) throw std::invalid_argument("Lookup cache needs a LookupCacheHash for the key type");
+
+    delete lookupCache_;
+    lookupCache_ = nullptr;
+    if (slots == 0) return;
+
+    size_t size = 1;
+    while (size < slots && size < ((size_t)1 << 31)) size <<= 1;
+    lookupCache_ = new LookupCache<Key, Value>(size);
+}
+
+template<typename Key, typename Value, typename Compare>
+size_t BinarySearchTree<Key, Value, Compare>::lookupCacheSlots() const
+{
+    return lookupCache_ ? lookupCache_->slots.size() : 0;
+}
+
+/**
+* Returns the counters since the cache was turned on or last reset (all
+* zero when it is off)
+*/
+template<typename Key, typename Value, typename Compare>
+LookupCacheStats BinarySearchTree<Key, Value, Compare>::lookupCacheStats() const
+{
+    if (lookupCache_) return lookupCache_->stats;
+
+    LookupCacheStats none = { 0, 0, 0, 0 };
+    return none;
+}
+
+template<typename Key, typename Value, typename Compare>
+void BinarySearchTree<Key, Value, Compare>::resetLookupCacheStats()
+{
+    if (!lookupCache_) return;
+    lookupCache_->stats.hits = lookupCache_->stats.misses = lookupCache_->stats.invalidations = 0;
+}
+
+/*
+* Helper for internalFind
+* Checks the key's slot before descending, and remembers what a descent found
+*/
+template<typename Key, typename Value, typename Compare>
+Node<Key, Value>* BinarySearchTree<Key, Value, Compare>::_cachedFind(const Key& key) const
+{
+    uint64_t mixed = LookupCache<Key, Value>::mix(LookupCacheHash<Key>()(key));
+    typename LookupCache<Key, Value>::Slot& slot = lookupCache_->slotFor(mixed);
+    Node<Key, Value>* node = slot.node;
+    if (node && slot.hash == mixed && !comp_(key, node->getKey()) && !comp_(node->getKey(), key))
+    {
+        lookupCache_->stats.hits++;
+        return node;
+    }
+
+    lookupCache_->stats.misses++;
+    node = _internalFind(root_, key);
+    if (node)
+    {
+        slot.hash = mixed;
+        slot.node = node;
+    }
+    return node;
+}
+
+/*
+* Helper for _eraseNode
+*/
+template<typename Key, typename Value, typename Compare>
+void BinarySearchTree<Key, Value, Compare>::_lookupCacheForget(Node<Key, Value>* n)
+{
+    uint64_t mixed = LookupCache<Key, Value>::mix(LookupCacheHash<Key>()(n->getKey()));
+    typename LookupCache<Key, Value>::Slot& slot = lookupCache_->slotFor(mixed);
+    if (slot.node != n) return;
+
+    slot.node = nullptr;
+    lookupCache_->stats.invalidations++;
+}
+
+#endif
@@ -0,0 +1,65 @@
+#ifndef BST_MEMORY_H
+#define BST_MEMORY_H
+
+#include <cstddef>
+#include <cstdint>
+#if defined(__GLIBC__) || defined(__linux__)
+#include <malloc.h>
+#define BST_USABLE_SIZE(p) malloc_usable_size(p)
+#elif defined(__APPLE__)
+#include <malloc/malloc.h>
+#define BST_USABLE_SIZE(p) malloc_size(p)
+#endif
+
+/**
+* Where the memory of a tree goes. Only memory the tree itself allocates is
+* counted; heap buffers owned by the keys or values (such as the characters
+* of a long std::string) are not.
+*/
+struct TreeMemoryUsage
+{
+    size_t nodes;          // number of nodes in the tree
+    size_t nodeSize;       // sizeof the node type, including the vptr and padding
+    size_t itemSize;       // sizeof the key/value pair inside each node
+    size_t requestedBytes; // nodes * nodeSize, what the tree asked the allocator for
+    size_t allocatedBytes; // usable bytes the allocator reserved for those nodes (its own block headers are not visible)
+    size_t treeBytes;      // sizeof the BinarySearchTree object itself (members of derived trees are not counted)
+
+    size_t linkBytesPerNode() const { return nodeSize - itemSize; }
+    size_t allocatorOverheadBytes() const { return allocatedBytes - requestedBytes; }
+    double bytesPerNode() const { return nodes ? (double)allocatedBytes / nodes : 0.0; }
+    size_t totalBytes() const { return allocatedBytes + treeBytes; }
+};
+
+/*
+* One block of nodes allocated together by a tree's copy constructor.
+* Its nodes are destroyed in place, and the block is freed with the last one.
+*/
+struct NodeSlab
+{
+    char* begin;
+    char* end;
+    size_t live; // nodes in the block that have not been destroyed yet
+
+    bool contains(const void* p) const
+    {
+        return (uintptr_t)p >= (uintptr_t)begin && (uintptr_t)p < (uintptr_t)end;
+    }
+};
+
+/*
+* Returns the number of bytes the allocator reserved for the block at p,
+* which was requested with the given size. Falls back to the requested size
+* when the platform cannot tell, and assumes operator new allocates with
+* malloc, as the standard library's default one does.
+*/
+inline size_t allocationSize(void* p, size_t requested)
+{
+#ifdef BST_USABLE_SIZE
+    return p ? BST_USABLE_SIZE(p) : 0;
+#else
+    return requested;
+#endif
+}
+
+#endif
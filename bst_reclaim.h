@@ -0,0 +1,276 @@
+#ifndef BST_RECLAIM_H
+#define BST_RECLAIM_H
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+
+/*
+  Background reclamation
+
+  clear() frees every node on the calling thread, which takes seconds for
+  tens of millions of nodes. clearInBackground() instead detaches the root
+  and the node slabs in O(1), leaving the tree empty and ready for use, and
+  hands the detached nodes to a NodeReclaimer. Its worker threads free them
+  without recursion (right rotations flatten each subtree as it goes), and
+  with more than one worker the top levels are peeled off first so that
+  the subtrees below them are freed in parallel.
+
+  Keys and values are destroyed on the worker threads, so their destructors
+  must not depend on the thread that owned the tree.
+
+  When the node type is trivially destructible and every node lives in a
+  slab (a tree made by the copy constructor and not grown since), there is
+  nothing to destroy: clear() and clearInBackground() just free the slabs.
+  That is decided by counting the linked nodes against the slabs' live
+  counts, never from size(), so a tree whose count is off (such as one a
+  failed load left half built) is still freed node by node. The count is a
+  read-only walk, which clearInBackground() makes on the worker.
+
+    tree.clearInBackground();               // shared reclaimer
+    NodeReclaimer reclaimer(4);
+    big.clearInBackground(reclaimer);       // four workers
+    reclaimer.wait();                       // everything freed
+*/
+
+/**
+* A pool of threads that frees detached nodes. The destructor finishes all
+* submitted work before joining the threads.
+*/
+class NodeReclaimer
+{
+public:
+    explicit NodeReclaimer(unsigned threads = 1);
+    ~NodeReclaimer();
+    unsigned threads() const;
+    void submit(std::function<void()> job);
+    void wait(); // Blocks until every submitted job has finished
+
+    static NodeReclaimer& shared(); // Two workers, finished at program exit
+
+    NodeReclaimer(const NodeReclaimer&) = delete;
+    NodeReclaimer& operator=(const NodeReclaimer&) = delete;
+
+private:
+    void _run();
+
+    std::mutex mutex_;
+    std::condition_variable wake_;  // A job was queued or the pool is stopping
+    std::condition_variable idle_;  // A job finished
+    std::deque<std::function<void()> > jobs_;
+    size_t busy_;                   // Jobs being run right now
+    bool stopping_;
+    std::vector<std::thread> workers_;
+};
+
+inline NodeReclaimer::NodeReclaimer(unsigned threads) :
+    busy_(0), stopping_(false)
+{
+    if (threads == 0) threads = 1;
+    for (unsigned i = 0; i < threads; i++) workers_.push_back(std::thread(&NodeReclaimer::_run, this));
+}
+
+inline NodeReclaimer::~NodeReclaimer()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stopping_ = true;
+    }
+    wake_.notify_all();
+    for (size_t i = 0; i < workers_.size(); i++) workers_[i].join();
+}
+
+inline unsigned NodeReclaimer::threads() const
+{
+    return (unsigned)workers_.size();
+}
+
+inline void NodeReclaimer::submit(std::function<void()> job)
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        jobs_.push_back(std::move(job));
+    }
+    wake_.notify_one();
+}
+
+inline void NodeReclaimer::wait()
+{
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (!jobs_.empty() || busy_) idle_.wait(lock);
+}
+
+inline NodeReclaimer& NodeReclaimer::shared()
+{
+    static NodeReclaimer reclaimer(2);
+    return reclaimer;
+}
+
+/*
+* Worker loop: runs jobs until stopped with an empty queue
+*/
+inline void NodeReclaimer::_run()
+{
+    std::unique_lock<std::mutex> lock(mutex_);
+    for (;;)
+    {
+        while (jobs_.empty() && !stopping_) wake_.wait(lock);
+        if (jobs_.empty()) return;
+
+        std::function<void()> job = std::move(jobs_.front());
+        jobs_.pop_front();
+        busy_++;
+        lock.unlock();
+        job();
+        job = nullptr; // drop what the job holds (such as slabs) before reporting idle
+        lock.lock();
+        busy_--;
+        idle_.notify_all();
+    }
+}
+
+/*
+* Slabs detached from a tree, freed once the last job holding them is done
+*/
+struct DetachedSlabs
+{
+    std::vector<NodeSlab> slabs;
+
+    ~DetachedSlabs()
+    {
+        for (size_t i = 0; i < slabs.size(); i++) ::operator delete(slabs[i].begin);
+    }
+};
+
+/**
+* Empties the tree in O(1) and frees its nodes on the shared reclaimer
+*/
+template<typename Key, typename Value, typename Compare>
+void BinarySearchTree<Key, Value, Compare>::clearInBackground()
+{
+    clearInBackground(NodeReclaimer::shared());
+}
+
+/**
+* Empties the tree in O(1) and frees its nodes on the given reclaimer,
+* which must outlive the work
+*/
+template<typename Key, typename Value, typename Compare>
+void BinarySearchTree<Key, Value, Compare>::clearInBackground(NodeReclaimer& reclaimer)
+{
+    Node<Key, Value>* root = root_;
+    bool trivial = nodesTriviallyDestructible();
+    std::shared_ptr<DetachedSlabs> slabs(new DetachedSlabs);
+    slabs->slabs.swap(slabs_);
+    root_ = nullptr;
+    size_ = 0;
+    maxSize_ = 0;
+    if (lookupCache_) lookupCache_->reset();
+
+    if (!root)
+    {
+        if (!slabs->slabs.empty()) reclaimer.submit([slabs]() {});
+        return;
+    }
+
+    NodeReclaimer* pool = &reclaimer;
+    reclaimer.submit([slabs, root, trivial, pool]()
+    {
+        if (trivial && _slabsHoldAllNodes(root, slabs->slabs)) return;
+
+        // Peel the top levels until there is a subtree for each worker to take a few of
+        std::deque<Node<Key, Value>*> subtrees(1, root);
+        size_t wanted = pool->threads() > 1 ? 4 * (size_t)pool->threads() : 1;
+        while (!subtrees.empty() && subtrees.size() < wanted)
+        {
+            Node<Key, Value>* n = subtrees.front();
+            subtrees.pop_front();
+            if (n->getLeft()) subtrees.push_back(n->getLeft());
+            if (n->getRight()) subtrees.push_back(n->getRight());
+            _releaseNode(n, slabs->slabs, trivial);
+        }
+        if (subtrees.empty()) return;
+
+        for (size_t i = 1; i < subtrees.size(); i++)
+        {
+            Node<Key, Value>* subtree = subtrees[i];
+            pool->submit([slabs, subtree, trivial]() { _releaseSubtree(subtree, slabs->slabs, trivial); });
+        }
+        _releaseSubtree(subtrees[0], slabs->slabs, trivial);
+    });
+}
+
+/*
+* A node type can be freed without running destructors when the key and
+* value can. Trees whose nodes carry more than these override this.
+*/
+template<typename Key, typename Value, typename Compare>
+bool BinarySearchTree<Key, Value, Compare>::nodesTriviallyDestructible() const
+{
+    return std::is_trivially_destructible<Key>::value && std::is_trivially_destructible<Value>::value;
+}
+
+/*
+* Helper for clear and clearInBackground
+* True when every node linked under root lives in one of slabs. Every live
+* slab node is linked in the tree, so that holds when the slabs' live
+* counts add up to the nodes the walk finds.
+*/
+template<typename Key, typename Value, typename Compare>
+bool BinarySearchTree<Key, Value, Compare>::_slabsHoldAllNodes(Node<Key, Value>* root, const std::vector<NodeSlab>& slabs)
+{
+    if (slabs.empty()) return false;
+
+    size_t live = 0;
+    for (size_t i = 0; i < slabs.size(); i++) live += slabs[i].live;
+    return live == _countSubtree(root);
+}
+
+/*
+* Helper for clearInBackground
+* Frees a detached subtree in O(1) space: a node with a left child is
+* rotated right, one without is freed and the walk goes on to its right
+*/
+template<typename Key, typename Value, typename Compare>
+void BinarySearchTree<Key, Value, Compare>::_releaseSubtree(Node<Key, Value>* n, const std::vector<NodeSlab>& slabs, bool trivial)
+{
+    while (n)
+    {
+        Node<Key, Value>* left = n->getLeft();
+        if (left)
+        {
+            n->setLeft(left->getRight());
+            left->setRight(n);
+            n = left;
+        }
+        else
+        {
+            Node<Key, Value>* right = n->getRight();
+            _releaseNode(n, slabs, trivial);
+            n = right;
+        }
+    }
+}
+
+/*
+* Helper for clearInBackground
+* Deletes a node from createNode, or destroys a slab node in place (if it
+* needs destroying at all); the slab itself goes with DetachedSlabs
+*/
+template<typename Key, typename Value, typename Compare>
+void BinarySearchTree<Key, Value, Compare>::_releaseNode(Node<Key, Value>* n, const std::vector<NodeSlab>& slabs, bool trivial)
+{
+    for (size_t i = 0; i < slabs.size(); i++)
+    {
+        if (!slabs[i].contains(n)) continue;
+        if (!trivial) n->~Node<Key, Value>();
+        return;
+    }
+    delete n;
+}
+
+#endif
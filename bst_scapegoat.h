@@ -0,0 +1,160 @@
+#ifndef BST_SCAPEGOAT_H
+#define BST_SCAPEGOAT_H
+
+#include <cmath>
+#include <stdexcept>
+
+/*
+  Scapegoat rebuild policy
+
+  A plain BinarySearchTree fed near-sorted keys degenerates into a list.
+  With setRebuildAlpha(alpha) the tree keeps itself alpha-height-balanced
+  the scapegoat way: no balance is stored on the nodes, only the tree's
+  size. When an insert lands deeper than log base 1/alpha of the size, the
+  lowest ancestor whose heavier child holds more than alpha of its nodes
+  (the scapegoat) is flattened into a vine by right rotations and relinked
+  into perfect balance. When removes shrink the tree below alpha times its
+  largest size, the whole tree is rebuilt. Both cost O(log n) amortized per
+  operation; smaller alphas keep the tree shallower but rebuild more often.
+
+    BinarySearchTree<int, int> tree;
+    tree.setRebuildAlpha(0.7);
+*/
+
+/**
+* Sets the scapegoat balance factor, or turns the policy off with 0.
+* Turning it on rebuilds the tree once so that it starts out balanced.
+* Throws std::invalid_argument unless alpha is 0 or in (0.5, 1).
+*/
+template<typename Key, typename Value, typename Compare>
+void BinarySearchTree<Key, Value, Compare>::setRebuildAlpha(double alpha)
+{
+    if (alpha != 0 && !(alpha > 0.5 && alpha < 1)) throw std::invalid_argument("Rebuild alpha must be 0 or in (0.5, 1)");
+
+    bool wasOff = rebuildAlpha_ == 0;
+    rebuildAlpha_ = alpha;
+    rebuildLogBase_ = alpha ? std::log(1 / alpha) : 0;
+    if (alpha && wasOff && root_)
+    {
+        _rebuildSubtree(root_);
+        maxSize_ = size_;
+    }
+}
+
+template<typename Key, typename Value, typename Compare>
+double BinarySearchTree<Key, Value, Compare>::rebuildAlpha() const
+{
+    return rebuildAlpha_;
+}
+
+/*
+* Helper for insert
+* If node (depth levels below the root) is deeper than the policy allows,
+* walks up counting subtree sizes to the first ancestor that is out of
+* alpha-weight balance and rebuilds it
+*/
+template<typename Key, typename Value, typename Compare>
+void BinarySearchTree<Key, Value, Compare>::_rebuildAfterInsert(Node<Key, Value>* node, size_t depth)
+{
+    if ((double)depth <= std::floor(std::log((double)size_) / rebuildLogBase_)) return;
+
+    Node<Key, Value>* child = node;
+    size_t childSize = 1;
+    for (Node<Key, Value>* p = node->getParent(); p; p = p->getParent())
+    {
+        Node<Key, Value>* sibling = p->getLeft() == child ? p->getRight() : p->getLeft();
+        size_t size = childSize + 1 + _countSubtree(sibling);
+        if (childSize > rebuildAlpha_ * size)
+        {
+            _rebuildSubtree(p);
+            return;
+        }
+        child = p;
+        childSize = size;
+    }
+}
+
+/*
+* Helper for remove
+* Rebuilds the whole tree once it has shrunk below alpha of its largest size
+*/
+template<typename Key, typename Value, typename Compare>
+void BinarySearchTree<Key, Value, Compare>::_rebuildAfterRemove()
+{
+    if (size_ >= rebuildAlpha_ * maxSize_) return;
+
+    if (root_) _rebuildSubtree(root_);
+    maxSize_ = size_;
+}
+
+/*
+* Helper for the rebuild functions
+* Flattens the subtree into a right-linked vine by right rotations, then
+* relinks the vine into a perfectly balanced subtree in the same place.
+* Needs no memory beyond the O(log n) stack of _buildBalanced.
+*/
+template<typename Key, typename Value, typename Compare>
+Node<Key, Value>* BinarySearchTree<Key, Value, Compare>::_rebuildSubtree(Node<Key, Value>* root)
+{
+    Node<Key, Value>* parent = root->getParent();
+    bool isLeft = parent && parent->getLeft() == root;
+
+    Node<Key, Value>* head = nullptr;
+    Node<Key, Value>* tail = nullptr;
+    Node<Key, Value>* rest = root;
+    size_t n = 0;
+    while (rest)
+    {
+        Node<Key, Value>* left = rest->getLeft();
+        if (left)
+        {
+            rest->setLeft(left->getRight());
+            left->setRight(rest);
+            rest = left;
+        }
+        else
+        {
+            if (tail) tail->setRight(rest);
+            else head = rest;
+            tail = rest;
+            rest = rest->getRight();
+            n++;
+        }
+    }
+
+    VineNodeReader<Key, Value> reader(head);
+    int height;
+    Node<Key, Value>* rebuilt = _buildBalanced(n, parent, reader, height);
+    if (!parent) root_ = rebuilt;
+    else if (isLeft) parent->setLeft(rebuilt);
+    else parent->setRight(rebuilt);
+    augmentSubtree(rebuilt);
+    return rebuilt;
+}
+
+/*
+* Helper for the rebuild functions
+* Counts a subtree with an in-order walk over the parent links
+*/
+template<typename Key, typename Value, typename Compare>
+size_t BinarySearchTree<Key, Value, Compare>::_countSubtree(Node<Key, Value>* root)
+{
+    size_t count = 0;
+    Node<Key, Value>* n = root;
+    while (n && n->getLeft()) n = n->getLeft();
+    while (n)
+    {
+        count++;
+        if (n->getRight())
+        {
+            n = n->getRight();
+            while (n->getLeft()) n = n->getLeft();
+            continue;
+        }
+        while (n != root && n->getParent()->getRight() == n) n = n->getParent();
+        n = n == root ? nullptr : n->getParent();
+    }
+    return count;
+}
+
+#endif
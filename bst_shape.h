@@ -0,0 +1,239 @@
+#ifndef BST_SHAPE_H
+#define BST_SHAPE_H
+
+#include <cstdlib>
+#include <map>
+#include <random>
+#include <vector>
+
+/*
+  Tree shape analytics
+
+  shapeStats() measures the whole tree in one iterative post-order pass:
+  O(n) time and O(height) extra space, so it is safe on degenerate trees.
+  sampleShapeStats() estimates the node count, leaf count, depth
+  distribution and path length from random root-to-leaf paths (Knuth's
+  estimator: a node reached after choosing between two children at k
+  levels stands for 2^k nodes). It costs O(paths * height) and cannot see
+  subtree heights, so the imbalance figures are left empty.
+*/
+
+/**
+* A subtree whose two sides differ in height, as found by shapeStats()
+*/
+template <typename Key>
+struct TreeImbalance
+{
+    Key key;          // key at the root of the subtree
+    int heightDiff;   // right height minus left height
+    size_t depth;     // depth of the subtree root (the tree root is 1)
+    size_t size;      // nodes in the subtree
+};
+
+/**
+* The shape of a tree. Sampled results are estimates, rounded to whole nodes.
+*/
+template <typename Key>
+struct TreeShapeStats
+{
+    bool sampled;
+    size_t nodes;
+    size_t leaves;
+    size_t height;                      // sampled: the deepest path seen, a lower bound
+    uint64_t internalPathLength;        // sum of the depths of all nodes, the root counting as 1
+    std::vector<size_t> depthHistogram; // depthHistogram[d] = nodes at depth d (index 0 unused)
+    std::map<int, size_t> balanceFactors; // right height minus left height -> nodes (exact mode only)
+    std::vector<TreeImbalance<Key> > worstSubtrees; // most imbalanced first (exact mode only)
+
+    // The mean number of nodes a successful search visits
+    double averageDepth() const { return nodes ? (double)internalPathLength / nodes : 0.0; }
+
+    // How far the average search is from a perfectly balanced tree's (1.0 = optimal)
+    double pathLengthRatio() const;
+};
+
+/*
+* The average depth of a perfectly balanced tree of the same size
+* divided into this tree's average depth
+*/
+template <typename Key>
+double TreeShapeStats<Key>::pathLengthRatio() const
+{
+    if (!nodes) return 1.0;
+    uint64_t optimal = 0;
+    size_t remaining = nodes;
+    size_t level = 1;
+    for (size_t width = 1; remaining; width *= 2, level++)
+    {
+        size_t here = remaining < width ? remaining : width;
+        optimal += (uint64_t)here * level;
+        remaining -= here;
+    }
+    return (double)internalPathLength / optimal;
+}
+
+/*
+* Helper for shapeStats
+* Keeps the given number of most imbalanced subtrees, worst first
+*/
+template <typename Key>
+void _keepWorstSubtree(std::vector<TreeImbalance<Key> >& worst, size_t limit, const TreeImbalance<Key>& candidate)
+{
+    if (limit == 0 || candidate.heightDiff == 0) return;
+
+    size_t pos = worst.size();
+    while (pos > 0)
+    {
+        const TreeImbalance<Key>& other = worst[pos - 1];
+        int a = std::abs(candidate.heightDiff), b = std::abs(other.heightDiff);
+        if (a < b || (a == b && candidate.size <= other.size)) break;
+        pos--;
+    }
+    if (pos >= limit) return;
+    worst.insert(worst.begin() + pos, candidate);
+    if (worst.size() > limit) worst.pop_back();
+}
+
+/**
+* Measures the shape of the whole tree in one pass, keeping the given
+* number of most imbalanced subtrees
+*/
+template<typename Key, typename Value, typename Compare>
+TreeShapeStats<Key> BinarySearchTree<Key, Value, Compare>::shapeStats(size_t worstSubtrees) const
+{
+    TreeShapeStats<Key> stats;
+    stats.sampled = false;
+    stats.nodes = 0;
+    stats.leaves = 0;
+    stats.height = 0;
+    stats.internalPathLength = 0;
+    stats.depthHistogram.push_back(0);
+
+    struct Frame
+    {
+        Node<Key, Value>* node;
+        size_t depth;
+        int stage;          // 0 = not visited, 1 = left side done, 2 = right side done
+        size_t leftHeight;
+        size_t leftSize;
+    };
+
+    std::vector<Frame> stack;
+    size_t childHeight = 0; // height and size of the subtree just finished
+    size_t childSize = 0;
+    if (root_)
+    {
+        Frame top = { root_, 1, 0, 0, 0 };
+        stack.push_back(top);
+    }
+
+    while (!stack.empty())
+    {
+        Frame& f = stack.back();
+        if (f.stage == 0)
+        {
+            stats.nodes++;
+            stats.internalPathLength += f.depth;
+            if (stats.depthHistogram.size() <= f.depth) stats.depthHistogram.resize(f.depth + 1, 0);
+            stats.depthHistogram[f.depth]++;
+
+            f.stage = 1;
+            childHeight = childSize = 0;
+            if (f.node->getLeft())
+            {
+                Frame left = { f.node->getLeft(), f.depth + 1, 0, 0, 0 };
+                stack.push_back(left); // invalidates f
+            }
+        }
+        else if (f.stage == 1)
+        {
+            f.leftHeight = childHeight;
+            f.leftSize = childSize;
+            f.stage = 2;
+            childHeight = childSize = 0;
+            if (f.node->getRight())
+            {
+                Frame right = { f.node->getRight(), f.depth + 1, 0, 0, 0 };
+                stack.push_back(right); // invalidates f
+            }
+        }
+        else
+        {
+            size_t rightHeight = childHeight;
+            int diff = (int)rightHeight - (int)f.leftHeight;
+            TreeImbalance<Key> subtree = { f.node->getKey(), diff, f.depth, f.leftSize + childSize + 1 };
+
+            if (!f.node->getLeft() && !f.node->getRight()) stats.leaves++;
+            stats.balanceFactors[diff]++;
+            _keepWorstSubtree(stats.worstSubtrees, worstSubtrees, subtree);
+
+            childHeight = (rightHeight > f.leftHeight ? rightHeight : f.leftHeight) + 1;
+            childSize = subtree.size;
+            stack.pop_back();
+        }
+    }
+
+    stats.height = stats.depthHistogram.size() - 1;
+    return stats;
+}
+
+/**
+* Estimates the shape of the tree from the given number of random
+* root-to-leaf paths. The result is reproducible for a given seed.
+*/
+template<typename Key, typename Value, typename Compare>
+TreeShapeStats<Key> BinarySearchTree<Key, Value, Compare>::sampleShapeStats(size_t paths, uint64_t seed) const
+{
+    TreeShapeStats<Key> stats;
+    stats.sampled = true;
+    stats.height = 0;
+
+    std::mt19937_64 rng(seed);
+    std::vector<double> levelWeights(1, 0.0);
+    double leaves = 0;
+
+    for (size_t p = 0; p < paths && root_; p++)
+    {
+        Node<Key, Value>* n = root_;
+        double weight = 1;
+        size_t depth = 1;
+        while (n)
+        {
+            if (levelWeights.size() <= depth) levelWeights.resize(depth + 1, 0.0);
+            levelWeights[depth] += weight;
+            if (depth > stats.height) stats.height = depth;
+
+            Node<Key, Value>* left = n->getLeft();
+            Node<Key, Value>* right = n->getRight();
+            if (left && right)
+            {
+                weight *= 2;
+                n = (rng() & 1) ? right : left;
+            }
+            else if (left || right) n = left ? left : right;
+            else
+            {
+                leaves += weight;
+                n = nullptr;
+            }
+            depth++;
+        }
+    }
+
+    double scale = paths ? 1.0 / paths : 0.0;
+    double nodes = 0, pathLength = 0;
+    stats.depthHistogram.resize(levelWeights.size(), 0);
+    for (size_t d = 1; d < levelWeights.size(); d++)
+    {
+        double estimate = levelWeights[d] * scale;
+        stats.depthHistogram[d] = (size_t)(estimate + 0.5);
+        nodes += estimate;
+        pathLength += estimate * d;
+    }
+    stats.nodes = (size_t)(nodes + 0.5);
+    stats.leaves = (size_t)(leaves * scale + 0.5);
+    stats.internalPathLength = (uint64_t)(pathLength + 0.5);
+    return stats;
+}
+
+#endif
@@ -0,0 +1,251 @@
+#ifndef BST_STATS_H
+#define BST_STATS_H
+
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+#include <vector>
+
+/*
+  Hot-path instrumentation for the search trees
+
+  Build with -DBST_STATS to count comparisons, visited nodes, rotations and
+  rebalancing propagation, plus a histogram of search depths. Without it
+  every BST_STAT(...) expands to nothing, so the normal build is unchanged.
+
+  Each thread counts into its own block, written only by that thread, so
+  instrumented trees can still be used from several threads. A snapshot
+  sums all live blocks plus the totals left behind by finished threads.
+  The counters are process-wide: they cover every tree in the program.
+*/
+
+#ifdef BST_STATS
+#define BST_STAT(expr) expr
+#else
+#define BST_STAT(expr)
+#endif
+
+#define BST_STATS_DEPTH_BUCKETS 64 // the last bucket also collects anything deeper
+
+enum TreeStatCounter
+{
+    TREE_STAT_SEARCHES,          // root-to-leaf descents (find, lower_bound, remove, insert)
+    TREE_STAT_COMPARISONS,       // key comparisons made by those descents
+    TREE_STAT_NODES_VISITED,     // nodes touched by those descents
+    TREE_STAT_ROTATE_LEFT,
+    TREE_STAT_ROTATE_RIGHT,
+    TREE_STAT_INSERT_FIXES,      // inserts that needed insertFix
+    TREE_STAT_INSERT_FIX_STEPS,  // levels insertFix climbed in total
+    TREE_STAT_INSERT_FIX_MAX,    // most levels climbed by a single insert
+    TREE_STAT_REMOVE_FIXES,      // removes that needed removeFix
+    TREE_STAT_REMOVE_FIX_STEPS,  // levels removeFix climbed in total
+    TREE_STAT_REMOVE_FIX_MAX,    // most levels climbed by a single remove
+    TREE_STAT_DEPTH_BASE,        // BST_STATS_DEPTH_BUCKETS search depth buckets start here
+    TREE_STAT_COUNT = TREE_STAT_DEPTH_BASE + BST_STATS_DEPTH_BUCKETS
+};
+
+/**
+* A plain snapshot of the counters
+*/
+struct TreeStats
+{
+    uint64_t searches;
+    uint64_t comparisons;
+    uint64_t nodesVisited;
+    uint64_t rotateLeft;
+    uint64_t rotateRight;
+    uint64_t insertFixes;
+    uint64_t insertFixSteps;
+    uint64_t insertFixMaxDepth;
+    uint64_t removeFixes;
+    uint64_t removeFixSteps;
+    uint64_t removeFixMaxDepth;
+    uint64_t depthHistogram[BST_STATS_DEPTH_BUCKETS]; // searches that ended at each depth
+
+    double comparisonsPerSearch() const { return searches ? (double)comparisons / searches : 0.0; }
+};
+
+/*
+* One thread's counters. Only the owning thread writes them, so relaxed
+* load/store pairs are enough and cost the same as plain increments.
+*/
+class TreeStatsBlock
+{
+public:
+    TreeStatsBlock();
+    ~TreeStatsBlock();
+
+    void add(int counter, uint64_t amount)
+    {
+        counters_[counter].store(counters_[counter].load(std::memory_order_relaxed) + amount, std::memory_order_relaxed);
+    }
+
+    void max(int counter, uint64_t value)
+    {
+        if (value > counters_[counter].load(std::memory_order_relaxed)) counters_[counter].store(value, std::memory_order_relaxed);
+    }
+
+    uint64_t get(int counter) const
+    {
+        return counters_[counter].load(std::memory_order_relaxed);
+    }
+
+    void reset()
+    {
+        for (int i = 0; i < TREE_STAT_COUNT; i++) counters_[i].store(0, std::memory_order_relaxed);
+    }
+
+private:
+    std::atomic<uint64_t> counters_[TREE_STAT_COUNT];
+};
+
+/*
+* Registry of live blocks and the totals of threads that have exited
+*/
+struct TreeStatsRegistry
+{
+    std::mutex lock;
+    std::vector<TreeStatsBlock*> blocks;
+    uint64_t retired[TREE_STAT_COUNT];
+
+    TreeStatsRegistry() : retired() {}
+
+    static TreeStatsRegistry& instance()
+    {
+        static TreeStatsRegistry registry;
+        return registry;
+    }
+};
+
+/*
+* Max-type counters combine by taking the maximum instead of summing
+*/
+inline bool treeStatIsMax(int counter)
+{
+    return counter == TREE_STAT_INSERT_FIX_MAX || counter == TREE_STAT_REMOVE_FIX_MAX;
+}
+
+inline TreeStatsBlock::TreeStatsBlock()
+{
+    reset();
+    TreeStatsRegistry& registry = TreeStatsRegistry::instance();
+    std::lock_guard<std::mutex> guard(registry.lock);
+    registry.blocks.push_back(this);
+}
+
+inline TreeStatsBlock::~TreeStatsBlock()
+{
+    TreeStatsRegistry& registry = TreeStatsRegistry::instance();
+    std::lock_guard<std::mutex> guard(registry.lock);
+    for (int i = 0; i < TREE_STAT_COUNT; i++)
+    {
+        if (treeStatIsMax(i)) registry.retired[i] = get(i) > registry.retired[i] ? get(i) : registry.retired[i];
+        else registry.retired[i] += get(i);
+    }
+    for (size_t i = 0; i < registry.blocks.size(); i++)
+    {
+        if (registry.blocks[i] == this)
+        {
+            registry.blocks.erase(registry.blocks.begin() + i);
+            break;
+        }
+    }
+}
+
+/*
+* Returns the calling thread's block, creating it on first use
+*/
+inline TreeStatsBlock& treeStatsLocal()
+{
+    static thread_local TreeStatsBlock block;
+    return block;
+}
+
+/*
+* Records one finished descent of the given depth and comparison count
+*/
+inline void treeStatsRecordSearch(uint64_t depth, uint64_t comparisons)
+{
+    TreeStatsBlock& block = treeStatsLocal();
+    block.add(TREE_STAT_SEARCHES, 1);
+    block.add(TREE_STAT_COMPARISONS, comparisons);
+    block.add(TREE_STAT_NODES_VISITED, depth);
+    block.add(TREE_STAT_DEPTH_BASE + (depth < BST_STATS_DEPTH_BUCKETS ? depth : BST_STATS_DEPTH_BUCKETS - 1), 1);
+}
+
+/*
+* Counts one level climbed by insertFix or removeFix
+*/
+inline void treeStatsFixStep(bool insert)
+{
+    treeStatsLocal().add(insert ? TREE_STAT_INSERT_FIX_STEPS : TREE_STAT_REMOVE_FIX_STEPS, 1);
+}
+
+/*
+* Returns the calling thread's running step count, so that an operation can
+* work out how far its own propagation climbed
+*/
+inline uint64_t treeStatsFixSteps(bool insert)
+{
+    return treeStatsLocal().get(insert ? TREE_STAT_INSERT_FIX_STEPS : TREE_STAT_REMOVE_FIX_STEPS);
+}
+
+/*
+* Records one finished insertFix or removeFix propagation
+*/
+inline void treeStatsRecordFix(bool insert, uint64_t steps)
+{
+    TreeStatsBlock& block = treeStatsLocal();
+    block.add(insert ? TREE_STAT_INSERT_FIXES : TREE_STAT_REMOVE_FIXES, 1);
+    block.max(insert ? TREE_STAT_INSERT_FIX_MAX : TREE_STAT_REMOVE_FIX_MAX, steps);
+}
+
+/**
+* Sums every thread's counters into a snapshot
+*/
+inline TreeStats treeStatsSnapshot()
+{
+    uint64_t totals[TREE_STAT_COUNT];
+    TreeStatsRegistry& registry = TreeStatsRegistry::instance();
+    {
+        std::lock_guard<std::mutex> guard(registry.lock);
+        for (int i = 0; i < TREE_STAT_COUNT; i++) totals[i] = registry.retired[i];
+        for (size_t b = 0; b < registry.blocks.size(); b++)
+        {
+            for (int i = 0; i < TREE_STAT_COUNT; i++)
+            {
+                uint64_t v = registry.blocks[b]->get(i);
+                if (treeStatIsMax(i)) totals[i] = v > totals[i] ? v : totals[i];
+                else totals[i] += v;
+            }
+        }
+    }
+
+    TreeStats stats;
+    stats.searches = totals[TREE_STAT_SEARCHES];
+    stats.comparisons = totals[TREE_STAT_COMPARISONS];
+    stats.nodesVisited = totals[TREE_STAT_NODES_VISITED];
+    stats.rotateLeft = totals[TREE_STAT_ROTATE_LEFT];
+    stats.rotateRight = totals[TREE_STAT_ROTATE_RIGHT];
+    stats.insertFixes = totals[TREE_STAT_INSERT_FIXES];
+    stats.insertFixSteps = totals[TREE_STAT_INSERT_FIX_STEPS];
+    stats.insertFixMaxDepth = totals[TREE_STAT_INSERT_FIX_MAX];
+    stats.removeFixes = totals[TREE_STAT_REMOVE_FIXES];
+    stats.removeFixSteps = totals[TREE_STAT_REMOVE_FIX_STEPS];
+    stats.removeFixMaxDepth = totals[TREE_STAT_REMOVE_FIX_MAX];
+    for (int i = 0; i < BST_STATS_DEPTH_BUCKETS; i++) stats.depthHistogram[i] = totals[TREE_STAT_DEPTH_BASE + i];
+    return stats;
+}
+
+/**
+* Zeroes every thread's counters. Counts made concurrently may be lost.
+*/
+inline void treeStatsReset()
+{
+    TreeStatsRegistry& registry = TreeStatsRegistry::instance();
+    std::lock_guard<std::mutex> guard(registry.lock);
+    for (int i = 0; i < TREE_STAT_COUNT; i++) registry.retired[i] = 0;
+    for (size_t b = 0; b < registry.blocks.size(); b++) registry.blocks[b]->reset();
+}
+
+#endif
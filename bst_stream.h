@@ -0,0 +1,252 @@
+#ifndef BST_STREAM_H
+#define BST_STREAM_H
+
+#include <algorithm>
+#include <istream>
+#include <ostream>
+#include <stdexcept>
+
+/*
+  Tree stream format (version 1)
+
+    "BSTS"               4 bytes
+    version              uint32_t
+    count                uint64_t
+    count records        KeyCodec::write(key) then ValueCodec::write(value),
+                         in strictly increasing key order
+
+  Because the records arrive sorted and the count is known up front, a
+  reader can link them into a perfectly balanced tree as they arrive,
+  holding only the current root-to-leaf path besides the tree itself.
+*/
+
+#define BST_STREAM_VERSION 1
+
+/*
+* Supplies freshly read nodes to _buildBalanced, checking that the keys really are sorted
+*/
+template<typename Key, typename Value, typename Compare, typename KeyCodec, typename ValueCodec>
+class StreamNodeReader
+{
+public:
+    StreamNodeReader(const BinarySearchTree<Key, Value, Compare>& tree, std::istream& in, Node<Key, Value>* (BinarySearchTree<Key, Value, Compare>::*create)(const Key&, const Value&, Node<Key, Value>*) const) :
+        tree_(tree), in_(in), create_(create), prev_(nullptr)
+    {}
+
+    Node<Key, Value>* operator()()
+    {
+        Key key = KeyCodec::read(in_);
+        Value value = ValueCodec::read(in_);
+        if (prev_ && !tree_.key_comp()(prev_->getKey(), key)) throw std::runtime_error("Tree stream is not sorted");
+        prev_ = (tree_.*create_)(key, value, nullptr);
+        return prev_;
+    }
+
+private:
+    const BinarySearchTree<Key, Value, Compare>& tree_;
+    std::istream& in_;
+    Node<Key, Value>* (BinarySearchTree<Key, Value, Compare>::*create_)(const Key&, const Value&, Node<Key, Value>*) const;
+    Node<Key, Value>* prev_;
+};
+
+/*
+* Supplies the nodes of a right-linked vine to _buildBalanced, in order
+*/
+template<typename Key, typename Value>
+class VineNodeReader
+{
+public:
+    explicit VineNodeReader(Node<Key, Value>* head) : current_(head) {}
+
+    Node<Key, Value>* operator()()
+    {
+        Node<Key, Value>* n = current_;
+        current_ = current_->getRight();
+        return n;
+    }
+
+private:
+    Node<Key, Value>* current_;
+};
+
+/**
+* Writes every item to out in sorted order. The caller is responsible for
+* checking the stream state afterwards.
+*/
+template<typename Key, typename Value, typename Compare>
+template<typename KeyCodec, typename ValueCodec>
+void BinarySearchTree<Key, Value, Compare>::serialize(std::ostream& out) const
+{
+    uint64_t count = 0;
+    for (iterator it = begin(); it != end(); ++it) count++;
+
+    uint32_t version = BST_STREAM_VERSION;
+    out.write("BSTS", 4);
+    out.write(reinterpret_cast<const char*>(&version), sizeof(version));
+    out.write(reinterpret_cast<const char*>(&count), sizeof(count));
+
+    for (iterator it = begin(); it != end() && out; ++it)
+    {
+        KeyCodec::write(out, it->first);
+        ValueCodec::write(out, it->second);
+    }
+}
+
+/*
+* Reads and checks the stream header, returning the record count
+*/
+inline uint64_t readTreeStreamHeader(std::istream& in)
+{
+    char magic[4];
+    uint32_t version;
+    uint64_t count;
+    readStreamBytes(in, magic, sizeof(magic));
+    readStreamBytes(in, &version, sizeof(version));
+    readStreamBytes(in, &count, sizeof(count));
+    if (magic[0] != 'B' || magic[1] != 'S' || magic[2] != 'T' || magic[3] != 'S') throw std::runtime_error("Not a tree stream");
+    if (version != BST_STREAM_VERSION) throw std::runtime_error("Unsupported tree stream version");
+    return count;
+}
+
+/**
+* Replaces the contents of the tree with a stream written by serialize().
+* Nodes are linked into a perfectly balanced shape as they are read.
+* Throws std::runtime_error (leaving the tree empty) on a malformed stream.
+*/
+template<typename Key, typename Value, typename Compare>
+template<typename KeyCodec, typename ValueCodec>
+void BinarySearchTree<Key, Value, Compare>::deserialize(std::istream& in)
+{
+    clear();
+
+    uint64_t count = readTreeStreamHeader(in);
+    StreamNodeReader<Key, Value, Compare, KeyCodec, ValueCodec> reader(*this, in, &BinarySearchTree<Key, Value, Compare>::createNode);
+    int height;
+    root_ = _buildBalanced((size_t)count, nullptr, reader, height);
+    size_ = maxSize_ = (size_t)count;
+    augmentSubtree(root_);
+}
+
+/**
+* Like deserialize(), but keeps only the items whose key satisfies keep(key).
+* Kept nodes are strung into a vine as they arrive and then relinked into a
+* perfectly balanced tree, so memory use is bounded by the kept items and
+* never by the size of the stream.
+*/
+template<typename Key, typename Value, typename Compare>
+template<typename KeyCodec, typename ValueCodec, typename Filter>
+void BinarySearchTree<Key, Value, Compare>::deserialize(std::istream& in, Filter keep)
+{
+    clear();
+
+    uint64_t count = readTreeStreamHeader(in);
+    Node<Key, Value>* head = nullptr;
+    Node<Key, Value>* tail = nullptr;
+    size_t kept = 0;
+
+    try
+    {
+        for (uint64_t i = 0; i < count; i++)
+        {
+            Key key = KeyCodec::read(in);
+            Value value = ValueCodec::read(in);
+            if (tail && !comp_(tail->getKey(), key)) throw std::runtime_error("Tree stream is not sorted");
+            if (!keep(key)) continue;
+
+            Node<Key, Value>* n = createNode(key, value, nullptr);
+            if (tail) tail->setRight(n);
+            else head = n;
+            tail = n;
+            kept++;
+        }
+    }
+    catch (...)
+    {
+        _deleteSubtree(head);
+        throw;
+    }
+
+    VineNodeReader<Key, Value> reader(head);
+    int height;
+    root_ = _buildBalanced(kept, nullptr, reader, height);
+    size_ = maxSize_ = kept;
+    augmentSubtree(root_);
+}
+
+/*
+* Helper for the deserialize functions
+* Takes the next n nodes from next() (in key order) and links them into a
+* perfectly balanced subtree under parent, setting balances on the way.
+* If next() throws, everything taken so far is freed before rethrowing.
+*/
+template<typename Key, typename Value, typename Compare>
+template<typename NextNode>
+Node<Key, Value>* BinarySearchTree<Key, Value, Compare>::_buildBalanced(size_t n, Node<Key, Value>* parent, NextNode& next, int& height)
+{
+    if (n == 0)
+    {
+        height = 0;
+        return nullptr;
+    }
+
+    size_t leftCount = (n - 1) / 2;
+    int leftHeight, rightHeight;
+    Node<Key, Value>* left = _buildBalanced(leftCount, nullptr, next, leftHeight);
+
+    Node<Key, Value>* root;
+    try
+    {
+        root = next();
+    }
+    catch (...)
+    {
+        _deleteSubtree(left);
+        throw;
+    }
+
+    root->setParent(parent);
+    root->setLeft(left);
+    root->setRight(nullptr);
+    if (left) left->setParent(root);
+
+    try
+    {
+        root->setRight(_buildBalanced(n - 1 - leftCount, root, next, rightHeight));
+    }
+    catch (...)
+    {
+        _deleteSubtree(root);
+        throw;
+    }
+
+    setNodeBalance(root, (int8_t)(rightHeight - leftHeight));
+    height = std::max(leftHeight, rightHeight) + 1;
+    return root;
+}
+
+/*
+* Frees every node of a detached subtree (or right-linked vine)
+* Rotates left children up instead of recursing, so it needs no stack
+*/
+template<typename Key, typename Value, typename Compare>
+void BinarySearchTree<Key, Value, Compare>::_deleteSubtree(Node<Key, Value>* root)
+{
+    while (root)
+    {
+        Node<Key, Value>* left = root->getLeft();
+        if (left)
+        {
+            root->setLeft(left->getRight());
+            left->setRight(root);
+            root = left;
+        }
+        else
+        {
+            Node<Key, Value>* right = root->getRight();
+            delete root;
+            root = right;
+        }
+    }
+}
+
+#endif
@@ -0,0 +1,200 @@
+#ifndef BST_TRACE_H
+#define BST_TRACE_H
+
+#include <cstdint>
+#include <istream>
+#include <ostream>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+#include "stream_codec.h"
+
+/*
+  Workload traces (version 1)
+
+    "BSTT"               4 bytes
+    version              uint32_t
+    records until EOF    one op byte, KeyCodec::write(key), and for
+                         inserts ValueCodec::write(value)
+
+  TracingTree records the operations made on a tree so that trace-replay
+  can run the same sequence against another container offline. A trace
+  cut short by a crash is still readable up to its last whole record.
+*/
+
+#define BST_TRACE_VERSION 1
+
+enum TraceOp
+{
+    TRACE_INSERT = 'I',
+    TRACE_REMOVE = 'R',
+    TRACE_FIND = 'F',
+    TRACE_ACCESS = 'A' // operator[]
+};
+
+/**
+* One recorded operation. value is only meaningful for inserts.
+*/
+template <typename Key, typename Value>
+struct TraceRecord
+{
+    char op;
+    Key key;
+    Value value;
+};
+
+/*
+* Writes the trace header
+*/
+inline void writeTraceHeader(std::ostream& out)
+{
+    uint32_t version = BST_TRACE_VERSION;
+    out.write("BSTT", 4);
+    out.write(reinterpret_cast<const char*>(&version), sizeof(version));
+}
+
+/**
+* Reads a whole trace into memory, so that replaying it does not time the
+* I/O. Throws std::runtime_error if the header is wrong.
+*/
+template <typename Key, typename Value, typename KeyCodec = StreamCodec<Key>, typename ValueCodec = StreamCodec<Value> >
+std::vector<TraceRecord<Key, Value> > readTrace(std::istream& in)
+{
+    char magic[4];
+    uint32_t version;
+    readStreamBytes(in, magic, sizeof(magic));
+    readStreamBytes(in, &version, sizeof(version));
+    if (magic[0] != 'B' || magic[1] != 'S' || magic[2] != 'T' || magic[3] != 'T') throw std::runtime_error("Not a tree trace");
+    if (version != BST_TRACE_VERSION) throw std::runtime_error("Unsupported tree trace version");
+
+    std::vector<TraceRecord<Key, Value> > records;
+    char op;
+    while (in.get(op))
+    {
+        TraceRecord<Key, Value> record;
+        record.op = op;
+        try
+        {
+            record.key = KeyCodec::read(in);
+            if (op == TRACE_INSERT) record.value = ValueCodec::read(in);
+        }
+        catch (const std::runtime_error&)
+        {
+            break; // A torn final record
+        }
+        if (op != TRACE_INSERT && op != TRACE_REMOVE && op != TRACE_FIND && op != TRACE_ACCESS) throw std::runtime_error("Corrupt tree trace");
+        records.push_back(record);
+    }
+    return records;
+}
+
+/**
+* A tree that can record its insert, remove, find and operator[] calls to
+* a trace. Recording is off until startTrace() is called.
+*
+* Only calls made through the TracingTree itself are seen: find and
+* operator[] are not virtual, so calls through a base class reference
+* bypass the recorder.
+*/
+template <typename Tree, typename KeyCodec = StreamCodec<typename Tree::key_type>, typename ValueCodec = StreamCodec<typename Tree::mapped_type> >
+class TracingTree : public Tree
+{
+public:
+    typedef typename Tree::key_type Key;
+    typedef typename Tree::mapped_type Value;
+    typedef typename Tree::iterator iterator;
+
+    TracingTree() : out_(nullptr) {}
+
+    void startTrace(std::ostream& out); // Writes a header to out and records every following call there
+    void stopTrace();                   // Stops recording; the caller owns and flushes the stream
+    bool tracing() const { return out_ != nullptr; }
+
+    virtual void insert(const std::pair<const Key, Value>& keyValuePair) override;
+    virtual void remove(const Key& key) override;
+    iterator find(const Key& key) const;
+    Value& operator[](const Key& key);
+    Value const & operator[](const Key& key) const;
+
+protected:
+    void record(char op, const Key& key) const;
+
+    std::ostream* out_;
+};
+
+/*
+  ------------------------------------------------
+  Begin implementations for the TracingTree class.
+  ------------------------------------------------
+*/
+
+template<typename Tree, typename KeyCodec, typename ValueCodec>
+void TracingTree<Tree, KeyCodec, ValueCodec>::startTrace(std::ostream& out)
+{
+    writeTraceHeader(out);
+    out_ = &out;
+}
+
+template<typename Tree, typename KeyCodec, typename ValueCodec>
+void TracingTree<Tree, KeyCodec, ValueCodec>::stopTrace()
+{
+    out_ = nullptr;
+}
+
+/*
+* Writes the op byte and key of one call when recording
+*/
+template<typename Tree, typename KeyCodec, typename ValueCodec>
+void TracingTree<Tree, KeyCodec, ValueCodec>::record(char op, const Key& key) const
+{
+    if (!out_) return;
+    out_->put(op);
+    KeyCodec::write(*out_, key);
+}
+
+template<typename Tree, typename KeyCodec, typename ValueCodec>
+void TracingTree<Tree, KeyCodec, ValueCodec>::insert(const std::pair<const Key, Value>& keyValuePair)
+{
+    record(TRACE_INSERT, keyValuePair.first);
+    if (out_) ValueCodec::write(*out_, keyValuePair.second);
+    Tree::insert(keyValuePair);
+}
+
+template<typename Tree, typename KeyCodec, typename ValueCodec>
+void TracingTree<Tree, KeyCodec, ValueCodec>::remove(const Key& key)
+{
+    record(TRACE_REMOVE, key);
+    Tree::remove(key);
+}
+
+template<typename Tree, typename KeyCodec, typename ValueCodec>
+typename TracingTree<Tree, KeyCodec, ValueCodec>::iterator
+TracingTree<Tree, KeyCodec, ValueCodec>::find(const Key& key) const
+{
+    record(TRACE_FIND, key);
+    return Tree::find(key);
+}
+
+template<typename Tree, typename KeyCodec, typename ValueCodec>
+typename TracingTree<Tree, KeyCodec, ValueCodec>::Value&
+TracingTree<Tree, KeyCodec, ValueCodec>::operator[](const Key& key)
+{
+    record(TRACE_ACCESS, key);
+    return Tree::operator[](key);
+}
+
+template<typename Tree, typename KeyCodec, typename ValueCodec>
+typename TracingTree<Tree, KeyCodec, ValueCodec>::Value const &
+TracingTree<Tree, KeyCodec, ValueCodec>::operator[](const Key& key) const
+{
+    record(TRACE_ACCESS, key);
+    return Tree::operator[](key);
+}
+
+/*
+  ----------------------------------------------
+  End implementations for the TracingTree class.
+  ----------------------------------------------
+*/
+
+#endif
@@ -0,0 +1,93 @@
+#include <cstdio>
+#include <string>
+#include <vector>
+#include "avlbst.h"
+#include "bench_util.h"
+
+using namespace std;
+
+// Times how long dropping a large tree keeps the calling thread busy:
+// clear() against clearInBackground() with one or more reclaimer threads,
+// and the slab fast path for a copied tree of trivially destructible items.
+// Usage: ./clear-bench [number of items]
+
+typedef AVLTree<uint64_t, uint64_t> IntTree;
+typedef AVLTree<uint64_t, string> StringTree;
+
+template<typename Tree, typename MakeValue>
+void fill(Tree& tree, const vector<uint64_t>& keys, MakeValue value)
+{
+    for (size_t i = 0; i < keys.size(); i++) tree.insert(make_pair(keys[i], value(keys[i])));
+}
+
+void report(const char* what, double caller, double total)
+{
+    printf("  %-34s caller %8.3f ms   until freed %8.3f ms\n", what, caller * 1e3, total * 1e3);
+}
+
+/*
+* Fills a tree, then drops it with clear() or on a reclaimer of the given size
+*/
+template<typename Tree, typename MakeValue>
+void run(const char* what, const vector<uint64_t>& keys, MakeValue value, unsigned threads)
+{
+    Tree tree;
+    fill(tree, keys, value);
+    BenchTimer timer;
+    if (threads == 0)
+    {
+        tree.clear();
+        double seconds = timer.seconds();
+        report(what, seconds, seconds);
+        return;
+    }
+
+    NodeReclaimer reclaimer(threads);
+    timer.restart();
+    tree.clearInBackground(reclaimer);
+    double caller = timer.seconds();
+    reclaimer.wait();
+    report(what, caller, timer.seconds());
+}
+
+int main(int argc, char* argv[])
+{
+    size_t n = benchSizeArg(argc, argv, 1, 5000000);
+    vector<uint64_t> keys = randomKeys(n, 42);
+    auto number = [](uint64_t k) { return k; };
+    auto text = [](uint64_t k) { return string(40, (char)('a' + k % 26)); };
+
+    printf("%zu items\n", n);
+    printf("uint64_t values\n");
+    run<IntTree>("clear()", keys, number, 0);
+    run<IntTree>("clearInBackground, 1 thread", keys, number, 1);
+    run<IntTree>("clearInBackground, 2 threads", keys, number, 2);
+    run<IntTree>("clearInBackground, 4 threads", keys, number, 4);
+
+    printf("40-byte string values\n");
+    run<StringTree>("clear()", keys, text, 0);
+    run<StringTree>("clearInBackground, 1 thread", keys, text, 1);
+    run<StringTree>("clearInBackground, 4 threads", keys, text, 4);
+
+    // A copy keeps all of its nodes in one slab
+    printf("copied tree, uint64_t values\n");
+    IntTree original;
+    fill(original, keys, number);
+    {
+        IntTree copy(original);
+        BenchTimer timer;
+        copy.clear();
+        report("clear() of a copy", timer.seconds(), timer.seconds());
+    }
+    {
+        IntTree copy(original);
+        NodeReclaimer reclaimer(1);
+        BenchTimer timer;
+        copy.clearInBackground(reclaimer);
+        double caller = timer.seconds();
+        reclaimer.wait();
+        report("clearInBackground of a copy", caller, timer.seconds());
+    }
+
+    return 0;
+}
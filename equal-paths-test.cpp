@@ -1,6 +1,8 @@
 #include <iostream>
 #include <cstdlib>
+#include <vector>
 #include "equal-paths.h"
+#include "leaf-paths.h"
 using namespace std;
 
 
@@ -11,6 +13,8 @@ Node* d;
 Node* e;
 Node* f;
 
+int failures = 0;
+
 void setNode(Node* n, int key, Node* left=NULL, Node* right=NULL)
 {
   n->key = key;
@@ -18,17 +22,27 @@ void setNode(Node* n, int key, Node* left=NULL, Node* right=NULL)
   n->right = right;
 }
 
+// Prints a result and counts it as a failure if it is not the expected one
+void report(const char* msg, bool result, bool expected)
+{
+  cout << msg << ": " << result << endl;
+  if (result != expected) {
+    cout << "  expected " << expected << endl;
+    failures++;
+  }
+}
+
 void test1(const char* msg)
 {
   setNode(a,1,NULL, NULL);
-  cout << msg << ": " <<   equalPaths(a) << endl;
+  report(msg, equalPaths(a), true);
 }
 
 void test2(const char* msg)
 {
   setNode(a,1,b,NULL);
   setNode(b,2,NULL,NULL);
-  cout << msg << ": " <<   equalPaths(a) << endl;
+  report(msg, equalPaths(a), true);
 }
 
 void test3(const char* msg)
@@ -36,14 +50,14 @@ void test3(const char* msg)
   setNode(a,1,b,c);
   setNode(b,2,NULL,NULL);
   setNode(c,3,NULL,NULL);
-  cout << msg << ": " <<   equalPaths(a) << endl;
+  report(msg, equalPaths(a), true);
 }
 
 void test4(const char* msg)
 {
   setNode(a,1,NULL,c);
   setNode(c,3,NULL,NULL);
-  cout << msg << ": " <<   equalPaths(a) << endl;
+  report(msg, equalPaths(a), true);
 }
 
 void test5(const char* msg)
@@ -52,7 +66,53 @@ void test5(const char* msg)
   setNode(b,2,NULL,d);
   setNode(c,3,NULL,NULL);
   setNode(d,4,NULL,NULL);
-  cout << msg << ": " <<   equalPaths(a) << endl;
+  report(msg, equalPaths(a), false);
+}
+
+// A complete tree that is not full: b has only a left child
+void test6(const char* msg)
+{
+  setNode(a,1,b,c);
+  setNode(b,2,d,NULL);
+  setNode(c,3,NULL,NULL);
+  setNode(d,4,NULL,NULL);
+  LeafPathReport r = checkLeafPaths(a);
+  report(msg, r.complete && !r.full && !r.perfect && !r.equalDepths, true);
+  report("  depth range 1..2", r.minLeafDepth == 1 && r.maxLeafDepth == 2 && r.nodes == 4 && r.leaves == 2, true);
+}
+
+// Trees that are complete, full or perfect but not all three
+void test7(const char* msg)
+{
+  setNode(a,1,b,c);
+  setNode(b,2,d,e);
+  setNode(c,3,f,NULL);
+  setNode(d,4,NULL,NULL);
+  setNode(e,5,NULL,NULL);
+  setNode(f,6,NULL,NULL);
+  report(msg, isCompleteTree(a) && !isFullTree(a) && !isPerfectTree(a), true);
+  setNode(c,3,NULL,NULL);
+  report("  without the last leaf", isFullTree(a) && isCompleteTree(a) && !allLeavesSameDepth(a), true);
+  setNode(b,2,NULL,NULL);
+  report("  two levels", isPerfectTree(a) && isCompleteTree(a) && allLeavesSameDepth(a), true);
+  report("  empty tree", equalPaths(NULL) && isPerfectTree(NULL) && checkLeafPaths(NULL).nodes == 0, true);
+}
+
+// A degenerate tree is checked without recursion, and a violation near
+// the start of a walk stops it early
+void test8(const char* msg)
+{
+  const size_t n = 1000000;
+  vector<Node> line(n, Node(0));
+  for (size_t i = 0; i + 1 < n; i++) line[i].left = &line[i + 1];
+  report(msg, equalPaths(&line[0]), true);
+  LeafPathReport r = checkLeafPaths(&line[0], LEAF_DEPTH_RANGE);
+  report("  deepest leaf", r.maxLeafDepth == n - 1 && r.nodes == n, true);
+
+  line[0].right = &line[n - 1];
+  line[n - 2].left = NULL;
+  r = checkLeafPaths(&line[0], LEAF_FULL);
+  report("  stops at the first node with one child", !r.full && r.stoppedEarly && r.nodes < 10, true);
 }
 
 int main()
@@ -61,16 +121,28 @@ int main()
   b = new Node(2);
   c = new Node(3);
   d = new Node(4);
+  e = new Node(5);
+  f = new Node(6);
 
   test1("Test1");
   test2("Test2");
   test3("Test3");
   test4("Test4");
   test5("Test5");
- 
+  test6("Test6");
+  test7("Test7");
+  test8("Test8");
+
   delete a;
   delete b;
   delete c;
   delete d;
-}
+  delete e;
+  delete f;
 
+  if (failures) {
+    cout << failures << " check(s) failed" << endl;
+    return 1;
+  }
+  return 0;
+}
@@ -4,6 +4,7 @@
 #endif
 
 #include "equal-paths.h"
+#include "leaf-paths.h"
 using namespace std;
 
 
@@ -13,47 +14,20 @@ using namespace std;
 bool equalPaths(Node * root)
 {
     // Add your code below
-    if (!root) return 1;
-
-    return _checkLeafPaths(root->left, 0) == _checkLeafPaths(root->right, 0);
+    return allLeavesSameDepth(root);
 }
 
 /*
-* Finds the path of a subtree, given the root of that subtree
+* Returns h plus the depth that every leaf of the subtree shares (0 for an
+* empty subtree), or -1 if its leaves are at different depths
 */
 int _checkLeafPaths(const Node* root, int h)
 {
-	if (!root) return 0;
-
-    if (root->left && root->right)
-    {
-        // If one child is a leaf and the other one isnt return -1 (does not have equal path). Otherwise, track height
-        if ((_isLeaf(root->left) && !_isLeaf(root->right)) || (!_isLeaf(root->left) && _isLeaf(root->right))) return -1;
-        else if (_isLeaf(root->left) && _isLeaf(root->right)) return h+1;
+    if (!root) return 0;
 
-        // Save values from the left and right
-        int lvalue = _checkLeafPaths(root->left, h+1);
-        int rvalue = _checkLeafPaths(root->right, h+1);
-        
-        // If one of the values is -1, return it (does not have equal paths)
-        if (lvalue == -1 || rvalue == -1) return -1;
-        if (lvalue > rvalue) return lvalue + 1;
-        else return rvalue + 1;
-    }
-    else if (root->left)
-    {
-        // Similar to above, returns -1 if any subtree does not have an equal path
-        int lvalue = _checkLeafPaths(root->left, h+1);
-        if (lvalue == -1) return -1;
-        return lvalue + 1;
-    }
-    else if (root->right)
-    {
-        // Similar to above, returns -1 if any subtree does not have an equal path
-        int rvalue = _checkLeafPaths(root->right, h+1);
-        if (rvalue == -1) return -1;
-        return rvalue + 1;
-    }
+    LeafPathReport report = checkLeafPaths(root, LEAF_EQUAL_DEPTHS);
+    if (!report.equalDepths) return -1;
+    return h + (int)report.maxLeafDepth;
 }
 
 /*
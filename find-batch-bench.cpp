@@ -0,0 +1,90 @@
+#include <cstdio>
+#include <vector>
+#include "avlbst.h"
+#include "bench_util.h"
+
+using namespace std;
+
+// Compares findBatch() against a loop of find() on a tree far larger than
+// the last-level cache, for hits and for misses, at a few batch sizes.
+// Usage: ./find-batch-bench [number of items] [number of lookups]
+//
+// Nodes are inserted in random order, so neighbours in the tree are not
+// neighbours in memory and every level below the top few is a cache miss.
+
+typedef AVLTree<uint64_t, uint64_t> Tree;
+
+static volatile uint64_t sink; // Keeps the optimizer from dropping results
+
+double timeFindLoop(const Tree& tree, const vector<uint64_t>& lookups)
+{
+    BenchTimer timer;
+    uint64_t sum = 0;
+    for (size_t i = 0; i < lookups.size(); i++)
+    {
+        Tree::iterator it = tree.find(lookups[i]);
+        if (it != tree.end()) sum += it->second;
+    }
+    sink = sum;
+    return timer.seconds();
+}
+
+double timeFindBatch(const Tree& tree, const vector<uint64_t>& lookups, size_t batch)
+{
+    vector<Tree::iterator> found(batch);
+    BenchTimer timer;
+    uint64_t sum = 0;
+    for (size_t start = 0; start < lookups.size(); start += batch)
+    {
+        size_t count = lookups.size() - start < batch ? lookups.size() - start : batch;
+        tree.findBatch(&lookups[start], count, &found[0]);
+        for (size_t i = 0; i < count; i++)
+        {
+            if (found[i] != tree.end()) sum += found[i]->second;
+        }
+    }
+    sink = sum;
+    return timer.seconds();
+}
+
+void run(const char* what, const Tree& tree, const vector<uint64_t>& lookups)
+{
+    double loop = timeFindLoop(tree, lookups);
+    printf("  %-6s find() loop        %7.2f Mlookups/s\n", what, lookups.size() / loop / 1e6);
+    size_t batches[] = { 8, 32, 128, 1024 };
+    for (size_t i = 0; i < sizeof(batches) / sizeof(batches[0]); i++)
+    {
+        double seconds = timeFindBatch(tree, lookups, batches[i]);
+        printf("  %-6s findBatch(%4zu)     %7.2f Mlookups/s  %5.2fx\n",
+            what, batches[i], lookups.size() / seconds / 1e6, loop / seconds);
+    }
+}
+
+int main(int argc, char* argv[])
+{
+    size_t n = benchSizeArg(argc, argv, 1, 4000000);
+    size_t lookups = benchSizeArg(argc, argv, 2, 2000000);
+
+    // randomKeys draws from [0, 4n), which leaves three absent keys for each present one
+    vector<uint64_t> keys = randomKeys(n, 42);
+    vector<bool> present(4 * n);
+    Tree tree;
+    for (size_t i = 0; i < n; i++)
+    {
+        tree.insert(make_pair(keys[i], keys[i]));
+        present[keys[i]] = true;
+    }
+
+    mt19937_64 rng(7);
+    vector<uint64_t> hits(lookups), misses(lookups);
+    for (size_t i = 0; i < lookups; i++)
+    {
+        hits[i] = keys[rng() % n];
+        do misses[i] = rng() % (4 * n); while (present[misses[i]]);
+    }
+
+    printf("%zu items, %zu lookups, %d lanes\n", n, lookups, BST_FIND_BATCH_LANES);
+    run("hits", tree, hits);
+    run("misses", tree, misses);
+    return 0;
+}
@@ -0,0 +1,89 @@
+#include <cstdio>
+#include <vector>
+#include "avlbst.h"
+#include "bench_util.h"
+
+using namespace std;
+
+// Compares finger searches against find() from the root for access
+// patterns with different locality: sequential, near-sequential (small
+// random steps either way), jumps of about a thousand positions, and
+// uniformly random.
+// Usage: ./finger-bench [number of items] [number of lookups]
+
+typedef AVLTree<uint64_t, uint64_t> Tree;
+
+static volatile uint64_t sink; // Keeps the optimizer from dropping results
+
+double timeFind(const Tree& tree, const vector<uint64_t>& lookups)
+{
+    BenchTimer timer;
+    uint64_t sum = 0;
+    for (size_t i = 0; i < lookups.size(); i++)
+    {
+        Tree::iterator it = tree.find(lookups[i]);
+        if (it != tree.end()) sum += it->second;
+    }
+    sink = sum;
+    return timer.seconds();
+}
+
+double timeFinger(const Tree& tree, const vector<uint64_t>& lookups)
+{
+    Tree::finger finger(tree);
+    BenchTimer timer;
+    uint64_t sum = 0;
+    for (size_t i = 0; i < lookups.size(); i++)
+    {
+        Tree::iterator it = finger.find(lookups[i]);
+        if (it != tree.end()) sum += it->second;
+    }
+    sink = sum;
+    return timer.seconds();
+}
+
+void run(const char* pattern, const Tree& tree, const vector<uint64_t>& lookups)
+{
+    double root = timeFind(tree, lookups);
+    double finger = timeFinger(tree, lookups);
+    printf("  %-16s find() %7.2f Mlookups/s   finger %7.2f Mlookups/s  %5.2fx\n",
+        pattern, lookups.size() / root / 1e6, lookups.size() / finger / 1e6, root / finger);
+}
+
+/*
+* A walk over the key space [0, range) taking random steps of up to
+* maxStep either way (0 for uniformly random keys, 1 for a forward scan)
+*/
+vector<uint64_t> walk(size_t count, uint64_t range, uint64_t maxStep, uint64_t seed)
+{
+    mt19937_64 rng(seed);
+    vector<uint64_t> keys(count);
+    uint64_t pos = range / 2;
+    for (size_t i = 0; i < count; i++)
+    {
+        if (maxStep == 0) pos = rng() % range;
+        else if (maxStep == 1) pos = (pos + 1) % range;
+        else pos = (pos + range + rng() % (2 * maxStep + 1) - maxStep) % range;
+        keys[i] = pos;
+    }
+    return keys;
+}
+
+int main(int argc, char* argv[])
+{
+    size_t n = benchSizeArg(argc, argv, 1, 4000000);
+    size_t lookups = benchSizeArg(argc, argv, 2, 4000000);
+
+    // Keys are drawn from [0, 4n), so key distances are about four times item distances
+    vector<uint64_t> keys = randomKeys(n, 42);
+    Tree tree;
+    for (size_t i = 0; i < n; i++) tree.insert(make_pair(keys[i], keys[i]));
+    uint64_t range = 4 * n;
+
+    printf("%zu items, %zu lookups\n", n, lookups);
+    run("sequential", tree, walk(lookups, range, 1, 1));
+    run("steps of <= 16", tree, walk(lookups, range, 16, 2));
+    run("steps of <= 4096", tree, walk(lookups, range, 4096, 3));
+    run("random", tree, walk(lookups, range, 0, 4));
+    return 0;
+}
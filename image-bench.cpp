@@ -0,0 +1,74 @@
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <unistd.h>
+#include "bst.h"
+#include "avlbst.h"
+#include "bst_image.h"
+#include "bench_util.h"
+
+using namespace std;
+
+// Compares the ways of getting a saved AVLTree back at startup: mapping its
+// image and searching it in place, loading the image into a tree, reading
+// a stream with deserialize, and inserting every item again.
+// Usage: ./image-bench [number of items] [image path]
+
+int main(int argc, char* argv[])
+{
+    size_t n = benchSizeArg(argc, argv, 1, 1000000);
+    string path = argc > 2 ? argv[2] : "/tmp/image-bench-" + to_string(getpid()) + ".img";
+    vector<uint64_t> keys = randomKeys(n, 42);
+    vector<uint64_t> probes = randomKeys(1000, 7);
+
+    AVLTree<uint64_t, uint64_t> tree;
+    for (size_t i = 0; i < n; i++) tree.insert(make_pair(keys[i], (uint64_t)i));
+
+    BenchTimer timer;
+    TreeImage<uint64_t, uint64_t>::write(tree, path);
+    double writeTime = timer.seconds();
+
+    stringstream stream;
+    tree.serialize(stream);
+    string bytes = stream.str();
+
+    // Open and answer the first lookups straight from the mapping
+    timer.restart();
+    size_t hits = 0;
+    {
+        MappedTree<uint64_t, uint64_t> image(path);
+        double openTime = timer.seconds();
+        for (size_t i = 0; i < probes.size(); i++) hits += image.find(probes[i]) != nullptr;
+        double firstLookups = timer.seconds();
+
+        timer.restart();
+        bool valid = image.verify();
+        double verifyTime = timer.seconds();
+
+        AVLTree<uint64_t, uint64_t> loaded;
+        timer.restart();
+        TreeImage<uint64_t, uint64_t>::load(image, loaded);
+        double loadTime = timer.seconds();
+
+        cout << n << " items, image of " << TreeImage<uint64_t, uint64_t>::imageSize(n) / (1024.0 * 1024.0) << " MB" << endl;
+        cout << "  write image:               " << writeTime * 1000 << " ms" << endl;
+        cout << "  map and open:              " << openTime * 1000 << " ms" << endl;
+        cout << "  open + " << probes.size() << " mapped finds:   " << firstLookups * 1000 << " ms (" << hits << " hits)" << endl;
+        cout << "  verify links:              " << verifyTime * 1000 << " ms" << (valid ? "" : " (INVALID)") << endl;
+        cout << "  load into AVLTree:         " << loadTime * 1000 << " ms" << endl;
+    }
+
+    AVLTree<uint64_t, uint64_t> read;
+    stringstream in(bytes);
+    timer.restart();
+    read.deserialize(in);
+    cout << "  deserialize a stream:      " << timer.seconds() * 1000 << " ms" << endl;
+
+    AVLTree<uint64_t, uint64_t> rebuilt;
+    timer.restart();
+    for (size_t i = 0; i < n; i++) rebuilt.insert(make_pair(keys[i], (uint64_t)i));
+    cout << "  insert every item:         " << timer.seconds() * 1000 << " ms" << endl;
+
+    if (argc <= 2) ::unlink(path.c_str());
+    return 0;
+}
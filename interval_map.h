@@ -0,0 +1,286 @@
+#ifndef INTERVAL_MAP_H
+#define INTERVAL_MAP_H
+
+#include <ostream>
+#include <stdexcept>
+#include <vector>
+#include "avl_augmented.h"
+
+/*
+  Interval map
+
+  An AVL tree of closed intervals [start, end] keyed by start, in which
+  every node also knows the largest end point in its subtree (an
+  AugmentedAVLTree with IntervalEndMonoid, so rotations, the predecessor
+  swap in remove and bulk loads keep it current).
+
+  Several intervals may share a start point. As in AVLMultimap, each is
+  its own node, a new one goes after those already there, and intervals
+  with the same start are visited in insertion order. remove(start) drops
+  all of them; removeOne(start, end) drops the oldest one with that end.
+  find(), lower_bound() and operator[] reach the oldest interval at a start.
+
+  overlapping(lo, hi, visit) walks the tree in start order, skipping every
+  subtree whose largest end is before lo and stopping at the first start
+  after hi. It visits the k overlapping intervals plus the nodes on the
+  paths to them: O(log n) when there are none, and O(log n + k) when, as
+  usual, the overlaps are neighbours in start order; a few long intervals
+  scattered among many short ones can cost up to O(log n) each.
+
+    IntervalMap<long, Lease> leases;
+    leases.insert(start, end, lease);
+    leases.stabbing(now, [](const long& start, const long& end, Lease& l) { ... });
+
+  Points need a default constructor, and no end point may be changed once
+  inserted (it is part of the stored value). deserialize() still requires
+  strictly increasing start points.
+*/
+
+/**
+* The value stored for each start point
+*/
+template<typename Point, typename T>
+struct Interval
+{
+    Point end;
+    T value;
+};
+
+/*
+* Lets print() show the end point after the start
+*/
+template<typename Point, typename T>
+std::ostream& operator<<(std::ostream& out, const Interval<Point, T>& interval)
+{
+    return out << "to " << interval.end << ' ' << interval.value;
+}
+
+/**
+* Aggregates the largest end point of a subtree
+*/
+template<typename Point, typename T, typename Compare = std::less<Point> >
+struct IntervalEndMonoid
+{
+    struct value_type
+    {
+        Point end;
+        bool empty; // set only for the identity
+    };
+
+    explicit IntervalEndMonoid(const Compare& comp = Compare()) : comp(comp) {}
+
+    value_type identity() const
+    {
+        value_type none = { Point(), true };
+        return none;
+    }
+
+    value_type lift(const Interval<Point, T>& interval) const
+    {
+        value_type v = { interval.end, false };
+        return v;
+    }
+
+    value_type combine(const value_type& a, const value_type& b) const
+    {
+        if (a.empty) return b;
+        if (b.empty) return a;
+        return comp(a.end, b.end) ? b : a;
+    }
+
+    Compare comp;
+};
+
+template <class Point, class T, class Compare = std::less<Point> >
+class IntervalMap : public AugmentedAVLTree<Point, Interval<Point, T>, IntervalEndMonoid<Point, T, Compare>, Compare>
+{
+public:
+    typedef AugmentedAVLTree<Point, Interval<Point, T>, IntervalEndMonoid<Point, T, Compare>, Compare> Base;
+
+    explicit IntervalMap(const Compare& comp = Compare());
+    IntervalMap(const IntervalMap& other) = default;
+    IntervalMap(IntervalMap&& other);
+    IntervalMap& operator=(const IntervalMap& other) = default;
+    IntervalMap& operator=(IntervalMap&& other) = default;
+
+    virtual void insert(const std::pair<const Point, Interval<Point, T> >& item) override; // Adds the interval after any others with the same start
+    void insert(const Point& start, const Point& end, const T& value); // Same
+    virtual void remove(const Point& start) override; // Removes every interval with start
+    bool removeOne(const Point& start, const Point& end); // Removes the oldest interval [start, end], if there is one
+    size_t count(const Point& start) const; // Number of intervals with start
+
+    // Calls visit(start, end, value) for each interval overlapping [lo, hi],
+    // in start order, and returns how many there were
+    template<typename Visitor>
+    size_t overlapping(const Point& lo, const Point& hi, Visitor visit);
+    template<typename Visitor>
+    size_t stabbing(const Point& point, Visitor visit); // Same, for the intervals containing point
+
+protected:
+    bool _endsBefore(AVLNode<Point, Interval<Point, T> >* n, const Point& point) const; // Whether every interval in n's subtree ends before point
+};
+
+/*
+  -----------------------------------------------
+  Begin implementations for the IntervalMap class.
+  -----------------------------------------------
+*/
+
+template<class Point, class T, class Compare>
+IntervalMap<Point, T, Compare>::IntervalMap(const Compare& comp) :
+    Base(IntervalEndMonoid<Point, T, Compare>(comp), comp)
+{
+
+}
+
+/**
+* Move constructor. The base one would refuse an IntervalMap, so this one
+* takes the nodes itself.
+*/
+template<class Point, class T, class Compare>
+IntervalMap<Point, T, Compare>::IntervalMap(IntervalMap&& other) :
+    Base(other.monoid_, other.comp_)
+{
+    this->_requireTreeType(other, typeid(IntervalMap));
+    this->_swapContents(other);
+}
+
+/**
+* Inserts the interval [item.first, item.second.end], descending to the
+* upper bound of its start so that it follows every interval with the same
+* start, and links it in as a new leaf.
+* Throws std::invalid_argument if it ends before it starts.
+*/
+template<class Point, class T, class Compare>
+void IntervalMap<Point, T, Compare>::insert(const std::pair<const Point, Interval<Point, T> >& item)
+{
+    if (this->comp_(item.second.end, item.first)) throw std::invalid_argument("Interval ends before it starts");
+
+    if (this->empty())
+    {
+        Base::insert(item);
+        return;
+    }
+
+    BST_TIMED(TREE_TIME_INSERT);
+    AVLNode<Point, Interval<Point, T> >* current = static_cast<AVLNode<Point, Interval<Point, T> >*>(this->root_);
+    AVLNode<Point, Interval<Point, T> >* parent = nullptr;
+    bool goLeft = false;
+    size_t depth = 0;
+    while (current)
+    {
+        depth++;
+        parent = current;
+        goLeft = this->comp_(item.first, current->getKey());
+        current = goLeft ? current->getLeft() : current->getRight();
+    }
+    BST_STAT(treeStatsRecordSearch(depth, depth));
+
+    this->_insertLeaf(parent, goLeft, item, depth);
+}
+
+/**
+* Inserts the interval [start, end] carrying value.
+* Throws std::invalid_argument if end is before start.
+*/
+template<class Point, class T, class Compare>
+void IntervalMap<Point, T, Compare>::insert(const Point& start, const Point& end, const T& value)
+{
+    Interval<Point, T> interval = { end, value };
+    insert(std::make_pair(start, interval));
+}
+
+/**
+* Finds the oldest interval with start once, then unlinks the run in order,
+* taking each node's successor before freeing it
+*/
+template<class Point, class T, class Compare>
+void IntervalMap<Point, T, Compare>::remove(const Point& start)
+{
+    BST_TIMED(TREE_TIME_REMOVE);
+    Node<Point, Interval<Point, T> >* current = this->_lowerBound(this->root_, start);
+    while (current && !this->comp_(start, current->getKey()))
+    {
+        Node<Point, Interval<Point, T> >* next = this->successor(current);
+        this->_eraseNode(current);
+        current = next;
+    }
+}
+
+template<class Point, class T, class Compare>
+bool IntervalMap<Point, T, Compare>::removeOne(const Point& start, const Point& end)
+{
+    BST_TIMED(TREE_TIME_REMOVE);
+    Node<Point, Interval<Point, T> >* current = this->_lowerBound(this->root_, start);
+    for (; current && !this->comp_(start, current->getKey()); current = this->successor(current))
+    {
+        const Point& currentEnd = current->getValue().end;
+        if (this->comp_(currentEnd, end) || this->comp_(end, currentEnd)) continue;
+
+        this->_eraseNode(current);
+        return true;
+    }
+    return false;
+}
+
+template<class Point, class T, class Compare>
+size_t IntervalMap<Point, T, Compare>::count(const Point& start) const
+{
+    size_t found = 0;
+    Node<Point, Interval<Point, T> >* current = this->_lowerBound(this->root_, start);
+    for (; current && !this->comp_(start, current->getKey()); current = this->successor(current)) found++;
+    return found;
+}
+
+/**
+* In-order walk that prunes subtrees ending before lo and stops at the
+* first start after hi
+*/
+template<class Point, class T, class Compare>
+template<typename Visitor>
+size_t IntervalMap<Point, T, Compare>::overlapping(const Point& lo, const Point& hi, Visitor visit)
+{
+    size_t found = 0;
+    std::vector<AVLNode<Point, Interval<Point, T> >*> stack;
+    AVLNode<Point, Interval<Point, T> >* n = static_cast<AVLNode<Point, Interval<Point, T> >*>(this->root_);
+    for (;;)
+    {
+        for (; n && !_endsBefore(n, lo); n = n->getLeft()) stack.push_back(n);
+        if (stack.empty()) break;
+
+        n = stack.back();
+        stack.pop_back();
+        if (this->comp_(hi, n->getKey())) break; // every later interval starts after hi
+
+        Interval<Point, T>& interval = n->getValue();
+        if (!this->comp_(interval.end, lo))
+        {
+            visit(n->getKey(), interval.end, interval.value);
+            found++;
+        }
+        n = n->getRight();
+    }
+    return found;
+}
+
+template<class Point, class T, class Compare>
+template<typename Visitor>
+size_t IntervalMap<Point, T, Compare>::stabbing(const Point& point, Visitor visit)
+{
+    return overlapping(point, point, visit);
+}
+
+template<class Point, class T, class Compare>
+bool IntervalMap<Point, T, Compare>::_endsBefore(AVLNode<Point, Interval<Point, T> >* n, const Point& point) const
+{
+    const typename Base::Aggregate& maxEnd = static_cast<typename Base::AugNode*>(n)->getAggregate();
+    return maxEnd.empty || this->comp_(maxEnd.end, point);
+}
+
+/*
+  ---------------------------------------------
+  End implementations for the IntervalMap class.
+  ---------------------------------------------
+*/
+
+#endif
@@ -0,0 +1,383 @@
+#ifndef LATENCY_HISTOGRAM_H
+#define LATENCY_HISTOGRAM_H
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+#include <ostream>
+#include <vector>
+
+/*
+  Log-linear latency histograms
+
+  Like an HDR histogram, every power of two is split into
+  LATENCY_SUB_BUCKETS linear buckets, so any recorded value is known to
+  within about 3% while a histogram covering 1 ns to centuries stays a
+  fixed 15 KB. Recording is a count-leading-zeros and an increment.
+
+  Build with -DBST_TIMING to have the trees time every find, insert,
+  remove and iterator step into per-thread histograms; timings() merges
+  them. Without it every BST_TIMED(...) expands to nothing. Each sample
+  costs two clock reads (about 20-40 ns), which dominates a single
+  iterator step, so read the iterate figures as an upper bound.
+*/
+
+#ifdef BST_TIMING
+#define BST_TIMED(op) TreeOpTimer bstOpTimer_(op)
+#else
+#define BST_TIMED(op)
+#endif
+
+#define LATENCY_SUB_BUCKET_BITS 5
+#define LATENCY_SUB_BUCKETS (1 << LATENCY_SUB_BUCKET_BITS)
+#define LATENCY_BUCKETS ((65 - LATENCY_SUB_BUCKET_BITS) * LATENCY_SUB_BUCKETS)
+
+/*
+* A counter that one thread increments while others may read it
+*/
+class RelaxedCounter
+{
+public:
+    RelaxedCounter() : value_(0) {}
+
+    uint64_t get() const { return value_.load(std::memory_order_relaxed); }
+    void set(uint64_t value) { value_.store(value, std::memory_order_relaxed); }
+
+private:
+    std::atomic<uint64_t> value_;
+};
+
+inline uint64_t counterGet(const uint64_t& c) { return c; }
+inline void counterSet(uint64_t& c, uint64_t value) { c = value; }
+inline uint64_t counterGet(const RelaxedCounter& c) { return c.get(); }
+inline void counterSet(RelaxedCounter& c, uint64_t value) { c.set(value); }
+
+/**
+* A log-linear histogram of nanosecond latencies. Counter is uint64_t for
+* a plain histogram, or RelaxedCounter for one that is written by a single
+* thread and read concurrently by others.
+*/
+template <typename Counter>
+class BasicLatencyHistogram
+{
+public:
+    BasicLatencyHistogram() { reset(); }
+
+    void record(uint64_t ns);
+    template <typename Other>
+    void merge(const BasicLatencyHistogram<Other>& other);
+    void reset();
+
+    uint64_t count() const { return counterGet(count_); }
+    uint64_t min() const { return count() ? counterGet(min_) : 0; }
+    uint64_t max() const { return counterGet(max_); }
+    double mean() const { return count() ? (double)counterGet(sum_) / count() : 0.0; }
+    uint64_t valueAtPercentile(double percentile) const;
+
+    void writeText(std::ostream& out, const char* name) const;
+    void writeJson(std::ostream& out) const;
+
+    static size_t bucketOf(uint64_t ns);
+    static uint64_t bucketLow(size_t bucket);
+    static uint64_t bucketHigh(size_t bucket);
+
+protected:
+    template <typename Other>
+    friend class BasicLatencyHistogram;
+
+    Counter counts_[LATENCY_BUCKETS];
+    Counter count_;
+    Counter sum_;
+    Counter min_;
+    Counter max_;
+};
+
+typedef BasicLatencyHistogram<uint64_t> LatencyHistogram;
+
+/*
+  --------------------------------------------------------
+  Begin implementations for the LatencyHistogram class.
+  --------------------------------------------------------
+*/
+
+/*
+* Values below LATENCY_SUB_BUCKETS get a bucket each; above that, each
+* power of two gets LATENCY_SUB_BUCKETS buckets
+*/
+template <typename Counter>
+size_t BasicLatencyHistogram<Counter>::bucketOf(uint64_t ns)
+{
+    if (ns < LATENCY_SUB_BUCKETS) return (size_t)ns;
+    int shift = 63 - __builtin_clzll(ns) - LATENCY_SUB_BUCKET_BITS;
+    return (size_t)(shift + 1) * LATENCY_SUB_BUCKETS + (size_t)((ns >> shift) - LATENCY_SUB_BUCKETS);
+}
+
+/*
+* The smallest value that falls in a bucket
+*/
+template <typename Counter>
+uint64_t BasicLatencyHistogram<Counter>::bucketLow(size_t bucket)
+{
+    if (bucket < LATENCY_SUB_BUCKETS) return bucket;
+    int shift = (int)(bucket / LATENCY_SUB_BUCKETS) - 1;
+    return (uint64_t)(LATENCY_SUB_BUCKETS + bucket % LATENCY_SUB_BUCKETS) << shift;
+}
+
+/*
+* The largest value that falls in a bucket
+*/
+template <typename Counter>
+uint64_t BasicLatencyHistogram<Counter>::bucketHigh(size_t bucket)
+{
+    if (bucket < LATENCY_SUB_BUCKETS) return bucket;
+    int shift = (int)(bucket / LATENCY_SUB_BUCKETS) - 1;
+    return bucketLow(bucket) + (((uint64_t)1 << shift) - 1);
+}
+
+template <typename Counter>
+void BasicLatencyHistogram<Counter>::record(uint64_t ns)
+{
+    Counter& bucket = counts_[bucketOf(ns)];
+    counterSet(bucket, counterGet(bucket) + 1);
+    counterSet(count_, counterGet(count_) + 1);
+    counterSet(sum_, counterGet(sum_) + ns);
+    if (ns < counterGet(min_)) counterSet(min_, ns);
+    if (ns > counterGet(max_)) counterSet(max_, ns);
+}
+
+template <typename Counter>
+template <typename Other>
+void BasicLatencyHistogram<Counter>::merge(const BasicLatencyHistogram<Other>& other)
+{
+    for (size_t i = 0; i < LATENCY_BUCKETS; i++) counterSet(counts_[i], counterGet(counts_[i]) + counterGet(other.counts_[i]));
+    counterSet(count_, counterGet(count_) + counterGet(other.count_));
+    counterSet(sum_, counterGet(sum_) + counterGet(other.sum_));
+    if (counterGet(other.min_) < counterGet(min_)) counterSet(min_, counterGet(other.min_));
+    if (counterGet(other.max_) > counterGet(max_)) counterSet(max_, counterGet(other.max_));
+}
+
+template <typename Counter>
+void BasicLatencyHistogram<Counter>::reset()
+{
+    for (size_t i = 0; i < LATENCY_BUCKETS; i++) counterSet(counts_[i], 0);
+    counterSet(count_, 0);
+    counterSet(sum_, 0);
+    counterSet(min_, UINT64_MAX);
+    counterSet(max_, 0);
+}
+
+/**
+* Returns the highest value of the bucket holding the given percentile
+* (0-100), clamped to the largest value recorded
+*/
+template <typename Counter>
+uint64_t BasicLatencyHistogram<Counter>::valueAtPercentile(double percentile) const
+{
+    uint64_t total = count();
+    if (total == 0) return 0;
+    uint64_t rank = (uint64_t)(percentile / 100.0 * total + 0.5);
+    if (rank < 1) rank = 1;
+    if (rank > total) rank = total;
+
+    uint64_t seen = 0;
+    for (size_t i = 0; i < LATENCY_BUCKETS; i++)
+    {
+        seen += counterGet(counts_[i]);
+        if (seen >= rank) return bucketHigh(i) < max() ? bucketHigh(i) : max();
+    }
+    return max();
+}
+
+/**
+* Writes one summary line: count, mean, percentiles and max in nanoseconds
+*/
+template <typename Counter>
+void BasicLatencyHistogram<Counter>::writeText(std::ostream& out, const char* name) const
+{
+    out << name << ": count=" << count() << " mean=" << (uint64_t)mean()
+        << " min=" << min()
+        << " p50=" << valueAtPercentile(50)
+        << " p90=" << valueAtPercentile(90)
+        << " p99=" << valueAtPercentile(99)
+        << " p99.9=" << valueAtPercentile(99.9)
+        << " p99.99=" << valueAtPercentile(99.99)
+        << " max=" << max() << " (ns)\n";
+}
+
+/**
+* Writes the summary and every non-empty bucket as a JSON object
+*/
+template <typename Counter>
+void BasicLatencyHistogram<Counter>::writeJson(std::ostream& out) const
+{
+    out << "{\"count\": " << count() << ", \"mean_ns\": " << mean() << ", \"min_ns\": " << min()
+        << ", \"p50_ns\": " << valueAtPercentile(50)
+        << ", \"p90_ns\": " << valueAtPercentile(90)
+        << ", \"p99_ns\": " << valueAtPercentile(99)
+        << ", \"p999_ns\": " << valueAtPercentile(99.9)
+        << ", \"p9999_ns\": " << valueAtPercentile(99.99)
+        << ", \"max_ns\": " << max() << ", \"buckets\": [";
+    bool first = true;
+    for (size_t i = 0; i < LATENCY_BUCKETS; i++)
+    {
+        if (!counterGet(counts_[i])) continue;
+        out << (first ? "" : ", ") << "[" << bucketLow(i) << ", " << bucketHigh(i) << ", " << counterGet(counts_[i]) << "]";
+        first = false;
+    }
+    out << "]}";
+}
+
+/*
+  ------------------------------------------------------
+  End implementations for the LatencyHistogram class.
+  ------------------------------------------------------
+*/
+
+/*
+  Per-operation timing of the trees (only collected with -DBST_TIMING)
+*/
+
+enum TreeTimedOp
+{
+    TREE_TIME_FIND,
+    TREE_TIME_INSERT,
+    TREE_TIME_REMOVE,
+    TREE_TIME_ITERATE,
+    TREE_TIME_OPS
+};
+
+inline const char* treeTimedOpName(int op)
+{
+    static const char* names[TREE_TIME_OPS] = { "find", "insert", "remove", "iterate" };
+    return names[op];
+}
+
+/**
+* Merged latency histograms of every tree operation
+*/
+struct TreeTimings
+{
+    LatencyHistogram ops[TREE_TIME_OPS];
+
+    void writeText(std::ostream& out) const
+    {
+        for (int op = 0; op < TREE_TIME_OPS; op++) ops[op].writeText(out, treeTimedOpName(op));
+    }
+
+    void writeJson(std::ostream& out) const
+    {
+        out << "{";
+        for (int op = 0; op < TREE_TIME_OPS; op++)
+        {
+            out << (op ? ", " : "") << "\"" << treeTimedOpName(op) << "\": ";
+            ops[op].writeJson(out);
+        }
+        out << "}\n";
+    }
+};
+
+struct TreeTimingBlock;
+
+/*
+* Registry of live per-thread histograms and the merged histograms of
+* threads that have exited
+*/
+struct TreeTimingRegistry
+{
+    std::mutex lock;
+    std::vector<TreeTimingBlock*> blocks;
+    TreeTimings retired;
+
+    static TreeTimingRegistry& instance()
+    {
+        static TreeTimingRegistry registry;
+        return registry;
+    }
+};
+
+/*
+* One thread's histograms, written only by that thread
+*/
+struct TreeTimingBlock
+{
+    BasicLatencyHistogram<RelaxedCounter> ops[TREE_TIME_OPS];
+
+    TreeTimingBlock()
+    {
+        TreeTimingRegistry& registry = TreeTimingRegistry::instance();
+        std::lock_guard<std::mutex> guard(registry.lock);
+        registry.blocks.push_back(this);
+    }
+
+    ~TreeTimingBlock()
+    {
+        TreeTimingRegistry& registry = TreeTimingRegistry::instance();
+        std::lock_guard<std::mutex> guard(registry.lock);
+        for (int op = 0; op < TREE_TIME_OPS; op++) registry.retired.ops[op].merge(ops[op]);
+        for (size_t i = 0; i < registry.blocks.size(); i++)
+        {
+            if (registry.blocks[i] == this)
+            {
+                registry.blocks.erase(registry.blocks.begin() + i);
+                break;
+            }
+        }
+    }
+
+    static TreeTimingBlock& local()
+    {
+        static thread_local TreeTimingBlock block;
+        return block;
+    }
+};
+
+/*
+* Times the enclosing scope into the calling thread's histogram for op
+*/
+class TreeOpTimer
+{
+public:
+    explicit TreeOpTimer(int op) : op_(op), start_(std::chrono::steady_clock::now()) {}
+
+    ~TreeOpTimer()
+    {
+        uint64_t ns = (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start_).count();
+        TreeTimingBlock::local().ops[op_].record(ns);
+    }
+
+private:
+    int op_;
+    std::chrono::steady_clock::time_point start_;
+};
+
+/**
+* Merges every thread's histograms
+*/
+inline TreeTimings treeTimingsSnapshot()
+{
+    TreeTimingRegistry& registry = TreeTimingRegistry::instance();
+    std::lock_guard<std::mutex> guard(registry.lock);
+    TreeTimings timings = registry.retired;
+    for (size_t b = 0; b < registry.blocks.size(); b++)
+    {
+        for (int op = 0; op < TREE_TIME_OPS; op++) timings.ops[op].merge(registry.blocks[b]->ops[op]);
+    }
+    return timings;
+}
+
+/**
+* Clears every thread's histograms. Samples recorded concurrently may be lost.
+*/
+inline void treeTimingsReset()
+{
+    TreeTimingRegistry& registry = TreeTimingRegistry::instance();
+    std::lock_guard<std::mutex> guard(registry.lock);
+    for (int op = 0; op < TREE_TIME_OPS; op++) registry.retired.ops[op].reset();
+    for (size_t b = 0; b < registry.blocks.size(); b++)
+    {
+        for (int op = 0; op < TREE_TIME_OPS; op++) registry.blocks[b]->ops[op].reset();
+    }
+}
+
+#endif
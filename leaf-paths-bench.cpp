@@ -0,0 +1,111 @@
+#include <cstdio>
+#include <vector>
+#include "leaf-paths.h"
+#include "bench_util.h"
+
+using namespace std;
+
+// Times checkLeafPaths() on large trees of the Node struct from equal-paths.h,
+// next to a straightforward recursive check where the recursion still fits
+// on the stack.
+// Usage: ./leaf-paths-bench [number of nodes]
+//
+// Nodes take 24 bytes each, so 1e8 nodes need about 2.4 GB.
+
+static volatile size_t sink; // Keeps the optimizer from dropping results
+
+/*
+* Links nodes[0..n) into a complete tree in level order
+*/
+void linkComplete(vector<Node>& nodes)
+{
+    size_t n = nodes.size();
+    for (size_t i = 0; i < n; i++)
+    {
+        nodes[i].left = 2 * i + 1 < n ? &nodes[2 * i + 1] : nullptr;
+        nodes[i].right = 2 * i + 2 < n ? &nodes[2 * i + 2] : nullptr;
+    }
+}
+
+/*
+* Links nodes[0..n) into a single chain of right children
+*/
+void linkChain(vector<Node>& nodes)
+{
+    for (size_t i = 0; i < nodes.size(); i++)
+    {
+        nodes[i].left = nullptr;
+        nodes[i].right = i + 1 < nodes.size() ? &nodes[i + 1] : nullptr;
+    }
+}
+
+/*
+* The recursive baseline: the common leaf depth below n, or -1
+*/
+long recursiveLeafDepth(const Node* n, long depth)
+{
+    if (!n->left && !n->right) return depth;
+    long l = n->left ? recursiveLeafDepth(n->left, depth + 1) : -2;
+    long r = n->right ? recursiveLeafDepth(n->right, depth + 1) : -2;
+    if (l == -1 || r == -1) return -1;
+    if (l == -2) return r;
+    if (r == -2) return l;
+    return l == r ? l : -1;
+}
+
+void report(const char* shape, const char* check, size_t n, const LeafPathReport& r, double seconds)
+{
+    sink = r.nodes;
+    printf("  %-10s %-22s %6.3f s  %7.1f Mnodes/s  visited %zu of %zu%s\n",
+        shape, check, seconds, r.nodes / seconds / 1e6, r.nodes, n, r.stoppedEarly ? " (stopped early)" : "");
+}
+
+int main(int argc, char* argv[])
+{
+    size_t n = benchSizeArg(argc, argv, 1, 10000000);
+    if (n < 2) n = 2;
+    vector<Node> nodes(n, Node(0));
+    BenchTimer timer;
+
+    printf("%zu nodes\n", n);
+
+    // n - 1 nodes make the last level end half way, so the leaves are at two depths
+    linkComplete(nodes);
+    timer.restart();
+    LeafPathReport all = checkLeafPaths(&nodes[0], LEAF_ALL);
+    report("complete", "all checks", n, all, timer.seconds());
+    timer.restart();
+    LeafPathReport equal = checkLeafPaths(&nodes[0], LEAF_EQUAL_DEPTHS);
+    report("complete", "equal depths", n, equal, timer.seconds());
+    timer.restart();
+    sink = recursiveLeafDepth(&nodes[0], 0) >= 0;
+    printf("  %-10s %-22s %6.3f s\n", "complete", "recursive equal depths", timer.seconds());
+
+    // The largest perfect tree that fits
+    size_t perfect = 1;
+    while (perfect * 2 + 1 <= n) perfect = perfect * 2 + 1;
+    vector<Node> head(nodes.begin(), nodes.begin() + perfect);
+    linkComplete(head);
+    timer.restart();
+    LeafPathReport p = checkLeafPaths(&head[0], LEAF_ALL);
+    report("perfect", "all checks", perfect, p, timer.seconds());
+    timer.restart();
+    LeafPathReport pEqual = checkLeafPaths(&head[0], LEAF_EQUAL_DEPTHS);
+    report("perfect", "equal depths", perfect, pEqual, timer.seconds());
+    timer.restart();
+    sink = recursiveLeafDepth(&head[0], 0) >= 0;
+    printf("  %-10s %-22s %6.3f s\n", "perfect", "recursive equal depths", timer.seconds());
+    head.clear();
+    head.shrink_to_fit();
+
+    // Far too deep for any recursive check
+    linkChain(nodes);
+    timer.restart();
+    LeafPathReport chain = checkLeafPaths(&nodes[0], LEAF_ALL);
+    report("chain", "all checks", n, chain, timer.seconds());
+    timer.restart();
+    LeafPathReport chainFull = checkLeafPaths(&nodes[0], LEAF_FULL);
+    report("chain", "full", n, chainFull, timer.seconds());
+
+    return 0;
+}
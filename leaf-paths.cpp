@@ -0,0 +1,154 @@
+#ifndef RECCHECK
+#include <cstdint>
+#include <vector>
+#endif
+
+#include "leaf-paths.h"
+using namespace std;
+
+/*
+* One node waiting on the walk stack, with its depth and its position in
+* level order (the root is 1 and the children of i are 2i and 2i + 1),
+* which is what decides completeness
+*/
+struct LeafPathFrame
+{
+    const Node* node;
+    size_t depth;
+    uint64_t position;
+};
+
+// Beyond this depth positions would overflow, and no tree that fits in memory is complete
+#define LEAF_PATHS_MAX_POSITION_DEPTH 62
+
+/*
+* Returns whether some requested property could still hold, so the walk has to go on
+*/
+static bool leafPathsUndecided(unsigned checks, bool equal, bool full, bool complete)
+{
+    return (checks & LEAF_DEPTH_RANGE) ||
+           ((checks & LEAF_EQUAL_DEPTHS) && equal) ||
+           ((checks & LEAF_FULL) && full) ||
+           ((checks & LEAF_COMPLETE) && complete) ||
+           ((checks & LEAF_PERFECT) && equal && full);
+}
+
+/*
+* Walks the tree once in pre-order with an explicit stack. Left children
+* are followed directly, so only right children that have a left sibling
+* wait on the stack.
+*/
+LeafPathReport checkLeafPaths(const Node* root, unsigned checks)
+{
+    bool equal = true, full = true;
+    bool complete = (checks & LEAF_COMPLETE) != 0; // positions are only tracked when asked for
+    size_t minDepth = SIZE_MAX, maxDepth = 0;
+    size_t nodes = 0, leaves = 0;
+    uint64_t maxPosition = 0;
+    bool stop = false;
+    bool stoppedEarly = false; // stopped with nodes left to visit
+
+    vector<LeafPathFrame> stack;
+    if (root)
+    {
+        LeafPathFrame top = { root, 0, 1 };
+        stack.push_back(top);
+    }
+
+    while (!stack.empty() && !stop)
+    {
+        LeafPathFrame f = stack.back();
+        stack.pop_back();
+
+        // Walk down from f until reaching a leaf
+        for (;;)
+        {
+            nodes++;
+            if (complete && f.position > maxPosition) maxPosition = f.position;
+
+            const Node* left = f.node->left;
+            const Node* right = f.node->right;
+            bool violation = false;
+
+            if (!left && !right)
+            {
+                leaves++;
+                if (leaves > 1 && f.depth != minDepth)
+                {
+                    equal = false;
+                    violation = true;
+                }
+                if (f.depth < minDepth) minDepth = f.depth;
+                if (f.depth > maxDepth) maxDepth = f.depth;
+                if (complete && maxDepth - minDepth > 1)
+                {
+                    complete = false;
+                    violation = true;
+                }
+            }
+            else if (!left || !right)
+            {
+                full = false;
+                violation = true;
+                if (!left) complete = false; // a right child without a left one
+            }
+            if (complete && (left || right) && f.depth >= LEAF_PATHS_MAX_POSITION_DEPTH)
+            {
+                complete = false;
+                violation = true;
+            }
+
+            if (violation && !leafPathsUndecided(checks, equal, full, complete))
+            {
+                stop = true;
+                stoppedEarly = left || right || !stack.empty();
+                break;
+            }
+            if (!left && !right) break;
+
+            if (left && right)
+            {
+                LeafPathFrame r = { right, f.depth + 1, 2 * f.position + 1 };
+                stack.push_back(r);
+            }
+            if (left) f.position = 2 * f.position;
+            else f.position = 2 * f.position + 1;
+            f.node = left ? left : right;
+            f.depth++;
+        }
+    }
+    // A complete tree numbers its nodes 1 to n in level order without gaps
+    if (complete && !stop) complete = maxPosition == nodes;
+
+    LeafPathReport report;
+    report.equalDepths = (checks & LEAF_EQUAL_DEPTHS) && equal;
+    report.full = (checks & LEAF_FULL) && full;
+    report.complete = (checks & LEAF_COMPLETE) && complete;
+    report.perfect = (checks & LEAF_PERFECT) && equal && full;
+    report.minLeafDepth = leaves ? minDepth : 0;
+    report.maxLeafDepth = maxDepth;
+    report.nodes = nodes;
+    report.leaves = leaves;
+    report.stoppedEarly = stoppedEarly;
+    return report;
+}
+
+bool allLeavesSameDepth(const Node* root)
+{
+    return checkLeafPaths(root, LEAF_EQUAL_DEPTHS).equalDepths;
+}
+
+bool isFullTree(const Node* root)
+{
+    return checkLeafPaths(root, LEAF_FULL).full;
+}
+
+bool isCompleteTree(const Node* root)
+{
+    return checkLeafPaths(root, LEAF_COMPLETE).complete;
+}
+
+bool isPerfectTree(const Node* root)
+{
+    return checkLeafPaths(root, LEAF_PERFECT).perfect;
+}
@@ -0,0 +1,62 @@
+#ifndef LEAF_PATHS_H
+#define LEAF_PATHS_H
+
+#ifndef RECCHECK
+#include <cstddef>
+#endif
+
+#include "equal-paths.h"
+
+/*
+  Leaf-depth property checks over the Node struct of equal-paths.h
+
+  checkLeafPaths() walks the tree once, depth first, with an explicit stack
+  instead of recursion, so its memory use is bounded by the height of the
+  tree rather than the call stack and even a degenerate tree of 1e8 nodes
+  can be checked. Each node is looked at exactly once. The walk stops as
+  soon as every requested property is known to fail, so a violation near
+  the start of a large tree costs almost nothing.
+
+  Depths count edges from the root, so the root itself is at depth 0.
+*/
+
+/**
+ * Properties that checkLeafPaths() can check, to be or'ed together
+ */
+enum LeafPathCheck
+{
+    LEAF_EQUAL_DEPTHS = 1,  // every leaf is at the same depth
+    LEAF_FULL = 2,          // every node has zero or two children
+    LEAF_COMPLETE = 4,      // every level is filled except the last, which is filled from the left
+    LEAF_PERFECT = 8,       // full with every leaf at the same depth
+    LEAF_DEPTH_RANGE = 16,  // report the minimum and maximum leaf depth (always walks the whole tree)
+    LEAF_ALL = 31
+};
+
+/**
+ * The result of checkLeafPaths(). A property that was not requested is
+ * reported as false. When the walk stopped early, nodes and leaves only
+ * count what was visited before it did.
+ */
+struct LeafPathReport
+{
+    bool equalDepths;
+    bool full;
+    bool complete;
+    bool perfect;
+    size_t minLeafDepth;    // with LEAF_DEPTH_RANGE, 0 for an empty tree
+    size_t maxLeafDepth;
+    size_t nodes;
+    size_t leaves;
+    bool stoppedEarly;
+};
+
+LeafPathReport checkLeafPaths(const Node* root, unsigned checks = LEAF_ALL);
+
+// Shorthands that only check (and stop early on) one property
+bool allLeavesSameDepth(const Node* root);
+bool isFullTree(const Node* root);
+bool isCompleteTree(const Node* root);
+bool isPerfectTree(const Node* root);
+
+#endif
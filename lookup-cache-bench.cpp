@@ -0,0 +1,58 @@
+#include <cstdio>
+#include <vector>
+#include "avlbst.h"
+#include "bench_util.h"
+
+using namespace std;
+
+// Measures find() with and without the hot-key lookup cache, for lookups
+// drawn from Zipf distributions of different skew over the tree's keys,
+// at a few cache sizes.
+// Usage: ./lookup-cache-bench [number of items] [number of lookups]
+
+typedef AVLTree<uint64_t, uint64_t> Tree;
+
+static volatile uint64_t sink; // Keeps the optimizer from dropping results
+
+double timeFind(const Tree& tree, const vector<uint64_t>& lookups)
+{
+    BenchTimer timer;
+    uint64_t sum = 0;
+    for (size_t i = 0; i < lookups.size(); i++)
+    {
+        Tree::iterator it = tree.find(lookups[i]);
+        if (it != tree.end()) sum += it->second;
+    }
+    sink = sum;
+    return timer.seconds();
+}
+
+int main(int argc, char* argv[])
+{
+    size_t n = benchSizeArg(argc, argv, 1, 1000000);
+    size_t lookups = benchSizeArg(argc, argv, 2, 4000000);
+
+    vector<uint64_t> keys = randomKeys(n, 42);
+    Tree tree;
+    for (size_t i = 0; i < n; i++) tree.insert(make_pair(keys[i], keys[i]));
+
+    const size_t sizes[] = { 256, 4096, 65536 };
+    const double skews[] = { 0.8, 1.0, 1.2 };
+    printf("%zu items, %zu lookups\n", n, lookups);
+    for (size_t s = 0; s < sizeof(skews) / sizeof(skews[0]); s++)
+    {
+        vector<uint64_t> pattern = zipfKeys(lookups, keys, skews[s], s + 1);
+        tree.setLookupCache(0);
+        double plain = timeFind(tree, pattern);
+        printf("  zipf %.1f  no cache %7.2f Mlookups/s\n", skews[s], lookups / plain / 1e6);
+        for (size_t c = 0; c < sizeof(sizes) / sizeof(sizes[0]); c++)
+        {
+            tree.setLookupCache(sizes[c]);
+            double cached = timeFind(tree, pattern);
+            LookupCacheStats stats = tree.lookupCacheStats();
+            printf("            %6zu slots %7.2f Mlookups/s  %5.2fx  hit rate %5.1f%%\n",
+                sizes[c], lookups / cached / 1e6, plain / cached, 100 * stats.hitRate());
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,138 @@
+#include <cstdio>
+#include <cstdlib>
+#include <map>
+#include <new>
+#include <string>
+#include <vector>
+#include "bst.h"
+#include "avlbst.h"
+#include "bench_util.h"
+
+using namespace std;
+
+// Reports the memory footprint of the trees while replaying a workload:
+// bytes per node, allocator overhead, heap fragmentation and peak usage.
+// Usage: ./memory-report [number of items]
+//
+// Every allocation in the program goes through the operator new below, so
+// the live and peak figures hold whatever allocator sits behind malloc.
+
+/*
+* Heap accounting shared by the replaced global operator new and delete
+*/
+struct HeapCounters
+{
+    size_t liveAllocated;
+    size_t peakAllocated;
+    size_t allocations;
+};
+
+static HeapCounters heap;
+
+static void* countedAlloc(size_t size)
+{
+    void* p = malloc(size ? size : 1);
+    if (!p) throw std::bad_alloc();
+    heap.liveAllocated += allocationSize(p, size);
+    heap.allocations++;
+    if (heap.liveAllocated > heap.peakAllocated) heap.peakAllocated = heap.liveAllocated;
+    return p;
+}
+
+static void countedFree(void* p)
+{
+    if (!p) return;
+    heap.liveAllocated -= allocationSize(p, 0);
+    free(p);
+}
+
+void* operator new(size_t size) { return countedAlloc(size); }
+void* operator new[](size_t size) { return countedAlloc(size); }
+void operator delete(void* p) noexcept { countedFree(p); }
+void operator delete[](void* p) noexcept { countedFree(p); }
+void operator delete(void* p, size_t) noexcept { countedFree(p); }
+void operator delete[](void* p, size_t) noexcept { countedFree(p); }
+
+/*
+* Returns the fraction of the heap's arena that is free but still held by
+* the allocator, or a negative number when the platform cannot say
+*/
+static double heapFragmentation()
+{
+#ifdef __GLIBC__
+#if __GLIBC_PREREQ(2, 33)
+    struct mallinfo2 info = mallinfo2();
+#else
+    struct mallinfo info = mallinfo(); // int counters, which wrap on heaps past 2 GiB
+#endif
+    return info.arena ? (double)info.fordblks / info.arena : 0.0;
+#else
+    return -1.0;
+#endif
+}
+
+/*
+* Adapters so the same replay can drive the trees and std::map
+*/
+template<typename Tree, typename Key>
+void eraseKey(Tree& tree, const Key& key) { tree.remove(key); }
+template<typename Key, typename Value>
+void eraseKey(map<Key, Value>& tree, const Key& key) { tree.erase(key); }
+
+template<typename Tree>
+void printUsage(const Tree& tree)
+{
+    TreeMemoryUsage usage = tree.memoryUsage();
+    printf("  node layout:         %zu bytes (%zu item + %zu links, balance and padding)\n",
+           usage.nodeSize, usage.itemSize, usage.linkBytesPerNode());
+    printf("  memoryUsage():       %zu nodes, %.1f bytes/node, %zu bytes allocator rounding\n",
+           usage.nodes, usage.bytesPerNode(), usage.allocatorOverheadBytes());
+}
+template<typename Key, typename Value>
+void printUsage(const map<Key, Value>&) {}
+
+/*
+* Inserts n keys, removes every other one, refills with fresh keys and
+* clears, reporting the heap after each phase
+*/
+template<typename Tree>
+void replay(const char* name, const vector<uint64_t>& keys, size_t n)
+{
+    printf("%s\n", name);
+    size_t baseline = heap.liveAllocated;
+    heap.peakAllocated = heap.liveAllocated;
+
+    {
+        Tree tree;
+        for (size_t i = 0; i < n; i++) tree.insert(make_pair((typename Tree::key_type)keys[i], (typename Tree::mapped_type)i));
+        size_t filled = heap.liveAllocated - baseline;
+        printf("  after %zu inserts:   %zu bytes live, %.1f bytes/item\n", n, filled, (double)filled / n);
+        printUsage(tree);
+
+        for (size_t i = 0; i < n; i += 2) eraseKey(tree, (typename Tree::key_type)keys[i]);
+        printf("  after %zu removes:   %zu bytes live, heap %.1f%% free-but-held\n",
+               (n + 1) / 2, heap.liveAllocated - baseline, 100 * heapFragmentation());
+
+        for (size_t i = n; i < n + n / 2; i++) tree.insert(make_pair((typename Tree::key_type)keys[i], (typename Tree::mapped_type)i));
+        printf("  after %zu refills:   %zu bytes live, heap %.1f%% free-but-held\n",
+               n / 2, heap.liveAllocated - baseline, 100 * heapFragmentation());
+
+        tree.clear();
+        printf("  after clear:         %zu bytes live\n", heap.liveAllocated - baseline);
+    }
+    printf("  peak:                %zu bytes\n\n", heap.peakAllocated - baseline);
+}
+
+int main(int argc, char* argv[])
+{
+    size_t n = benchSizeArg(argc, argv, 1, 1000000);
+    vector<uint64_t> keys = randomKeys(n + n / 2, 5);
+
+    replay<BinarySearchTree<uint64_t, uint64_t> >("BinarySearchTree<uint64_t, uint64_t>", keys, n);
+    replay<AVLTree<uint64_t, uint64_t> >("AVLTree<uint64_t, uint64_t>", keys, n);
+    replay<AVLTree<int, char> >("AVLTree<int, char>", keys, n);
+    replay<map<uint64_t, uint64_t> >("std::map<uint64_t, uint64_t>", keys, n);
+    printf("%zu allocations in total\n", heap.allocations);
+
+    return 0;
+}
@@ -0,0 +1,466 @@
+#ifndef ORDERED_CACHE_H
+#define ORDERED_CACHE_H
+
+#include <chrono>
+#include <cstdint>
+#include "avlbst.h"
+
+/*
+  Ordered LRU/TTL cache
+
+  OrderedCache keeps its entries in an AVLTree, so they can still be
+  scanned in key order, and threads two intrusive lists through the same
+  nodes: the recency order, least recently used first, and the expiry
+  order, soonest first. All entries share one time to live, so an entry
+  written later never expires earlier and the expiry order is simply the
+  order of the last writes. Keeping both lists costs four pointers and a
+  time point per node and no allocations besides the node itself.
+
+    put(key, value)   inserts or overwrites, O(log n); the entry becomes
+                      the most recent and its time to live restarts
+    get(key)          O(log n) lookup that makes a hit the most recent
+    touch(key)        get without the value, also restarting the TTL
+    expire()          removes every expired entry, O(log n) each, without
+                      looking at the ones that have not expired
+
+  When put() adds an entry to a full cache, it first drops an expired
+  entry if there is one, or else the least recently used. get() treats an
+  expired entry as a miss and removes it, so expire() only needs to run
+  to give back memory. Hits, misses, evictions and expirations are
+  counted per cache.
+
+    OrderedCache<std::string, Session> sessions(100000, std::chrono::minutes(30));
+    sessions.put(id, session);
+    if (Session* s = sessions.get(id)) ...
+
+  A capacity of 0 means no limit and a time to live of zero means entries
+  never expire. Iterating with begin()/end()/lower_bound() neither counts
+  nor refreshes anything and may still show expired entries. Clock can be
+  replaced, e.g. by a manual clock in tests.
+*/
+
+/**
+* Per-cache counters
+*/
+struct CacheStats
+{
+    uint64_t hits;
+    uint64_t misses;
+    uint64_t evictions;      // least recently used entries dropped to make room
+    uint64_t expirations;    // entries dropped because their time to live ran out
+};
+
+/**
+* Links of one intrusive list
+*/
+template<typename Node>
+struct CacheLinks
+{
+    Node* prev;
+    Node* next;
+};
+
+/**
+* An AVL node that is also on the recency and expiry lists of its cache
+*/
+template <typename Key, typename Value, typename TimePoint>
+class CacheNode : public AVLNode<Key, Value>
+{
+public:
+    CacheNode(const Key& key, const Value& value, AVLNode<Key, Value>* parent);
+    virtual ~CacheNode();
+
+    // Maintained by OrderedCache
+    CacheLinks<CacheNode> recency;
+    CacheLinks<CacheNode> expiry;
+    TimePoint expiresAt;
+};
+
+template<class Key, class Value, class TimePoint>
+CacheNode<Key, Value, TimePoint>::CacheNode(const Key& key, const Value& value, AVLNode<Key, Value>* parent) :
+    AVLNode<Key, Value>(key, value, parent), expiresAt()
+{
+    recency.prev = recency.next = nullptr;
+    expiry.prev = expiry.next = nullptr;
+}
+
+template<class Key, class Value, class TimePoint>
+CacheNode<Key, Value, TimePoint>::~CacheNode()
+{
+
+}
+
+template <class Key, class Value, class Compare = std::less<Key>, class Clock = std::chrono::steady_clock>
+class OrderedCache : protected AVLTree<Key, Value, Compare>
+{
+public:
+    typedef typename Clock::duration Duration;
+    typedef typename Clock::time_point TimePoint;
+    typedef typename BinarySearchTree<Key, Value, Compare>::iterator iterator;
+
+    explicit OrderedCache(size_t capacity, Duration ttl = Duration::zero(), const Compare& comp = Compare());
+    OrderedCache(const OrderedCache& other) = delete;
+    OrderedCache& operator=(const OrderedCache& other) = delete;
+
+    void put(const Key& key, const Value& value);
+    Value* get(const Key& key); // Null on a miss
+    const Value* peek(const Key& key) const; // Same, but without counting or refreshing
+    bool touch(const Key& key); // Makes the entry the most recent and restarts its time to live
+    bool erase(const Key& key);
+    size_t expire(); // Removes the expired entries, returning how many there were
+    void clear();
+
+    size_t size() const;
+    bool empty() const;
+    size_t capacity() const;
+    void setCapacity(size_t capacity); // Evicts down to the new capacity
+    Duration ttl() const;
+    CacheStats stats() const;
+    void resetStats();
+
+    // Key order scans, which leave the recency order alone
+    using BinarySearchTree<Key, Value, Compare>::begin;
+    using BinarySearchTree<Key, Value, Compare>::end;
+    using BinarySearchTree<Key, Value, Compare>::lower_bound;
+    using BinarySearchTree<Key, Value, Compare>::memoryUsage;
+
+protected:
+    typedef CacheNode<Key, Value, TimePoint> Entry;
+
+    struct List
+    {
+        Entry* head;
+        Entry* tail;
+    };
+
+    virtual Node<Key, Value>* createNode(const Key& key, const Value& value, Node<Key, Value>* parent) const override;
+    virtual size_t getNodeSize() const override;
+    virtual void removeNode(Node<Key, Value>* current) override; // Takes the entry off both lists first
+
+    Entry* _lookup(const Key& key) const; // The entry with key, expired or not
+    bool _expired(const Entry* entry, TimePoint now) const;
+    void _refresh(Entry* entry, bool restartTtl); // Moves entry to the back of the recency list and maybe the expiry list
+    void _makeRoom(); // Drops one entry, expired if possible, else the least recently used
+    static void _pushBack(List& list, Entry* entry, CacheLinks<Entry> Entry::* links);
+    static void _unlink(List& list, Entry* entry, CacheLinks<Entry> Entry::* links);
+
+    size_t capacity_;
+    Duration ttl_;
+    List recency_;  // least recently used first
+    List expiry_;   // soonest to expire first, only kept when ttl_ is set
+    CacheStats stats_;
+};
+
+/*
+  ------------------------------------------------
+  Begin implementations for the OrderedCache class.
+  ------------------------------------------------
+*/
+
+/**
+* Constructs an empty cache holding up to capacity entries (0 for no
+* limit), each for ttl after it was last written (zero for ever)
+*/
+template<class Key, class Value, class Compare, class Clock>
+OrderedCache<Key, Value, Compare, Clock>::OrderedCache(size_t capacity, Duration ttl, const Compare& comp) :
+    AVLTree<Key, Value, Compare>(comp), capacity_(capacity), ttl_(ttl)
+{
+    recency_.head = recency_.tail = nullptr;
+    expiry_.head = expiry_.tail = nullptr;
+    resetStats();
+}
+
+/**
+* Inserts or overwrites the entry for key. A new entry in a full cache
+* first makes room by dropping another one.
+*/
+template<class Key, class Value, class Compare, class Clock>
+void OrderedCache<Key, Value, Compare, Clock>::put(const Key& key, const Value& value)
+{
+    BST_TIMED(TREE_TIME_INSERT);
+    AVLNode<Key, Value>* parent;
+    bool goLeft;
+    size_t depth;
+    for (;;)
+    {
+        AVLNode<Key, Value>* current = static_cast<AVLNode<Key, Value>*>(this->root_);
+        AVLNode<Key, Value>* candidate = nullptr; // Last node whose key is not less than key
+        parent = nullptr;
+        goLeft = false;
+        depth = 0;
+        while (current)
+        {
+            depth++;
+            parent = current;
+            goLeft = !this->comp_(current->getKey(), key);
+            if (goLeft) candidate = current;
+            current = goLeft ? current->getLeft() : current->getRight();
+        }
+        BST_STAT(treeStatsRecordSearch(depth, depth + (candidate ? 1 : 0)));
+
+        if (candidate && !this->comp_(key, candidate->getKey()))
+        {
+            candidate->setValue(value);
+            _refresh(static_cast<Entry*>(candidate), true);
+            return;
+        }
+        if (!capacity_ || this->size_ < capacity_) break;
+
+        // Dropping an entry may rotate the tree under the path just found
+        _makeRoom();
+    }
+
+    Entry* entry;
+    if (!parent)
+    {
+        AVLTree<Key, Value, Compare>::insert(std::make_pair(key, value));
+        entry = static_cast<Entry*>(this->root_);
+    }
+    else entry = static_cast<Entry*>(this->_insertLeaf(parent, goLeft, std::make_pair(key, value), depth));
+    _refresh(entry, true);
+}
+
+/**
+* Returns the value for key and makes it the most recent entry, or null
+* if there is none or it has expired (an expired entry is removed)
+*/
+template<class Key, class Value, class Compare, class Clock>
+Value* OrderedCache<Key, Value, Compare, Clock>::get(const Key& key)
+{
+    BST_TIMED(TREE_TIME_FIND);
+    Entry* entry = _lookup(key);
+    if (entry && ttl_ != Duration::zero() && _expired(entry, Clock::now()))
+    {
+        this->_eraseNode(entry);
+        stats_.expirations++;
+        entry = nullptr;
+    }
+    if (!entry)
+    {
+        stats_.misses++;
+        return nullptr;
+    }
+
+    stats_.hits++;
+    _refresh(entry, false);
+    return &entry->getValue();
+}
+
+template<class Key, class Value, class Compare, class Clock>
+const Value* OrderedCache<Key, Value, Compare, Clock>::peek(const Key& key) const
+{
+    Entry* entry = _lookup(key);
+    if (!entry || (ttl_ != Duration::zero() && _expired(entry, Clock::now()))) return nullptr;
+    return &entry->getValue();
+}
+
+/**
+* Returns false, without counting a miss, if there is no live entry for key
+*/
+template<class Key, class Value, class Compare, class Clock>
+bool OrderedCache<Key, Value, Compare, Clock>::touch(const Key& key)
+{
+    Entry* entry = _lookup(key);
+    if (!entry) return false;
+    if (ttl_ != Duration::zero() && _expired(entry, Clock::now()))
+    {
+        this->_eraseNode(entry);
+        stats_.expirations++;
+        return false;
+    }
+
+    _refresh(entry, true);
+    return true;
+}
+
+template<class Key, class Value, class Compare, class Clock>
+bool OrderedCache<Key, Value, Compare, Clock>::erase(const Key& key)
+{
+    BST_TIMED(TREE_TIME_REMOVE);
+    Entry* entry = _lookup(key);
+    if (!entry) return false;
+
+    this->_eraseNode(entry);
+    return true;
+}
+
+/**
+* Pops expired entries off the front of the expiry list, stopping at the
+* first one that is still live
+*/
+template<class Key, class Value, class Compare, class Clock>
+size_t OrderedCache<Key, Value, Compare, Clock>::expire()
+{
+    if (ttl_ == Duration::zero()) return 0;
+
+    TimePoint now = Clock::now();
+    size_t expired = 0;
+    while (expiry_.head && _expired(expiry_.head, now))
+    {
+        this->_eraseNode(expiry_.head);
+        expired++;
+    }
+    stats_.expirations += expired;
+    return expired;
+}
+
+/**
+* Removes every entry; the counters are kept
+*/
+template<class Key, class Value, class Compare, class Clock>
+void OrderedCache<Key, Value, Compare, Clock>::clear()
+{
+    AVLTree<Key, Value, Compare>::clear();
+    recency_.head = recency_.tail = nullptr;
+    expiry_.head = expiry_.tail = nullptr;
+}
+
+template<class Key, class Value, class Compare, class Clock>
+size_t OrderedCache<Key, Value, Compare, Clock>::size() const
+{
+    return this->size_;
+}
+
+template<class Key, class Value, class Compare, class Clock>
+bool OrderedCache<Key, Value, Compare, Clock>::empty() const
+{
+    return this->size_ == 0;
+}
+
+template<class Key, class Value, class Compare, class Clock>
+size_t OrderedCache<Key, Value, Compare, Clock>::capacity() const
+{
+    return capacity_;
+}
+
+template<class Key, class Value, class Compare, class Clock>
+void OrderedCache<Key, Value, Compare, Clock>::setCapacity(size_t capacity)
+{
+    capacity_ = capacity;
+    while (capacity_ && this->size_ > capacity_) _makeRoom();
+}
+
+template<class Key, class Value, class Compare, class Clock>
+typename OrderedCache<Key, Value, Compare, Clock>::Duration OrderedCache<Key, Value, Compare, Clock>::ttl() const
+{
+    return ttl_;
+}
+
+template<class Key, class Value, class Compare, class Clock>
+CacheStats OrderedCache<Key, Value, Compare, Clock>::stats() const
+{
+    return stats_;
+}
+
+template<class Key, class Value, class Compare, class Clock>
+void OrderedCache<Key, Value, Compare, Clock>::resetStats()
+{
+    stats_.hits = stats_.misses = stats_.evictions = stats_.expirations = 0;
+}
+
+template<class Key, class Value, class Compare, class Clock>
+Node<Key, Value>* OrderedCache<Key, Value, Compare, Clock>::createNode(const Key& key, const Value& value, Node<Key, Value>* parent) const
+{
+    return new Entry(key, value, static_cast<AVLNode<Key, Value>*>(parent));
+}
+
+template<class Key, class Value, class Compare, class Clock>
+size_t OrderedCache<Key, Value, Compare, Clock>::getNodeSize() const
+{
+    return sizeof(Entry);
+}
+
+/**
+* The AVL remove may swap the node with its predecessor in the tree, but
+* frees only this node, so the other entries keep their list positions
+*/
+template<class Key, class Value, class Compare, class Clock>
+void OrderedCache<Key, Value, Compare, Clock>::removeNode(Node<Key, Value>* current)
+{
+    Entry* entry = static_cast<Entry*>(current);
+    _unlink(recency_, entry, &Entry::recency);
+    if (ttl_ != Duration::zero()) _unlink(expiry_, entry, &Entry::expiry);
+    AVLTree<Key, Value, Compare>::removeNode(current);
+}
+
+template<class Key, class Value, class Compare, class Clock>
+typename OrderedCache<Key, Value, Compare, Clock>::Entry* OrderedCache<Key, Value, Compare, Clock>::_lookup(const Key& key) const
+{
+    return static_cast<Entry*>(this->_internalFind(this->root_, key));
+}
+
+template<class Key, class Value, class Compare, class Clock>
+bool OrderedCache<Key, Value, Compare, Clock>::_expired(const Entry* entry, TimePoint now) const
+{
+    return !(now < entry->expiresAt);
+}
+
+/*
+* Helper for put, get and touch
+* An entry that is already on the lists is moved rather than added
+*/
+template<class Key, class Value, class Compare, class Clock>
+void OrderedCache<Key, Value, Compare, Clock>::_refresh(Entry* entry, bool restartTtl)
+{
+    if (recency_.tail != entry)
+    {
+        if (entry->recency.next) _unlink(recency_, entry, &Entry::recency);
+        _pushBack(recency_, entry, &Entry::recency);
+    }
+    if (!restartTtl || ttl_ == Duration::zero()) return;
+
+    entry->expiresAt = Clock::now() + ttl_;
+    if (expiry_.tail != entry)
+    {
+        if (entry->expiry.next) _unlink(expiry_, entry, &Entry::expiry);
+        _pushBack(expiry_, entry, &Entry::expiry);
+    }
+}
+
+/*
+* Helper for put and setCapacity
+*/
+template<class Key, class Value, class Compare, class Clock>
+void OrderedCache<Key, Value, Compare, Clock>::_makeRoom()
+{
+    if (ttl_ != Duration::zero() && expiry_.head && _expired(expiry_.head, Clock::now()))
+    {
+        this->_eraseNode(expiry_.head);
+        stats_.expirations++;
+    }
+    else if (recency_.head)
+    {
+        this->_eraseNode(recency_.head);
+        stats_.evictions++;
+    }
+}
+
+template<class Key, class Value, class Compare, class Clock>
+void OrderedCache<Key, Value, Compare, Clock>::_pushBack(List& list, Entry* entry, CacheLinks<Entry> Entry::* links)
+{
+    (entry->*links).prev = list.tail;
+    (entry->*links).next = nullptr;
+    if (list.tail) (list.tail->*links).next = entry;
+    else list.head = entry;
+    list.tail = entry;
+}
+
+template<class Key, class Value, class Compare, class Clock>
+void OrderedCache<Key, Value, Compare, Clock>::_unlink(List& list, Entry* entry, CacheLinks<Entry> Entry::* links)
+{
+    Entry* prev = (entry->*links).prev;
+    Entry* next = (entry->*links).next;
+    if (prev) (prev->*links).next = next;
+    else list.head = next;
+    if (next) (next->*links).prev = prev;
+    else list.tail = prev;
+    (entry->*links).prev = (entry->*links).next = nullptr;
+}
+
+/*
+  ----------------------------------------------
+  End implementations for the OrderedCache class.
+  ----------------------------------------------
+*/
+
+#endif
@@ -0,0 +1,75 @@
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+#include "avlbst.h"
+#include "prefix_key.h"
+#include "bench_util.h"
+
+using namespace std;
+
+// Compares lookups in an AVLTree keyed by std::string against one keyed by
+// PrefixKey, on URL-like and identifier-like keys.
+// Usage: ./prefix-key-bench [number of keys] [number of lookups]
+
+static const char* hosts[] = { "news.example.com", "shop.example.org", "api.internal.net", "cdn.static.io",
+                               "mail.example.com", "docs.project.dev", "www.video.tv", "blog.writer.me" };
+
+vector<string> urlKeys(size_t n, mt19937_64& rng)
+{
+    vector<string> keys;
+    for (size_t i = 0; i < n; i++)
+    {
+        keys.push_back(string("https://") + hosts[rng() % 8] + "/item/" + to_string(rng() % 100000000) + "?ref=" + to_string(rng() % 1000));
+    }
+    return keys;
+}
+
+vector<string> identifierKeys(size_t n, mt19937_64& rng)
+{
+    vector<string> keys;
+    for (size_t i = 0; i < n; i++)
+    {
+        keys.push_back("user:" + to_string(rng() % 10000000) + ":session:" + to_string(rng() % 100000));
+    }
+    return keys;
+}
+
+void runBench(const char* name, const vector<string>& keys, size_t lookups)
+{
+    mt19937_64 rng(11);
+    vector<size_t> probes(lookups);
+    for (size_t i = 0; i < lookups; i++) probes[i] = rng() % keys.size();
+
+    AVLTree<string, int, TransparentLess> plain;
+    AVLTree<PrefixKey, int, PrefixKeyLess> prefixed;
+    for (size_t i = 0; i < keys.size(); i++)
+    {
+        plain.insert(make_pair(keys[i], (int)i));
+        prefixed.insert(make_pair(PrefixKey(keys[i]), (int)i));
+    }
+
+    long found = 0;
+    BenchTimer timer;
+    for (size_t i = 0; i < lookups; i++) found += plain.find(keys[probes[i]]) != plain.end();
+    double plainTime = timer.seconds();
+
+    timer.restart();
+    for (size_t i = 0; i < lookups; i++) found += prefixed.find(PrefixKeyView(keys[probes[i]])) != prefixed.end();
+    double prefixTime = timer.seconds();
+
+    cout << name << " (" << keys.size() << " keys, " << found << " hits)" << endl;
+    cout << "  std::string keys: " << plainTime * 1e9 / lookups << " ns/lookup" << endl;
+    cout << "  PrefixKey keys:   " << prefixTime * 1e9 / lookups << " ns/lookup" << endl;
+}
+
+int main(int argc, char* argv[])
+{
+    size_t n = benchSizeArg(argc, argv, 1, 1000000);
+    size_t lookups = benchSizeArg(argc, argv, 2, 2000000);
+    mt19937_64 rng(5);
+
+    runBench("URLs", urlKeys(n, rng), lookups);
+    runBench("identifiers", identifierKeys(n, rng), lookups);
+    return 0;
+}
@@ -0,0 +1,161 @@
+#ifndef PREFIX_KEY_H
+#define PREFIX_KEY_H
+
+#include <cstdint>
+#include <cstring>
+#include <ostream>
+#include <string>
+#include "stream_codec.h"
+
+/*
+  String keys with an inline, normalized prefix
+
+  A tree of std::string keys pays two dependent cache misses per level:
+  one for the node and one for the string's heap buffer. BasicPrefixKey
+  keeps the first 8 * Words bytes of the string inside the key (and so
+  inside the node) as big-endian integers, zero padded. Comparing those
+  integers orders keys exactly like comparing the bytes, so most
+  comparisons finish without touching the heap buffer; the full string is
+  only compared when the prefixes tie.
+
+  Lookups should go through BasicPrefixKeyView, which computes the probe's
+  prefix once and points at the caller's characters without copying them.
+  Use PrefixKeyLess as the tree's Compare to enable those lookups:
+
+    AVLTree<PrefixKey, int, PrefixKeyLess> tree;
+    tree.find(PrefixKeyView("https://example.com/"));
+*/
+
+/*
+* Loads the first 8 * Words bytes of data as big-endian words, zero padded
+*/
+template <unsigned Words>
+inline void loadKeyPrefix(uint64_t (&prefix)[Words], const char* data, size_t size)
+{
+    for (unsigned w = 0; w < Words; w++)
+    {
+        uint64_t word = 0;
+        for (unsigned b = 0; b < 8; b++)
+        {
+            size_t i = w * 8 + b;
+            word = (word << 8) | (i < size ? (unsigned char)data[i] : 0);
+        }
+        prefix[w] = word;
+    }
+}
+
+/*
+* Three-way comparison of two prefixed strings, looking at the characters
+* only when the cached prefixes are equal
+*/
+template <unsigned Words>
+inline int comparePrefixedKeys(const uint64_t (&pa)[Words], const char* a, size_t aSize,
+                               const uint64_t (&pb)[Words], const char* b, size_t bSize)
+{
+    for (unsigned w = 0; w < Words; w++)
+    {
+        if (pa[w] != pb[w]) return pa[w] < pb[w] ? -1 : 1;
+    }
+
+    // Equal prefixes mean equal leading bytes, unless zero padding hid a length difference
+    size_t skip = (aSize >= 8 * Words && bSize >= 8 * Words) ? 8 * Words : 0;
+    size_t common = (aSize < bSize ? aSize : bSize) - skip;
+    int result = common ? std::memcmp(a + skip, b + skip, common) : 0;
+    if (result) return result;
+    return aSize < bSize ? -1 : (aSize > bSize ? 1 : 0);
+}
+
+/**
+* A non-owning probe for looking up BasicPrefixKeys without allocating
+*/
+template <unsigned Words>
+class BasicPrefixKeyView
+{
+public:
+    BasicPrefixKeyView(const char* s) : data_(s), size_(std::strlen(s)) { loadKeyPrefix(prefix_, data_, size_); }
+    BasicPrefixKeyView(const std::string& s) : data_(s.data()), size_(s.size()) { loadKeyPrefix(prefix_, data_, size_); }
+
+    const char* data() const { return data_; }
+    size_t size() const { return size_; }
+    const uint64_t (&prefix() const)[Words] { return prefix_; }
+
+private:
+    uint64_t prefix_[Words];
+    const char* data_;
+    size_t size_;
+};
+
+/**
+* A string key that caches its normalized leading bytes inline
+*/
+template <unsigned Words>
+class BasicPrefixKey
+{
+public:
+    BasicPrefixKey() : key_() { loadKeyPrefix(prefix_, key_.data(), 0); }
+    BasicPrefixKey(const std::string& s) : key_(s) { loadKeyPrefix(prefix_, key_.data(), key_.size()); }
+    BasicPrefixKey(const char* s) : key_(s) { loadKeyPrefix(prefix_, key_.data(), key_.size()); }
+
+    const std::string& str() const { return key_; }
+    const char* data() const { return key_.data(); }
+    size_t size() const { return key_.size(); }
+    const uint64_t (&prefix() const)[Words] { return prefix_; }
+
+    template <typename Other>
+    int compare(const Other& other) const
+    {
+        return comparePrefixedKeys<Words>(prefix_, key_.data(), key_.size(), other.prefix(), other.data(), other.size());
+    }
+
+    bool operator<(const BasicPrefixKey& rhs) const { return compare(rhs) < 0; }
+    bool operator>(const BasicPrefixKey& rhs) const { return compare(rhs) > 0; }
+    bool operator==(const BasicPrefixKey& rhs) const { return compare(rhs) == 0; }
+    bool operator!=(const BasicPrefixKey& rhs) const { return compare(rhs) != 0; }
+
+private:
+    uint64_t prefix_[Words];
+    std::string key_;
+};
+
+template <unsigned Words>
+std::ostream& operator<<(std::ostream& out, const BasicPrefixKey<Words>& key)
+{
+    return out << key.str();
+}
+
+/**
+* Transparent comparator for prefix keys and their views
+*/
+template <unsigned Words>
+struct BasicPrefixKeyLess
+{
+    typedef void is_transparent;
+
+    bool operator()(const BasicPrefixKey<Words>& a, const BasicPrefixKey<Words>& b) const { return a.compare(b) < 0; }
+    bool operator()(const BasicPrefixKey<Words>& a, const BasicPrefixKeyView<Words>& b) const { return a.compare(b) < 0; }
+    bool operator()(const BasicPrefixKeyView<Words>& a, const BasicPrefixKey<Words>& b) const { return b.compare(a) > 0; }
+};
+
+// 16 cached bytes fit the host part of most URLs and the scope of most identifiers
+typedef BasicPrefixKey<2> PrefixKey;
+typedef BasicPrefixKeyView<2> PrefixKeyView;
+typedef BasicPrefixKeyLess<2> PrefixKeyLess;
+
+/**
+* Streams prefix keys as plain strings; the prefix is rebuilt on read
+*/
+template <unsigned Words>
+struct StreamCodec<BasicPrefixKey<Words> >
+{
+    static void write(std::ostream& out, const BasicPrefixKey<Words>& item)
+    {
+        StreamCodec<std::string>::write(out, item.str());
+    }
+
+    static BasicPrefixKey<Words> read(std::istream& in)
+    {
+        return BasicPrefixKey<Words>(StreamCodec<std::string>::read(in));
+    }
+};
+
+#endif
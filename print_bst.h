@@ -1,6 +1,6 @@
 #include <cmath>
 #include <iomanip>
-#include <map>
+#include <algorithm>
 #include <vector>
 #include <cstdint>
 
@@ -13,34 +13,6 @@
 // maximum depth of tree to actually print.
 #define PPBST_MAX_HEIGHT 6
 
-// Returns the node's distance from the given root.
-// 1 means that it is the root.
-// Returns -1 (not found) if the distance is more than PPBST_MAX_HEIGHT,
-// or -2 if the tree is inconsistent.
-template<typename Key, typename Value>
-int getNodeDepth(BinarySearchTree<Key, Value> const & tree, Node<Key, Value> * root, Node<Key, Value> * node)
-{
-    int dist = 1;
-
-    while(node != root)
-    {
-        if(node == nullptr)
-        {
-            return -2;
-        }
-
-        ++dist;
-        node = node->getParent();
-
-        if(dist > PPBST_MAX_HEIGHT)
-        {
-            return -1;
-        }
-    }
-
-    return dist;
-}
-
 // Returns the height of the subtree at root.
 // Uses recursion, not height values, so it is bulletproof
 // against incorrect heights.
@@ -92,8 +64,8 @@ int getSubtreeHeight(Node<Key, Value> * root, int recursionDepth = 1)
 
     */
 
-template<typename Key, typename Value>
-void BinarySearchTree<Key, Value>::printRoot (Node<Key, Value>* root) const
+template<typename Key, typename Value, typename Compare>
+void BinarySearchTree<Key, Value, Compare>::printRoot (Node<Key, Value>* root) const
 {
     // special case for empty trees:
     if(root == nullptr)
@@ -127,19 +99,37 @@ void BinarySearchTree<Key, Value>::printRoot (Node<Key, Value>* root) const
 
     // get placeholders
     // ----------------------------------------------------------------------
-    std::map<Key, uint8_t> valuePlaceholders;
-
-    uint8_t nextPlaceHolderVal = 1;
-    for(typename BinarySearchTree<Key, Value>::iterator treeIter = this->begin(); treeIter != this->end(); ++treeIter)
+    // Only the printed levels get one, so walk just those levels in order
+    // with an explicit stack instead of iterating over the whole tree.
+    // The stack never holds more than PPBST_MAX_HEIGHT nodes, which also
+    // keeps a broken tree with a cycle from looping forever.
+    std::vector<Node<Key, Value>*> valuePlaceholders; // printed nodes in key order; placeholder = index + 1
+    std::vector<std::pair<Node<Key, Value>*, uint32_t> > placeholderStack;
+    Node<Key, Value>* walkNode = root;
+    uint32_t walkDepth = 1;
+    while(walkNode != nullptr || !placeholderStack.empty())
     {
-
-        if(getNodeDepth(*this, root, treeIter.current_) != -1)
+        while(walkNode != nullptr && walkDepth <= printedTreeHeight)
+        {
+            placeholderStack.push_back(std::make_pair(walkNode, walkDepth));
+            walkNode = walkNode->getLeft();
+            ++walkDepth;
+        }
+        if(placeholderStack.empty())
         {
-            // note; the iterator will traverse in sorted order so values should get the same placeholders between
-            // different calls as long as the tree is the same
-            valuePlaceholders.insert(std::make_pair(treeIter->first, nextPlaceHolderVal++));
+            break; // only nodes below the printed levels were left
         }
 
+        walkNode = placeholderStack.back().first;
+        walkDepth = placeholderStack.back().second;
+        placeholderStack.pop_back();
+
+        // note; nodes are visited in sorted order so values should get the same placeholders between
+        // different calls as long as the tree is the same
+        valuePlaceholders.push_back(walkNode);
+
+        walkNode = walkNode->getRight();
+        ++walkDepth;
     }
 
     // print tree
@@ -167,7 +157,7 @@ void BinarySearchTree<Key, Value>::printRoot (Node<Key, Value>* root) const
             }
             else
             {
-                uint16_t placeholder = valuePlaceholders[currRowNodes[elementIndex]->getItem().first];
+                uint16_t placeholder = (uint16_t)(std::find(valuePlaceholders.begin(), valuePlaceholders.end(), currRowNodes[elementIndex]) - valuePlaceholders.begin() + 1);
                 std::cout << "[" << std::setfill('0') << std::setw(2) << placeholder << "]";
             }
 
@@ -265,27 +255,13 @@ void BinarySearchTree<Key, Value>::printRoot (Node<Key, Value>* root) const
     if(!std::is_same<Key, uint8_t>::value) // print placeholder explanations if needed:
     {
         std::cout << "Tree Placeholders:------------------" << std::endl;
-        for(typename std::map<Key, uint8_t>::iterator placeholdersIter = valuePlaceholders.begin(); placeholdersIter != valuePlaceholders.end(); ++placeholdersIter)
+        for(size_t placeholderIndex = 0; placeholderIndex < valuePlaceholders.size(); ++placeholderIndex)
         {
-            std::cout << '[' << std::setfill('0') << std::setw(2) << ((uint16_t)placeholdersIter->second) << "] -> ";
+            std::cout << '[' << std::setfill('0') << std::setw(2) << (placeholderIndex + 1) << "] -> ";
 
             // print element with original cout flags
             std::cout.flags(origCoutState);
-            std::cout << '(' << placeholdersIter->first << ", ";
-
-            typename BinarySearchTree<Key, Value>::iterator elementIter = this->find(placeholdersIter->first);
-            if(elementIter == this->end())
-            {
-                std::cout << "<error: lookup failed>";
-            }
-            else
-            {
-                std::cout << elementIter->second;
-            }
-
-            std::cout << ')' << std::endl;
-
-
+            std::cout << '(' << valuePlaceholders[placeholderIndex]->getKey() << ", " << valuePlaceholders[placeholderIndex]->getValue() << ')' << std::endl;
         }
     }
 
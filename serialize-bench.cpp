@@ -0,0 +1,56 @@
+#include <iostream>
+#include <sstream>
+#include <string>
+#include "bst.h"
+#include "avlbst.h"
+#include "bench_util.h"
+
+using namespace std;
+
+// Measures stream serialization throughput of an AVLTree in MB/s.
+// Usage: ./serialize-bench [number of items]
+
+template<typename Key, typename Value>
+void runBench(const char* name, AVLTree<Key, Value>& tree, size_t n)
+{
+    BenchTimer timer;
+    stringstream buffer;
+    tree.serialize(buffer);
+    double writeTime = timer.seconds();
+    string bytes = buffer.str();
+    double mb = bytes.size() / (1024.0 * 1024.0);
+
+    stringstream in(bytes);
+    AVLTree<Key, Value> copy;
+    timer.restart();
+    copy.deserialize(in);
+    double readTime = timer.seconds();
+
+    stringstream filtered(bytes);
+    AVLTree<Key, Value> half;
+    size_t seen = 0;
+    timer.restart();
+    half.deserialize(filtered, [&seen](const Key&) { return (seen++ & 1) == 0; });
+    double filterTime = timer.seconds();
+
+    cout << name << ": " << n << " items, " << mb << " MB" << endl;
+    cout << "  serialize:          " << mb / writeTime << " MB/s" << endl;
+    cout << "  deserialize:        " << mb / readTime << " MB/s" << endl;
+    cout << "  deserialize (1/2):  " << mb / filterTime << " MB/s" << endl;
+}
+
+int main(int argc, char* argv[])
+{
+    size_t n = benchSizeArg(argc, argv, 1, 1000000);
+    vector<uint64_t> keys = randomKeys(n, 42);
+
+    AVLTree<uint64_t, uint64_t> numeric;
+    for (size_t i = 0; i < n; i++) numeric.insert(make_pair(keys[i], (uint64_t)i));
+    runBench("uint64_t -> uint64_t", numeric, n);
+
+    AVLTree<string, string> text;
+    for (size_t i = 0; i < n; i++) text.insert(make_pair("key/" + to_string(keys[i]), "value-" + to_string(i)));
+    runBench("string -> string", text, n);
+
+    return 0;
+}
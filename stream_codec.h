@@ -0,0 +1,92 @@
+#ifndef STREAM_CODEC_H
+#define STREAM_CODEC_H
+
+#include <cstdint>
+#include <istream>
+#include <ostream>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+
+/*
+  Codecs tell the stream serializer how to turn a key or value into bytes.
+  A codec is any type with two static functions:
+
+    static void write(std::ostream& out, const T& item);
+    static T read(std::istream& in);   // throws std::runtime_error on a short read
+
+  StreamCodec<T> handles trivially copyable types (copied byte for byte in
+  native layout) and std::string (length prefixed). Specialize it, or pass
+  your own codec type, for anything else.
+*/
+
+/*
+* Reads exactly size bytes or throws
+*/
+inline void readStreamBytes(std::istream& in, void* dest, size_t size)
+{
+    in.read(static_cast<char*>(dest), (std::streamsize)size);
+    if ((size_t)in.gcount() != size) throw std::runtime_error("Unexpected end of tree stream");
+}
+
+template <typename T, typename Enable = void>
+struct StreamCodec;
+
+/**
+* Copies trivially copyable items byte for byte
+*/
+template <typename T>
+struct StreamCodec<T, typename std::enable_if<std::is_trivially_copyable<T>::value>::type>
+{
+    static void write(std::ostream& out, const T& item)
+    {
+        out.write(reinterpret_cast<const char*>(&item), sizeof(T));
+    }
+
+    static T read(std::istream& in)
+    {
+        T item;
+        readStreamBytes(in, static_cast<void*>(&item), sizeof(T));
+        return item;
+    }
+};
+
+/**
+* Writes strings as a 32-bit length followed by the characters. Strings of
+* 4 GiB or more throw std::length_error. Reads take the characters in
+* chunks, so a damaged length costs no more memory than the stream holds
+* before it runs out.
+*/
+template <>
+struct StreamCodec<std::string>
+{
+    static const size_t readChunk = 64 * 1024;
+
+    static void write(std::ostream& out, const std::string& item)
+    {
+        if (item.size() > UINT32_MAX) throw std::length_error("String too long for a tree stream");
+
+        uint32_t len = (uint32_t)item.size();
+        out.write(reinterpret_cast<const char*>(&len), sizeof(len));
+        out.write(item.data(), (std::streamsize)len);
+    }
+
+    static std::string read(std::istream& in)
+    {
+        uint32_t len;
+        readStreamBytes(in, &len, sizeof(len));
+
+        std::string item;
+        while (item.size() < len)
+        {
+            size_t done = item.size();
+            size_t chunk = len - done;
+            if (chunk > readChunk) chunk = readChunk;
+            item.resize(done + chunk);
+            readStreamBytes(in, &item[done], chunk);
+        }
+        return item;
+    }
+};
+
+#endif
@@ -0,0 +1,148 @@
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include "bst.h"
+#include "avlbst.h"
+#include "bst_trace.h"
+#include "bench_util.h"
+
+using namespace std;
+
+// Replays a recorded workload trace (see bst_trace.h) and reports latency
+// percentiles per operation.
+//
+// Usage: ./trace-replay <trace> [bst|avl|map|all]
+//        ./trace-replay --record <trace> [number of operations]
+//
+// Traces must hold uint64_t keys and values. --record writes a synthetic
+// mixed workload through a TracingTree, which is handy as a starting point.
+
+typedef TraceRecord<uint64_t, uint64_t> Record;
+
+static volatile uint64_t sink; // Keeps the optimizer from dropping lookups
+
+/*
+* Adapters so the same replay loop can drive the trees and std::map
+*/
+template<typename Tree>
+void applyInsert(Tree& tree, const Record& r) { tree.insert(make_pair(r.key, r.value)); }
+template<typename Tree>
+void applyRemove(Tree& tree, const Record& r) { tree.remove(r.key); }
+template<typename Tree>
+uint64_t applyAccess(Tree& tree, const Record& r)
+{
+    try { return tree[r.key]; }
+    catch (const out_of_range&) { return 0; }
+}
+
+void applyInsert(map<uint64_t, uint64_t>& tree, const Record& r) { tree[r.key] = r.value; }
+void applyRemove(map<uint64_t, uint64_t>& tree, const Record& r) { tree.erase(r.key); }
+uint64_t applyAccess(map<uint64_t, uint64_t>& tree, const Record& r)
+{
+    try { return tree.at(r.key); }
+    catch (const out_of_range&) { return 0; }
+}
+
+/*
+* Runs the whole trace against a fresh Tree, timing every operation
+*/
+template<typename Tree>
+void replay(const char* name, const vector<Record>& trace)
+{
+    Tree tree;
+    LatencyHistogram latencies[4];
+    const char* names[4] = { "  insert", "  remove", "  find", "  access" };
+    uint64_t sum = 0;
+
+    BenchTimer total;
+    for (size_t i = 0; i < trace.size(); i++)
+    {
+        const Record& r = trace[i];
+        int kind;
+        chrono::steady_clock::time_point start = chrono::steady_clock::now();
+        switch (r.op)
+        {
+        case TRACE_INSERT: applyInsert(tree, r); kind = 0; break;
+        case TRACE_REMOVE: applyRemove(tree, r); kind = 1; break;
+        case TRACE_FIND: sum += tree.find(r.key) != tree.end(); kind = 2; break;
+        default: sum += applyAccess(tree, r); kind = 3; break;
+        }
+        latencies[kind].record((uint64_t)chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now() - start).count());
+    }
+    sink = sum;
+
+    printf("%s: %zu ops in %.3f s\n", name, trace.size(), total.seconds());
+    for (int k = 0; k < 4; k++)
+    {
+        if (latencies[k].count()) latencies[k].writeText(cout, names[k]);
+    }
+}
+
+/*
+* Writes a synthetic trace: a fill phase followed by a skewed mix of
+* lookups, accesses, inserts and removes
+*/
+void record(const char* path, size_t ops)
+{
+    ofstream out(path, ios::binary);
+    if (!out) throw runtime_error(string("Cannot create ") + path);
+
+    size_t fill = ops / 4;
+    vector<uint64_t> keys = randomKeys(fill + 1, 11);
+    mt19937_64 rng(13);
+    TracingTree<AVLTree<uint64_t, uint64_t> > tree;
+    tree.startTrace(out);
+    for (size_t i = 0; i < fill; i++) tree.insert(make_pair(keys[i], (uint64_t)i));
+    for (size_t i = fill; i < ops; i++)
+    {
+        uint64_t key = keys[rng() % keys.size()];
+        unsigned dice = rng() % 100;
+        if (dice < 60) tree.find(key);
+        else if (dice < 75) { try { tree[key]++; } catch (const out_of_range&) {} }
+        else if (dice < 90) tree.insert(make_pair(key, (uint64_t)i));
+        else tree.remove(key);
+    }
+    tree.stopTrace();
+    if (!out.flush()) throw runtime_error(string("Cannot write ") + path);
+}
+
+int main(int argc, char* argv[])
+{
+    if (argc < 2 || (strcmp(argv[1], "--record") == 0 && argc < 3))
+    {
+        fprintf(stderr, "usage: %s <trace> [bst|avl|map|all]\n       %s --record <trace> [ops]\n", argv[0], argv[0]);
+        return 1;
+    }
+
+    try
+    {
+        if (strcmp(argv[1], "--record") == 0)
+        {
+            record(argv[2], benchSizeArg(argc, argv, 3, 1000000));
+            return 0;
+        }
+
+        ifstream in(argv[1], ios::binary);
+        if (!in) throw runtime_error(string("Cannot open ") + argv[1]);
+        vector<Record> trace = readTrace<uint64_t, uint64_t>(in);
+        string which = argc > 2 ? argv[2] : "all";
+
+        if (which == "bst" || which == "all") replay<BinarySearchTree<uint64_t, uint64_t> >("BinarySearchTree", trace);
+        if (which == "avl" || which == "all") replay<AVLTree<uint64_t, uint64_t> >("AVLTree", trace);
+        if (which == "map" || which == "all") replay<map<uint64_t, uint64_t> >("std::map", trace);
+    }
+    catch (const exception& e)
+    {
+        fprintf(stderr, "%s\n", e.what());
+        return 1;
+    }
+
+    return 0;
+}
@@ -0,0 +1,339 @@
+#ifndef TREE_EXPORT_H
+#define TREE_EXPORT_H
+
+#include <cstdint>
+#include <ostream>
+#include <sstream>
+#include <string>
+#include <type_traits>
+#include <vector>
+#include "bst.h"
+
+/*
+  Graphviz DOT and JSON export of a tree, or of part of one
+
+  The export can be bounded by depth and by an inclusive key range. With a
+  key range the export starts at the highest node inside the range and
+  skips every subtree that lies wholly outside it; nodes outside the range
+  that still lead to nodes inside it are kept (marked as such) so that the
+  shape stays visible. Only the exported nodes and the path down to the
+  first of them are visited, so the cost is proportional to the output,
+  not to the size of the tree. The walks use an explicit stack, so even a
+  degenerate tree of any height can be dumped.
+
+    TreeExporter<int, int> exporter(tree);
+    exporter.maxDepth(8).keyRange(100, 200).writeDot(std::cout);
+*/
+
+/*
+* Writes a key or value as a JSON number when it is one, or as a JSON
+* string (via operator<<) otherwise. Single-byte integers are written as
+* strings so that char keys read naturally.
+*/
+template <typename T>
+typename std::enable_if<std::is_arithmetic<T>::value && (sizeof(T) > 1), void>::type
+writeExportJson(std::ostream& out, const T& item)
+{
+    out << +item;
+}
+
+template <typename T>
+typename std::enable_if<!std::is_arithmetic<T>::value || (sizeof(T) == 1), void>::type
+writeExportJson(std::ostream& out, const T& item)
+{
+    std::ostringstream text;
+    text << item;
+    std::string s = text.str();
+    out << '"';
+    for (size_t i = 0; i < s.size(); i++)
+    {
+        unsigned char c = (unsigned char)s[i];
+        if (c == '"' || c == '\\') out << '\\' << (char)c;
+        else if (c == '\n') out << "\\n";
+        else if (c < 0x20)
+        {
+            const char* hex = "0123456789abcdef";
+            out << "\\u00" << hex[c >> 4] << hex[c & 15];
+        }
+        else out << (char)c;
+    }
+    out << '"';
+}
+
+/*
+* Writes an item (via operator<<) escaped for a quoted DOT label
+*/
+template <typename T>
+void writeExportDot(std::ostream& out, const T& item)
+{
+    std::ostringstream text;
+    text << item;
+    std::string s = text.str();
+    for (size_t i = 0; i < s.size(); i++)
+    {
+        if (s[i] == '"' || s[i] == '\\') out << '\\';
+        if (s[i] == '\n') out << "\\n";
+        else out << s[i];
+    }
+}
+
+/**
+* Exports a BinarySearchTree (or AVLTree) as Graphviz DOT or JSON
+*/
+template <typename Key, typename Value, typename Compare = std::less<Key> >
+class TreeExporter
+{
+public:
+    explicit TreeExporter(const BinarySearchTree<Key, Value, Compare>& tree);
+
+    TreeExporter& maxDepth(size_t depth);            // Levels to export below the first exported node (1 = just that node)
+    TreeExporter& keyRange(const Key& lo, const Key& hi); // Only export the part of the tree holding keys in [lo, hi]
+    TreeExporter& balances(bool show);               // Include the stored AVL balance of every node
+
+    void writeDot(std::ostream& out) const;
+    void writeJson(std::ostream& out) const;
+
+protected:
+    /*
+    * One node on the explicit walk stack
+    */
+    struct Frame
+    {
+        Node<Key, Value>* node;
+        size_t depth;
+        int stage;      // JSON: 0 = not opened, 1 = left child written, 2 = right child written
+        uint64_t id;    // DOT: the node's name
+    };
+
+    enum ChildState { CHILD_NONE, CHILD_WALK, CHILD_DEPTH_CUT, CHILD_RANGE_CUT };
+
+    Node<Key, Value>* exportRoot() const;
+    bool inRange(const Node<Key, Value>* n) const;
+    ChildState childState(const Node<Key, Value>* parent, bool left, size_t parentDepth) const;
+    void writeJsonChild(std::ostream& out, ChildState state, Node<Key, Value>* child, size_t depth, std::vector<Frame>& stack) const;
+
+    const BinarySearchTree<Key, Value, Compare>& tree_;
+    size_t maxDepth_;
+    bool hasRange_;
+    Key lo_;
+    Key hi_;
+    bool balances_;
+};
+
+/*
+  -------------------------------------------------
+  Begin implementations for the TreeExporter class.
+  -------------------------------------------------
+*/
+
+template <typename Key, typename Value, typename Compare>
+TreeExporter<Key, Value, Compare>::TreeExporter(const BinarySearchTree<Key, Value, Compare>& tree) :
+    tree_(tree), maxDepth_(SIZE_MAX), hasRange_(false), lo_(), hi_(), balances_(false)
+{
+
+}
+
+template <typename Key, typename Value, typename Compare>
+TreeExporter<Key, Value, Compare>& TreeExporter<Key, Value, Compare>::maxDepth(size_t depth)
+{
+    maxDepth_ = depth;
+    return *this;
+}
+
+template <typename Key, typename Value, typename Compare>
+TreeExporter<Key, Value, Compare>& TreeExporter<Key, Value, Compare>::keyRange(const Key& lo, const Key& hi)
+{
+    hasRange_ = true;
+    lo_ = lo;
+    hi_ = hi;
+    return *this;
+}
+
+template <typename Key, typename Value, typename Compare>
+TreeExporter<Key, Value, Compare>& TreeExporter<Key, Value, Compare>::balances(bool show)
+{
+    balances_ = show;
+    return *this;
+}
+
+/*
+* Returns the first node to export: the root, or with a key range the
+* highest node inside the range (nullptr if the range is empty)
+*/
+template <typename Key, typename Value, typename Compare>
+Node<Key, Value>* TreeExporter<Key, Value, Compare>::exportRoot() const
+{
+    Node<Key, Value>* n = tree_.root_;
+    if (!hasRange_) return n;
+
+    while (n)
+    {
+        if (tree_.comp_(n->getKey(), lo_)) n = n->getRight();
+        else if (tree_.comp_(hi_, n->getKey())) n = n->getLeft();
+        else break;
+    }
+    return n;
+}
+
+template <typename Key, typename Value, typename Compare>
+bool TreeExporter<Key, Value, Compare>::inRange(const Node<Key, Value>* n) const
+{
+    return !hasRange_ || (!tree_.comp_(n->getKey(), lo_) && !tree_.comp_(hi_, n->getKey()));
+}
+
+/*
+* Decides whether a child is missing, to be walked, or cut off by the
+* depth bound or by the key range
+*/
+template <typename Key, typename Value, typename Compare>
+typename TreeExporter<Key, Value, Compare>::ChildState
+TreeExporter<Key, Value, Compare>::childState(const Node<Key, Value>* parent, bool left, size_t parentDepth) const
+{
+    Node<Key, Value>* child = left ? parent->getLeft() : parent->getRight();
+    if (!child) return CHILD_NONE;
+
+    // Everything left of a key below lo, or right of a key above hi, is out of range
+    if (hasRange_ && left && tree_.comp_(parent->getKey(), lo_)) return CHILD_RANGE_CUT;
+    if (hasRange_ && !left && tree_.comp_(hi_, parent->getKey())) return CHILD_RANGE_CUT;
+    if (parentDepth >= maxDepth_) return CHILD_DEPTH_CUT;
+    return CHILD_WALK;
+}
+
+/**
+* Writes the exported part of the tree as a Graphviz digraph. Nodes outside
+* the key range are drawn dashed, subtrees cut off by the depth bound
+* appear as "..." nodes, and subtrees wholly outside the range are left out.
+*/
+template <typename Key, typename Value, typename Compare>
+void TreeExporter<Key, Value, Compare>::writeDot(std::ostream& out) const
+{
+    out << "digraph tree {\n  node [shape=box, fontname=\"monospace\"];\n";
+
+    Node<Key, Value>* root = exportRoot();
+    uint64_t nextId = 0;
+    std::vector<Frame> stack;
+    if (root && maxDepth_ > 0)
+    {
+        Frame top = { root, 1, 0, nextId++ };
+        stack.push_back(top);
+    }
+
+    while (!stack.empty())
+    {
+        Frame f = stack.back();
+        stack.pop_back();
+
+        out << "  n" << f.id << " [label=\"";
+        writeExportDot(out, f.node->getKey());
+        out << "\\n";
+        writeExportDot(out, f.node->getValue());
+        if (balances_) out << "\\nbalance " << (int)tree_.getNodeBalance(f.node);
+        out << "\"" << (inRange(f.node) ? "" : ", style=dashed") << "];\n";
+
+        // Children cut by the key range are left out. Edges are written
+        // left first, but the right child is pushed first so that the
+        // left subtree is also written first.
+        Frame children[2];
+        int walked = 0;
+        for (int side = 0; side < 2; side++)
+        {
+            bool left = side == 0;
+            ChildState state = childState(f.node, left, f.depth);
+            if (state == CHILD_NONE || state == CHILD_RANGE_CUT) continue;
+
+            uint64_t id = nextId++;
+            out << "  n" << f.id << " -> n" << id << " [label=\"" << (left ? 'L' : 'R') << "\"];\n";
+            if (state == CHILD_WALK)
+            {
+                Frame child = { left ? f.node->getLeft() : f.node->getRight(), f.depth + 1, 0, id };
+                children[walked++] = child;
+            }
+            else
+            {
+                out << "  n" << id << " [label=\"...\", shape=plaintext];\n";
+            }
+        }
+        while (walked > 0) stack.push_back(children[--walked]);
+    }
+
+    out << "}\n";
+}
+
+/*
+* Helper for writeJson
+* Writes a child that is missing or cut off, or pushes it to be written
+*/
+template <typename Key, typename Value, typename Compare>
+void TreeExporter<Key, Value, Compare>::writeJsonChild(std::ostream& out, ChildState state, Node<Key, Value>* child, size_t depth, std::vector<Frame>& stack) const
+{
+    if (state == CHILD_NONE) out << "null";
+    else if (state == CHILD_DEPTH_CUT) out << "{\"cut\": \"depth\"}";
+    else if (state == CHILD_RANGE_CUT) out << "{\"cut\": \"range\"}";
+    else
+    {
+        Frame f = { child, depth, 0, 0 };
+        stack.push_back(f);
+    }
+}
+
+/**
+* Writes the exported part of the tree as nested JSON objects:
+*   {"key": k, "value": v, "left": child, "right": child}
+* where a child is null, another node, or {"cut": "depth"|"range"}. With
+* a key range every node also has "inRange", and with balances() on a
+* "balance". An empty export is written as null.
+*/
+template <typename Key, typename Value, typename Compare>
+void TreeExporter<Key, Value, Compare>::writeJson(std::ostream& out) const
+{
+    Node<Key, Value>* root = exportRoot();
+    if (!root || maxDepth_ == 0)
+    {
+        out << "null\n";
+        return;
+    }
+
+    std::vector<Frame> stack;
+    Frame top = { root, 1, 0, 0 };
+    stack.push_back(top);
+
+    while (!stack.empty())
+    {
+        Frame& f = stack.back();
+        Node<Key, Value>* n = f.node;
+        size_t depth = f.depth;
+
+        if (f.stage == 0)
+        {
+            f.stage = 1;
+            out << "{\"key\": ";
+            writeExportJson(out, n->getKey());
+            out << ", \"value\": ";
+            writeExportJson(out, n->getValue());
+            if (balances_) out << ", \"balance\": " << (int)tree_.getNodeBalance(n);
+            if (hasRange_) out << ", \"inRange\": " << (inRange(n) ? "true" : "false");
+            out << ", \"left\": ";
+            writeJsonChild(out, childState(n, true, depth), n->getLeft(), depth + 1, stack); // may invalidate f
+        }
+        else if (f.stage == 1)
+        {
+            f.stage = 2;
+            out << ", \"right\": ";
+            writeJsonChild(out, childState(n, false, depth), n->getRight(), depth + 1, stack); // may invalidate f
+        }
+        else
+        {
+            out << "}";
+            stack.pop_back();
+        }
+    }
+    out << "\n";
+}
+
+/*
+  -----------------------------------------------
+  End implementations for the TreeExporter class.
+  -----------------------------------------------
+*/
+
+#endif
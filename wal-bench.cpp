@@ -0,0 +1,93 @@
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include "avlbst.h"
+#include "avl_wal.h"
+#include "bench_util.h"
+
+using namespace std;
+
+/*
+* True if tree holds exactly the n inserted items
+*/
+bool recoveredAll(const DurableAVLTree<uint64_t, uint64_t>& tree, const vector<uint64_t>& keys)
+{
+    if (tree.size() != keys.size()) return false;
+    for (size_t i = 0; i < keys.size(); i++)
+    {
+        AVLTree<uint64_t, uint64_t>::iterator it = tree.find(keys[i]);
+        if (it == tree.end() || it->second != i) return false;
+    }
+    return true;
+}
+
+// Measures the cost of logging mutations and the time to recover a durable tree,
+// and checks that every insert survives each recovery.
+// Usage: ./wal-bench [number of inserts] [directory to use]
+
+int main(int argc, char* argv[])
+{
+    size_t n = benchSizeArg(argc, argv, 1, 1000000);
+    string dir = argc > 2 ? argv[2] : "wal-bench.data";
+    if (system(("rm -rf '" + dir + "' && mkdir -p '" + dir + "'").c_str()) != 0) return 1;
+    vector<uint64_t> keys = randomKeys(n, 7);
+
+    BenchTimer timer;
+    {
+        AVLTree<uint64_t, uint64_t> plain;
+        for (size_t i = 0; i < n; i++) plain.insert(make_pair(keys[i], (uint64_t)i));
+    }
+    double plainTime = timer.seconds();
+
+    WalOptions options;
+    options.groupCommitOps = 1024;
+    options.checkpointEveryOps = n / 2 + 1;
+    timer.restart();
+    {
+        DurableAVLTree<uint64_t, uint64_t> durable(dir, options);
+        for (size_t i = 0; i < n; i++) durable.insert(make_pair(keys[i], (uint64_t)i));
+        durable.sync();
+    }
+    double durableTime = timer.seconds();
+
+    // Recover from a checkpoint plus roughly half of the inserts in the log
+    timer.restart();
+    size_t replayed;
+    bool complete;
+    {
+        DurableAVLTree<uint64_t, uint64_t> recovered(dir, options);
+        replayed = recovered.recoveredOps();
+    }
+    double recoverTime = timer.seconds();
+
+    // Check outside the timings, after each kind of recovery
+    {
+        DurableAVLTree<uint64_t, uint64_t> recovered(dir, options);
+        complete = recoveredAll(recovered, keys);
+    }
+
+    // Recover from the checkpoint alone
+    DurableAVLTree<uint64_t, uint64_t>* fresh = new DurableAVLTree<uint64_t, uint64_t>(dir, options);
+    fresh->checkpoint();
+    delete fresh;
+    timer.restart();
+    {
+        DurableAVLTree<uint64_t, uint64_t> recovered(dir, options);
+    }
+    double checkpointOnlyTime = timer.seconds();
+
+    {
+        DurableAVLTree<uint64_t, uint64_t> recovered(dir, options);
+        complete = complete && recoveredAll(recovered, keys);
+    }
+
+    cout << "inserts:                    " << n << endl;
+    cout << "plain AVLTree insert:       " << n / plainTime << " ops/s" << endl;
+    cout << "durable insert (group " << options.groupCommitOps << "): " << n / durableTime << " ops/s" << endl;
+    cout << "recovery (checkpoint + " << replayed << " log records): " << recoverTime * 1000 << " ms" << endl;
+    cout << "recovery (checkpoint only): " << checkpointOnlyTime * 1000 << " ms" << endl;
+
+    if (!complete) cout << "ERROR: a recovered tree does not hold every insert" << endl;
+
+    return system(("rm -rf '" + dir + "'").c_str()) == 0 && complete ? 0 : 1;
+}